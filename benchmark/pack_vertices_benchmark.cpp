@@ -0,0 +1,117 @@
+#include "object.h"
+#include "thread_pool.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <limits>
+#include <random>
+
+// Compares the emplace_back loop that ObjectGL used to fill its vertex data with ObjectGL::packVertices(), on one
+// thread and split over the thread pool as uploadVertices() does. Each case is run a few times and the best time is
+// reported, so that page faults of the first run do not count.
+namespace
+{
+   constexpr size_t DefaultVertexNum = 1 << 22;
+   constexpr int RunNum = 5;
+
+   template<typename Function>
+   double getBestMilliseconds(const Function& function)
+   {
+      double best = std::numeric_limits<double>::max();
+      for (int i = 0; i < RunNum; ++i) {
+         const auto start = std::chrono::steady_clock::now();
+         function();
+         const auto end = std::chrono::steady_clock::now();
+         best = std::min( best, std::chrono::duration<double, std::milli>(end - start).count() );
+      }
+      return best;
+   }
+
+   void packWithEmplaceBack(
+      std::vector<GLfloat>& data,
+      const std::vector<glm::vec3>& vertices,
+      const std::vector<glm::vec3>& normals,
+      const std::vector<glm::vec2>& textures
+   )
+   {
+      data.clear();
+      data.shrink_to_fit();
+      for (size_t i = 0; i < vertices.size(); ++i) {
+         data.emplace_back( vertices[i].x );
+         data.emplace_back( vertices[i].y );
+         data.emplace_back( vertices[i].z );
+         data.emplace_back( normals[i].x );
+         data.emplace_back( normals[i].y );
+         data.emplace_back( normals[i].z );
+         data.emplace_back( textures[i].x );
+         data.emplace_back( textures[i].y );
+      }
+   }
+}
+
+int main(int argc, char* argv[])
+{
+   const size_t vertex_num = argc > 1 ? std::strtoull( argv[1], nullptr, 10 ) : DefaultVertexNum;
+   if (vertex_num == 0) {
+      std::cerr << "Usage: PackVerticesBenchmark [vertex number]\n";
+      return 1;
+   }
+
+   std::mt19937 generator(0);
+   std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+   std::vector<glm::vec3> vertices(vertex_num), normals(vertex_num);
+   std::vector<glm::vec2> textures(vertex_num);
+   for (size_t i = 0; i < vertex_num; ++i) {
+      vertices[i] = glm::vec3(distribution( generator ), distribution( generator ), distribution( generator ));
+      normals[i] = glm::vec3(distribution( generator ), distribution( generator ), distribution( generator ));
+      textures[i] = glm::vec2(distribution( generator ), distribution( generator ));
+   }
+
+   std::vector<GLfloat> expected;
+   const double emplace_back_time = getBestMilliseconds(
+      [&]() { packWithEmplaceBack( expected, vertices, normals, textures ); }
+   );
+
+   std::vector<GLfloat> packed;
+   const double serial_time = getBestMilliseconds(
+      [&]() {
+         packed.clear();
+         packed.shrink_to_fit();
+         packed.resize( 8 * vertex_num );
+         ObjectGL::packVertices(
+            packed.data(), vertices.data(), normals.data(), textures.data(), vertex_num, 0, vertex_num
+         );
+      }
+   );
+   if (packed != expected) {
+      std::cerr << "packVertices does not match the emplace_back loop\n";
+      return 1;
+   }
+
+   const double parallel_time = getBestMilliseconds(
+      [&]() {
+         packed.clear();
+         packed.shrink_to_fit();
+         packed.resize( 8 * vertex_num );
+         ThreadPool::getInstance().parallelFor(
+            vertex_num, 1 << 16,
+            [&](size_t begin, size_t end) {
+               ObjectGL::packVertices(
+                  packed.data(), vertices.data(), normals.data(), textures.data(), vertex_num, begin, end
+               );
+            }
+         );
+      }
+   );
+   if (packed != expected) {
+      std::cerr << "The parallel packVertices does not match the emplace_back loop\n";
+      return 1;
+   }
+
+   std::cout << vertex_num << " vertices with normals and textures, best of " << RunNum << " runs\n";
+   std::cout << "emplace_back loop: " << emplace_back_time << " ms\n";
+   std::cout << "packVertices: " << serial_time << " ms (" << emplace_back_time / serial_time << "x)\n";
+   std::cout << "packVertices on " << ThreadPool::getInstance().getThreadNum() << " threads: " << parallel_time
+      << " ms (" << emplace_back_time / parallel_time << "x)\n";
+   return 0;
+}
\ No newline at end of file
@@ -21,6 +21,7 @@
 #include <sstream>
 #include <fstream>
 #include <chrono>
+#include <memory>
 
 #include "project_constants.h"
 
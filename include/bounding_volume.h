@@ -0,0 +1,52 @@
+#pragma once
+
+#include "base.h"
+#include <limits>
+
+// An axis-aligned box and a sphere around a set of positions in object space. The box suits picking and fitting
+// shadow frusta, and the sphere, which is usually tighter than the sphere around the box, suits culling and LODs.
+struct BoundingVolume
+{
+   glm::vec3 BoxMin = glm::vec3(std::numeric_limits<float>::max());
+   glm::vec3 BoxMax = glm::vec3(std::numeric_limits<float>::lowest());
+   glm::vec3 SphereCenter = glm::vec3(0.0f);
+   float SphereRadius = 0.0f;
+
+   [[nodiscard]] bool isEmpty() const { return BoxMin.x > BoxMax.x; }
+   [[nodiscard]] glm::vec3 getBoxCenter() const { return (BoxMin + BoxMax) * 0.5f; }
+   [[nodiscard]] glm::vec3 getBoxExtent() const { return (BoxMax - BoxMin) * 0.5f; }
+   // Whether the position lies on a face of the box, so that moving it away may shrink the volumes.
+   [[nodiscard]] bool touchesBoundary(const glm::vec3& position) const
+   {
+      return glm::any( glm::equal( position, BoxMin ) ) || glm::any( glm::equal( position, BoxMax ) );
+   }
+
+   // Grows both volumes just enough to enclose the position, which keeps the sphere a Ritter sphere.
+   void expand(const glm::vec3& position);
+
+   // positions[stride * i] is the first coordinate of the i-th position, and stride is in floats.
+   // The box comes from a parallel SIMD min/max reduction; the sphere is Ritter's sphere seeded with the extreme
+   // positions along the widest axis of the box, unless the sphere around the box center is tighter.
+   [[nodiscard]] static BoundingVolume get(const GLfloat* positions, size_t stride, size_t vertex_num);
+
+private:
+   static constexpr size_t BlockSize = 1 << 16;
+
+   [[nodiscard]] static glm::vec3 getPosition(const GLfloat* positions, size_t stride, size_t index)
+   {
+      const GLfloat* p = positions + stride * index;
+      return { p[0], p[1], p[2] };
+   }
+   // Ritter's step: the sphere grows toward an outside position until it touches it, keeping its far side.
+   void growSphere(const glm::vec3& position);
+
+   static void getBox(
+      const GLfloat* positions,
+      size_t stride,
+      size_t begin,
+      size_t end,
+      glm::vec3& min_point,
+      glm::vec3& max_point
+   );
+   static void setSphere(BoundingVolume& volume, const GLfloat* positions, size_t stride, size_t vertex_num);
+};
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "base.h"
+#include <array>
 
 class CameraGL
 {
@@ -19,6 +20,13 @@ public:
    [[nodiscard]] glm::vec3 getCameraPosition() const { return CamPos; }
    [[nodiscard]] const glm::mat4& getViewMatrix() const { return ViewMatrix; }
    [[nodiscard]] const glm::mat4& getProjectionMatrix() const { return ProjectionMatrix; }
+   [[nodiscard]] std::array<glm::vec4, 6> getFrustumPlanes() const
+   {
+      return getFrustumPlanes( ProjectionMatrix * ViewMatrix );
+   }
+   // The planes bounding what matrix maps into the clip volume, in the space it maps from, as (a, b, c, d) with
+   // unit normals (a, b, c) pointing inside.
+   [[nodiscard]] static std::array<glm::vec4, 6> getFrustumPlanes(const glm::mat4& matrix);
    void setMovingState(bool is_moving) { IsMoving = is_moving; }
    void updateCamera();
    void pitch(int angle);
@@ -0,0 +1,196 @@
+#pragma once
+
+#include "base.h"
+#include <array>
+#include <cstring>
+#include <functional>
+#include <type_traits>
+
+// Records GL commands as plain structs in a linear arena so that any thread can prepare them, while execute()
+// replays them on the thread that owns the GL context. Binding a VAO, program or texture that the list already
+// bound last is not recorded again; the filter is per list, so each list starts from an unknown state.
+class CommandListGL final
+{
+public:
+   CommandListGL() = default;
+   ~CommandListGL() = default;
+
+   // Keeps the arena, so that lists recorded every frame stop allocating once they have grown.
+   void clear();
+   void bindVertexArray(GLuint vao);
+   void useProgram(GLuint program);
+   void bindTextureUnit(GLuint unit, GLuint texture);
+   void bindBufferBase(GLenum target, GLuint index, GLuint buffer);
+   void uniform1i(GLuint program, GLint location, GLint value) { push( Uniform1iCommand{ program, location, value } ); }
+   void uniform1f(GLuint program, GLint location, GLfloat value)
+   {
+      push( Uniform1fCommand{ program, location, value } );
+   }
+   void uniform4fv(GLuint program, GLint location, const glm::vec4& value)
+   {
+      push( Uniform4fvCommand{ program, location, value } );
+   }
+   void uniformMat4fv(GLuint program, GLint location, const glm::mat4& value)
+   {
+      push( UniformMatrix4fvCommand{ program, location, value } );
+   }
+   // The offset is in bytes into the bound index buffer.
+   void drawElements(
+      GLenum mode,
+      GLsizei count,
+      GLenum index_type,
+      size_t offset,
+      GLsizei instance_num,
+      GLint base_vertex,
+      GLuint base_instance
+   );
+   // The offset is in bytes into the bound draw indirect buffer.
+   void multiDrawElementsIndirect(GLenum mode, GLenum index_type, size_t offset, GLsizei draw_num);
+   void execute() const;
+   [[nodiscard]] size_t getCommandNum() const { return CommandNum; }
+   [[nodiscard]] size_t getSize() const { return Arena.size(); }
+
+private:
+   enum TYPE : uint32_t {
+      BindVertexArray = 0,
+      UseProgram,
+      BindTextureUnit,
+      BindBufferBase,
+      Uniform1i,
+      Uniform1f,
+      Uniform4fv,
+      UniformMatrix4fv,
+      DrawElements,
+      MultiDrawElementsIndirect
+   };
+
+   struct Header
+   {
+      TYPE Type;
+      uint32_t Size;
+   };
+   struct BindVertexArrayCommand
+   {
+      static constexpr TYPE Type = BindVertexArray;
+      GLuint VAO;
+   };
+   struct UseProgramCommand
+   {
+      static constexpr TYPE Type = UseProgram;
+      GLuint Program;
+   };
+   struct BindTextureUnitCommand
+   {
+      static constexpr TYPE Type = BindTextureUnit;
+      GLuint Unit;
+      GLuint Texture;
+   };
+   struct BindBufferBaseCommand
+   {
+      static constexpr TYPE Type = BindBufferBase;
+      GLenum Target;
+      GLuint Index;
+      GLuint Buffer;
+   };
+   struct Uniform1iCommand
+   {
+      static constexpr TYPE Type = Uniform1i;
+      GLuint Program;
+      GLint Location;
+      GLint Value;
+   };
+   struct Uniform1fCommand
+   {
+      static constexpr TYPE Type = Uniform1f;
+      GLuint Program;
+      GLint Location;
+      GLfloat Value;
+   };
+   struct Uniform4fvCommand
+   {
+      static constexpr TYPE Type = Uniform4fv;
+      GLuint Program;
+      GLint Location;
+      glm::vec4 Value;
+   };
+   struct UniformMatrix4fvCommand
+   {
+      static constexpr TYPE Type = UniformMatrix4fv;
+      GLuint Program;
+      GLint Location;
+      glm::mat4 Value;
+   };
+   struct DrawElementsCommand
+   {
+      static constexpr TYPE Type = DrawElements;
+      GLenum Mode;
+      GLsizei Count;
+      GLenum IndexType;
+      GLsizei InstanceNum;
+      GLint BaseVertex;
+      GLuint BaseInstance;
+      uint64_t Offset;
+   };
+   struct MultiDrawElementsIndirectCommand
+   {
+      static constexpr TYPE Type = MultiDrawElementsIndirect;
+      GLenum Mode;
+      GLenum IndexType;
+      GLsizei DrawNum;
+      uint64_t Offset;
+   };
+
+   static constexpr size_t MaxFilteredTextureUnitNum = 16;
+
+   std::vector<uint8_t> Arena;
+   size_t CommandNum = 0;
+   // What this list bound last, or 0 when it has not bound anything yet.
+   GLuint BoundVAO = 0;
+   GLuint UsedProgram = 0;
+   std::array<GLuint, MaxFilteredTextureUnitNum> BoundTextures{};
+
+   // Every command is a header followed by its struct, padded so that the next header stays aligned.
+   template<typename T>
+   void push(const T& command)
+   {
+      static_assert( std::is_trivially_copyable_v<T>, "Commands have to be plain structs." );
+      constexpr size_t alignment = alignof( Header );
+      constexpr auto size = static_cast<uint32_t>((sizeof( T ) + alignment - 1) / alignment * alignment);
+      const size_t offset = Arena.size();
+      Arena.resize( offset + sizeof( Header ) + size );
+      const Header header{ T::Type, size };
+      std::memcpy( Arena.data() + offset, &header, sizeof( Header ) );
+      std::memcpy( Arena.data() + offset + sizeof( Header ), &command, sizeof( T ) );
+      ++CommandNum;
+   }
+   template<typename T>
+   [[nodiscard]] static T read(const uint8_t* data)
+   {
+      T command;
+      std::memcpy( &command, data, sizeof( T ) );
+      return command;
+   }
+};
+
+// A list per range of a parallel loop. The ranges are fixed by the count alone and replayed in order, so the
+// commands come out in the same order however the ranges were spread over the threads.
+class CommandListSetGL final
+{
+public:
+   CommandListSetGL() = default;
+   ~CommandListSetGL() = default;
+
+   // Splits [0, count) into ranges of at least min_count_per_list and calls recorder(list, begin, end) for each
+   // range on the thread pool, with a cleared list of its own.
+   void record(
+      size_t count,
+      size_t min_count_per_list,
+      const std::function<void(CommandListGL&, size_t, size_t)>& recorder
+   );
+   void execute() const;
+   [[nodiscard]] size_t getCommandNum() const;
+
+private:
+   std::vector<CommandListGL> Lists;
+   size_t ListNum = 0;
+};
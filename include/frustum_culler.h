@@ -0,0 +1,54 @@
+#pragma once
+
+#include "base.h"
+#include <array>
+
+// Tests bounding spheres against the six planes of a frustum. The spheres are kept as separate arrays of center
+// coordinates and radii, padded to a multiple of eight, so that one AVX iteration, or two SSE ones, tests eight
+// spheres against a plane at once. Blocks of spheres are culled in parallel into a compacted list of the indices
+// of the visible spheres, in ascending order.
+class FrustumCuller final
+{
+public:
+   FrustumCuller() = default;
+   ~FrustumCuller() = default;
+
+   // New spheres are empty and never visible until they are set.
+   void resize(size_t sphere_num);
+   // Different spheres can be set from different threads.
+   void setSphere(size_t index, const glm::vec3& center, float radius)
+   {
+      CentersX[index] = center.x;
+      CentersY[index] = center.y;
+      CentersZ[index] = center.z;
+      Radii[index] = radius;
+   }
+   // planes are (a, b, c, d) with unit normals (a, b, c) pointing inside, as CameraGL::getFrustumPlanes() gives.
+   void cull(const std::array<glm::vec4, 6>& planes, bool parallel = true);
+   // Makes every sphere visible, for drawing without culling.
+   void setAllVisible();
+   [[nodiscard]] size_t getSphereNum() const { return SphereNum; }
+   [[nodiscard]] const std::vector<uint32_t>& getVisibleIndices() const { return VisibleIndices; }
+
+private:
+   static constexpr size_t LaneNum = 8;
+   static constexpr size_t BlockSize = 1 << 13;
+
+   size_t SphereNum = 0;
+   std::vector<float> CentersX;
+   std::vector<float> CentersY;
+   std::vector<float> CentersZ;
+   std::vector<float> Radii;
+   std::vector<uint32_t> VisibleIndices;
+   // Each block first writes its visible indices from its own offset, and the counts tell where they go.
+   std::vector<uint32_t> BlockVisibleIndices;
+   std::vector<size_t> BlockVisibleNums;
+
+   // Writes the visible indices in [begin, end), a range of whole lanes, to visible and returns their number.
+   [[nodiscard]] size_t cullBlock(
+      const std::array<glm::vec4, 6>& planes,
+      size_t begin,
+      size_t end,
+      uint32_t* visible
+   ) const;
+};
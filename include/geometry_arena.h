@@ -0,0 +1,76 @@
+#pragma once
+
+#include "tlsf_allocator.h"
+#include <array>
+
+// Shares a few large GL buffers among many objects. Each interleaved vertex layout has one vertex buffer and one VAO,
+// and every layout uses the same GLuint index buffer, so objects of a layout are drawn back to back without
+// rebinding, addressed by their base vertex and first index. The buffers grow by doubling, which keeps every offset.
+class GeometryArenaGL final
+{
+public:
+   GeometryArenaGL(const GeometryArenaGL&) = delete;
+   GeometryArenaGL(const GeometryArenaGL&&) = delete;
+   GeometryArenaGL& operator=(const GeometryArenaGL&) = delete;
+   GeometryArenaGL& operator=(const GeometryArenaGL&&) = delete;
+
+   struct VertexAllocation
+   {
+      TLSFAllocator::Allocation Range;
+      bool NormalsExist = false;
+      bool TexturesExist = false;
+   };
+
+   // No GL object is created until the first allocation.
+   explicit GeometryArenaGL(size_t initial_vertex_num = 1 << 16, size_t initial_index_num = 1 << 18);
+   ~GeometryArenaGL();
+
+   // Offsets and sizes are in vertices of the layout. Empty requests get an invalid allocation at offset 0.
+   [[nodiscard]] VertexAllocation allocateVertices(bool normals_exist, bool textures_exist, size_t vertex_num);
+   // Offsets and sizes are in GLuint indices.
+   [[nodiscard]] TLSFAllocator::Allocation allocateIndices(size_t index_num);
+   void freeVertices(const VertexAllocation& allocation);
+   void freeIndices(const TLSFAllocator::Allocation& allocation);
+   // Buffer names change when the arena grows, so they should be asked for whenever they are used.
+   [[nodiscard]] GLuint getVertexBuffer(bool normals_exist, bool textures_exist) const
+   {
+      return VertexPools[getLayoutIndex( normals_exist, textures_exist )].Buffer;
+   }
+   [[nodiscard]] GLuint getVAO(bool normals_exist, bool textures_exist) const
+   {
+      return VertexPools[getLayoutIndex( normals_exist, textures_exist )].VAO;
+   }
+   [[nodiscard]] GLuint getPositionVAO(bool normals_exist, bool textures_exist) const
+   {
+      return VertexPools[getLayoutIndex( normals_exist, textures_exist )].PositionVAO;
+   }
+   [[nodiscard]] GLuint getIndexBuffer() const { return IndexBuffer; }
+   [[nodiscard]] static GLsizei getVertexStride(bool normals_exist, bool textures_exist)
+   {
+      return static_cast<GLsizei>((3 + (normals_exist ? 3 : 0) + (textures_exist ? 2 : 0)) * sizeof( GLfloat ));
+   }
+
+private:
+   struct VertexPool
+   {
+      GLuint Buffer = 0;
+      GLuint VAO = 0;
+      GLuint PositionVAO = 0;
+      TLSFAllocator Allocator;
+   };
+
+   size_t InitialVertexNum;
+   size_t InitialIndexNum;
+   std::array<VertexPool, 4> VertexPools;
+   GLuint IndexBuffer;
+   TLSFAllocator IndexAllocator;
+
+   [[nodiscard]] static int getLayoutIndex(bool normals_exist, bool textures_exist)
+   {
+      return (normals_exist ? 1 : 0) | (textures_exist ? 2 : 0);
+   }
+   [[nodiscard]] static GLuint createBuffer(GLsizeiptr size, GLuint old_buffer = 0, GLsizeiptr old_size = 0);
+   void createVertexPool(bool normals_exist, bool textures_exist);
+   void growVertexPool(bool normals_exist, bool textures_exist, size_t required_vertex_num);
+   void growIndexBuffer(size_t required_index_num);
+};
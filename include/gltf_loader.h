@@ -0,0 +1,83 @@
+#pragma once
+
+#include "object.h"
+
+// Loads binary glTF 2.0 (.glb) files. Every mesh primitive becomes one ObjectGL whose vertex and index data are
+// copied from the memory-mapped binary chunk in their accessor formats; embedded images are decoded in parallel.
+class GLTFLoader final
+{
+public:
+   GLTFLoader() = delete;
+
+   [[nodiscard]] static bool load(std::vector<std::unique_ptr<ObjectGL>>& objects, const std::string& file_path);
+
+private:
+   struct JSON
+   {
+      enum TYPE { Null = 0, Boolean, Number, String, Array, Object };
+
+      TYPE Type = Null;
+      bool BooleanValue = false;
+      double NumberValue = 0.0;
+      std::string StringValue;
+      std::vector<JSON> Elements;
+      std::vector<std::pair<std::string, JSON>> Members;
+
+      [[nodiscard]] const JSON* find(const char* key) const;
+      [[nodiscard]] const JSON* at(size_t index) const { return index < Elements.size() ? &Elements[index] : nullptr; }
+      [[nodiscard]] int getInt(const char* key, int default_value) const;
+      [[nodiscard]] float getFloat(const char* key, float default_value) const;
+      [[nodiscard]] std::string getString(const char* key) const;
+   };
+
+   struct Image
+   {
+      int Width = 0;
+      int Height = 0;
+      std::vector<uint8_t> Pixels;
+   };
+
+   struct BinaryChunk
+   {
+      const uint8_t* Data = nullptr;
+      size_t Size = 0;
+   };
+
+   [[nodiscard]] static bool parseJSON(const char*& ptr, const char* end, JSON& value, int depth = 0);
+   [[nodiscard]] static bool parseJSONString(const char*& ptr, const char* end, std::string& value);
+   static void skipWhitespace(const char*& ptr, const char* end);
+   [[nodiscard]] static const JSON* getBufferView(const JSON& document, int buffer_view_index);
+   [[nodiscard]] static const uint8_t* getBufferViewData(
+      const JSON& buffer_view,
+      const BinaryChunk& binary,
+      size_t byte_offset,
+      size_t byte_size
+   );
+   [[nodiscard]] static bool getAccessorStream(
+      const JSON& document,
+      const BinaryChunk& binary,
+      int accessor_index,
+      ObjectGL::LayoutLocation location,
+      ObjectGL::VertexStream& stream,
+      GLsizei& count
+   );
+   // indices has to be an unsigned byte, short or int stream with at least i + 1 elements.
+   [[nodiscard]] static GLuint readIndex(const ObjectGL::VertexStream& indices, size_t i);
+   // Streams created for a primitive that lacks them; they have to outlive the streams that point into them.
+   struct GeneratedStreams
+   {
+      std::vector<glm::vec3> Normals;
+      std::vector<glm::vec4> Tangents;
+   };
+   // Adds smooth normals when the triangle list has none, and tangents when it has float texture coordinates
+   // but no tangents. Positions, and normals that are read back for the tangents, have to be float vectors.
+   static void generateStreams(
+      std::vector<ObjectGL::VertexStream>& streams,
+      GLsizei vertex_num,
+      const ObjectGL::VertexStream* indices,
+      GLsizei index_num,
+      GeneratedStreams& generated
+   );
+   [[nodiscard]] static std::vector<Image> decodeImages(const JSON& document, const BinaryChunk& binary);
+   static void setMaterial(ObjectGL& object, const JSON& document, int material_index, const std::vector<Image>& images);
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "base.h"
+
+// An offscreen target for the scene and a hierarchical-Z pyramid of its depth. The first level of the pyramid is a
+// copy of the depth buffer, and every texel of the next levels holds the farthest depth of the texels it covers in
+// the level below, so a box whose nearest depth is farther than the texels under it is hidden.
+class HiZBufferGL final
+{
+public:
+   HiZBufferGL(const HiZBufferGL&) = delete;
+   HiZBufferGL(const HiZBufferGL&&) = delete;
+   HiZBufferGL& operator=(const HiZBufferGL&) = delete;
+   HiZBufferGL& operator=(const HiZBufferGL&&) = delete;
+
+   // No GL object is created until the size is set.
+   HiZBufferGL();
+   ~HiZBufferGL();
+
+   // Recreates the targets and the pyramid only when the size changes.
+   void setSize(int width, int height);
+   // Copies the color of the scene to the default framebuffer.
+   void blitToScreen() const;
+   [[nodiscard]] GLuint getFramebuffer() const { return Framebuffer; }
+   [[nodiscard]] GLuint getDepthTexture() const { return DepthTexture; }
+   [[nodiscard]] GLuint getPyramid() const { return Pyramid; }
+   [[nodiscard]] int getLevelNum() const { return LevelNum; }
+   [[nodiscard]] glm::ivec2 getLevelSize(int level) const
+   {
+      return glm::max( glm::ivec2(Width >> level, Height >> level), glm::ivec2(1) );
+   }
+
+private:
+   int Width;
+   int Height;
+   int LevelNum;
+   GLuint Framebuffer;
+   GLuint ColorTexture;
+   GLuint DepthTexture;
+   GLuint Pyramid;
+
+   void release();
+};
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "object.h"
+#include <map>
+#include <tuple>
+
+// Turns a list of draws into one DrawElementsIndirectCommand buffer whose commands are grouped by the GL state
+// they need, so that each group is submitted with a single glMultiDrawElementsIndirect(). Every draw brings its
+// instances, which go to one shared instance buffer; the commands point at them through their base instance, and
+// the scene shader reads them at gl_BaseInstance + gl_InstanceID as it does for instanced draws.
+// Only objects that share a VAO, such as the objects of a geometry arena, can share a bucket.
+class IndirectBatcherGL final
+{
+public:
+   // The commands of a bucket are [CommandOffset, CommandOffset + CommandNum) in the command buffer.
+   struct Bucket
+   {
+      GLuint VAO;
+      GLenum DrawMode;
+      GLenum IndexType;
+      GLuint TextureID;
+      GLsizei CommandOffset;
+      GLsizei CommandNum;
+   };
+
+   IndirectBatcherGL(const IndirectBatcherGL&) = delete;
+   IndirectBatcherGL(const IndirectBatcherGL&&) = delete;
+   IndirectBatcherGL& operator=(const IndirectBatcherGL&) = delete;
+   IndirectBatcherGL& operator=(const IndirectBatcherGL&&) = delete;
+
+   IndirectBatcherGL();
+   ~IndirectBatcherGL();
+
+   void clear();
+   // A texture ID of 0 draws without a texture. Draws of the same mesh added one after another in a bucket are
+   // merged into one command.
+   void add(const ObjectGL& object, GLuint texture_id, const ObjectGL::Instance* instances, GLsizei instance_num);
+   void add(const ObjectGL& object, GLuint texture_id, const glm::mat4& to_world, GLuint material_index)
+   {
+      const ObjectGL::Instance instance{ to_world, material_index, { 0, 0, 0 } };
+      add( object, texture_id, &instance, 1 );
+   }
+   // Uploads the commands and the instances of everything added since clear().
+   void build();
+   [[nodiscard]] const std::vector<Bucket>& getBuckets() const { return Buckets; }
+   [[nodiscard]] GLuint getCommandBuffer() const { return CommandBuffer; }
+   [[nodiscard]] GLuint getInstanceBuffer() const { return InstanceBuffer; }
+   [[nodiscard]] size_t getCommandNum() const { return CommandNum; }
+
+private:
+   using BucketKey = std::tuple<GLuint, GLenum, GLenum, GLuint>;
+
+   std::map<BucketKey, size_t> BucketIndices;
+   std::vector<Bucket> Buckets;
+   std::vector<std::vector<ObjectGL::DrawElementsIndirectCommand>> BucketCommands;
+   std::vector<ObjectGL::Instance> Instances;
+   std::vector<ObjectGL::DrawElementsIndirectCommand> Commands;
+   size_t CommandNum;
+   GLuint CommandBuffer;
+   GLsizeiptr CommandBufferSize;
+   GLuint InstanceBuffer;
+   GLsizeiptr InstanceBufferSize;
+
+   // Makes sure the buffer holds size bytes, doubling its size when it has to grow; the contents are not kept.
+   static void reserveBuffer(GLuint& buffer, GLsizeiptr& buffer_size, GLsizeiptr size);
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "base.h"
+
+// A read-only view of a whole file through the OS page cache, so loaders parse it without copying it first.
+class MappedFile final
+{
+public:
+   MappedFile(const MappedFile&) = delete;
+   MappedFile(const MappedFile&&) = delete;
+   MappedFile& operator=(const MappedFile&) = delete;
+   MappedFile& operator=(const MappedFile&&) = delete;
+
+   MappedFile();
+   ~MappedFile();
+
+   [[nodiscard]] bool open(const std::string& file_path);
+   void close();
+   [[nodiscard]] bool isOpen() const { return Data != nullptr; }
+   [[nodiscard]] const uint8_t* getData() const { return Data; }
+   [[nodiscard]] size_t getSize() const { return Size; }
+
+private:
+   const uint8_t* Data;
+   size_t Size;
+#ifdef _WIN32
+   void* FileHandle;
+   void* MappingHandle;
+#endif
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "object.h"
+
+// Caches meshes in a GPU-ready binary file. The vertices are stored welded, in first-use order and already packed in
+// the interleaved layout of ObjectGL, followed by the indices of every level of detail. Both blocks are page-aligned, so a warm start maps
+// the file and hands them to the buffer storage as they are. The cache is rebuilt when the source hash changes.
+class MeshCache final
+{
+public:
+   MeshCache() = delete;
+
+   // Loads an OBJ file through its cache, which is file_path + ".meshcache" unless cache_path is given.
+   [[nodiscard]] static bool load(ObjectGL& object, const std::string& file_path, const std::string& cache_path = "");
+   // The hash of the whole file that keys the cache. It does not depend on the number of threads.
+   [[nodiscard]] static uint64_t getHash(const uint8_t* data, size_t size);
+
+private:
+   struct AttributeDescriptor
+   {
+      uint32_t Location;
+      uint32_t ComponentNum;
+      uint32_t ComponentType;
+      uint32_t Offset;
+   };
+
+   struct LODDescriptor
+   {
+      uint32_t FirstIndex;
+      uint32_t IndexNum;
+      float Error;
+   };
+
+   static constexpr int MaxLODNum = 8;
+
+   // The file starts with this header, written in the byte order of the machine that built it.
+   struct Header
+   {
+      uint32_t Magic;
+      uint32_t Version;
+      uint64_t SourceHash;
+      uint32_t DrawMode;
+      uint32_t VertexStride;
+      uint32_t VertexNum;
+      uint32_t AttributeNum;
+      AttributeDescriptor Attributes[3];
+      uint32_t IndexType;
+      uint32_t IndexNum;
+      uint64_t VertexDataOffset;
+      uint64_t VertexDataSize;
+      uint64_t IndexDataOffset;
+      uint64_t IndexDataSize;
+      float BoundsMin[3];
+      float BoundsMax[3];
+      float SphereCenter[3];
+      float SphereRadius;
+      uint32_t LODNum;
+      uint32_t Reserved;
+      LODDescriptor LODs[MaxLODNum];
+   };
+   static_assert( sizeof( Header ) == 264, "The mesh cache header must not have padding." );
+
+   struct Mesh
+   {
+      Header Info;
+      std::vector<GLfloat> Vertices;
+      std::vector<uint8_t> Indices;
+   };
+
+   static constexpr uint32_t CacheMagic = 0x48534D45; // "EMSH"
+   static constexpr uint32_t CacheVersion = 3;
+   static constexpr uint64_t BlockAlignment = 4096;
+
+   [[nodiscard]] static uint64_t hashBytes(const uint8_t* data, size_t size, uint64_t hash = 0xCBF29CE484222325ull);
+   [[nodiscard]] static const Header* getValidHeader(const uint8_t* data, size_t size, uint64_t source_hash);
+   [[nodiscard]] static bool build(Mesh& mesh, const std::string& file_path, uint64_t source_hash);
+   static void weldVertices(
+      Mesh& mesh,
+      std::vector<GLuint>& indices,
+      const std::vector<GLfloat>& corners,
+      size_t corner_num,
+      size_t step
+   );
+   static void setLODs(Mesh& mesh, std::vector<GLuint>& indices, size_t step);
+   static void setBounds(Header& info, const std::vector<GLfloat>& vertices, size_t step);
+   [[nodiscard]] static bool write(const std::string& cache_path, const Mesh& mesh);
+   static void upload(ObjectGL& object, const Header& info, const GLfloat* vertices, const void* indices);
+};
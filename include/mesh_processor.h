@@ -0,0 +1,45 @@
+#pragma once
+
+#include "base.h"
+
+// Generates vertex normals and tangents for indexed triangle lists. Each corner's contribution is computed in
+// parallel per triangle and then gathered per vertex through a vertex-to-corner table sorted by counting, so the
+// sums need no atomics and add up in the same order on every run.
+class MeshProcessor final
+{
+public:
+   MeshProcessor() = delete;
+
+   // Smooth normals where every triangle adds its unit normal weighted by its angle at the vertex, which keeps
+   // the result independent of how the surface around the vertex is triangulated.
+   [[nodiscard]] static std::vector<glm::vec3> getNormals(
+      const glm::vec3* positions,
+      size_t vertex_num,
+      const GLuint* indices,
+      size_t index_num
+   );
+   // Tangents in the MikkTSpace convention: xyz is the unit tangent along +u, and w is the sign such that
+   // cross(normal, tangent.xyz) * w is the bitangent along +v. As in MikkTSpace, each corner projects the
+   // triangle's tangent and bitangent onto the plane of the vertex normal before they are weighted by angle, but
+   // a vertex whose corners disagree in handedness is not split, so mirrored seams should have separate vertices.
+   [[nodiscard]] static std::vector<glm::vec4> getTangents(
+      const glm::vec3* positions,
+      const glm::vec3* normals,
+      const glm::vec2* textures,
+      size_t vertex_num,
+      const GLuint* indices,
+      size_t index_num
+   );
+
+private:
+   // CornerRanges[v] to CornerRanges[v + 1] index the corners of the vertex v in Corners.
+   struct VertexCorners
+   {
+      std::vector<GLuint> CornerRanges;
+      std::vector<GLuint> Corners;
+   };
+
+   [[nodiscard]] static VertexCorners getVertexCorners(size_t vertex_num, const GLuint* indices, size_t index_num);
+   // The angles of a triangle at its three corners.
+   [[nodiscard]] static glm::vec3 getCornerAngles(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2);
+};
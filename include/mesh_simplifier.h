@@ -0,0 +1,72 @@
+#pragma once
+
+#include "object.h"
+
+// Simplifies indexed triangle meshes with quadric error metrics. Each collapse moves a vertex onto one of its
+// neighbors, so every level of detail indexes the same vertex buffer and only the index buffer grows.
+// Vertices on borders, on attribute seams and on non-manifold edges are never moved.
+class MeshSimplifier final
+{
+public:
+   MeshSimplifier() = delete;
+
+   // positions are read every stride floats. error is set to the largest RMS distance a collapsed surface moved,
+   // in the units of the positions. The result can have more than target_index_num indices when no more
+   // collapses are allowed.
+   [[nodiscard]] static std::vector<GLuint> simplify(
+      const GLfloat* positions,
+      size_t stride,
+      size_t vertex_num,
+      const std::vector<GLuint>& indices,
+      size_t target_index_num,
+      float& error
+   );
+   // Appends coarser versions of indices to them, each about reduction times the size of the previous one,
+   // and returns the ranges of every level from the original indices to the coarsest level.
+   [[nodiscard]] static std::vector<ObjectGL::LOD> buildLODChain(
+      const GLfloat* positions,
+      size_t stride,
+      size_t vertex_num,
+      std::vector<GLuint>& indices,
+      int max_lod_num = 5,
+      float reduction = 0.5f
+   );
+
+private:
+   struct Quadric
+   {
+      double A00, A01, A02, A03, A11, A12, A13, A22, A23, A33;
+      double Weight;
+
+      Quadric& operator+=(const Quadric& q);
+      [[nodiscard]] double evaluate(const glm::dvec3& p) const;
+   };
+
+   struct Collapse
+   {
+      GLuint From;
+      GLuint To;
+      double Cost;
+   };
+
+   [[nodiscard]] static glm::dvec3 getPosition(const GLfloat* positions, size_t stride, GLuint index)
+   {
+      const GLfloat* p = positions + stride * index;
+      return { p[0], p[1], p[2] };
+   }
+   [[nodiscard]] static Quadric getPlaneQuadric(const glm::dvec3& p0, const glm::dvec3& p1, const glm::dvec3& p2);
+   [[nodiscard]] static std::vector<GLuint> getPositionIDs(const GLfloat* positions, size_t stride, size_t vertex_num);
+   [[nodiscard]] static std::vector<uint64_t> getEdges(const std::vector<GLuint>& indices, const std::vector<GLuint>& ids);
+   [[nodiscard]] static std::vector<uint8_t> getLockedVertices(
+      const std::vector<GLuint>& position_ids,
+      const std::vector<GLuint>& indices
+   );
+   [[nodiscard]] static bool flipsTriangle(
+      const GLfloat* positions,
+      size_t stride,
+      const std::vector<GLuint>& indices,
+      const GLuint* triangles,
+      size_t triangle_num,
+      const Collapse& collapse
+   );
+};
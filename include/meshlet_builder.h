@@ -0,0 +1,40 @@
+#pragma once
+
+#include "object.h"
+
+// Splits an indexed triangle list into meshlets of at most MaxVertexNum vertices and MaxTriangleNum triangles.
+// The triangles are reordered in place so that every meshlet is a contiguous index range, which lets a compute
+// pass cull meshlets and draw the survivors with glMultiDrawElementsIndirectCount().
+class MeshletBuilder final
+{
+public:
+   static constexpr size_t MaxVertexNum = 64;
+   static constexpr size_t MaxTriangleNum = 124;
+
+   MeshletBuilder() = delete;
+
+   // indices[0, index_num) are reordered and have to be below vertex_num; first_index is where they start in the
+   // index buffer of the object.
+   [[nodiscard]] static std::vector<ObjectGL::Meshlet> build(
+      const GLfloat* positions,
+      size_t stride,
+      size_t vertex_num,
+      GLuint* indices,
+      size_t index_num,
+      GLuint first_index = 0
+   );
+
+private:
+   [[nodiscard]] static glm::vec3 getPosition(const GLfloat* positions, size_t stride, GLuint index)
+   {
+      const GLfloat* p = positions + stride * index;
+      return { p[0], p[1], p[2] };
+   }
+   static void setBounds(
+      ObjectGL::Meshlet& meshlet,
+      const GLfloat* positions,
+      size_t stride,
+      const GLuint* triangles,
+      const std::vector<GLuint>& vertices
+   );
+};
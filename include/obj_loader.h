@@ -0,0 +1,77 @@
+#pragma once
+
+#include "object.h"
+
+// Loads Wavefront OBJ geometry as a triangle list: one position/normal/texture entry per triangle corner.
+// The file is memory-mapped and split into line-aligned chunks that are parsed in parallel.
+class OBJLoader final
+{
+public:
+   OBJLoader() = delete;
+
+   // textures are left empty when some face corner does not reference them. Missing normals are generated as
+   // smooth angle-weighted normals of the positions.
+   [[nodiscard]] static bool load(
+      const std::string& file_path,
+      std::vector<glm::vec3>& vertices,
+      std::vector<glm::vec3>& normals,
+      std::vector<glm::vec2>& textures
+   );
+   [[nodiscard]] static bool load(ObjectGL& object, const std::string& file_path);
+
+private:
+   struct Corner
+   {
+      int Position;
+      int Texture;
+      int Normal;
+   };
+
+   struct Chunk
+   {
+      const char* Begin;
+      const char* End;
+      size_t PositionNum;
+      size_t TextureNum;
+      size_t NormalNum;
+      size_t TriangleNum;
+      size_t PositionOffset;
+      size_t TextureOffset;
+      size_t NormalOffset;
+      size_t TriangleOffset;
+      bool AllCornersHaveTexture;
+      bool AllCornersHaveNormal;
+      bool IsValid;
+
+      Chunk(const char* begin, const char* end) :
+         Begin( begin ), End( end ), PositionNum( 0 ), TextureNum( 0 ), NormalNum( 0 ), TriangleNum( 0 ),
+         PositionOffset( 0 ), TextureOffset( 0 ), NormalOffset( 0 ), TriangleOffset( 0 ),
+         AllCornersHaveTexture( true ), AllCornersHaveNormal( true ), IsValid( true ) {}
+   };
+
+   struct Attributes
+   {
+      std::vector<glm::vec3> Positions;
+      std::vector<glm::vec2> Textures;
+      std::vector<glm::vec3> Normals;
+      std::vector<Corner> Corners;
+   };
+
+   [[nodiscard]] static bool isBlank(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+   [[nodiscard]] static bool isDigit(char c) { return c >= '0' && c <= '9'; }
+   static void skipBlanks(const char*& ptr, const char* end);
+   [[nodiscard]] static const char* findLineEnd(const char* ptr, const char* end);
+   [[nodiscard]] static float parseFloat(const char*& ptr, const char* end);
+   [[nodiscard]] static bool parseIndex(const char*& ptr, const char* end, size_t defined_num, int& index);
+   // defined_num holds how many positions, textures and normals precede this line in the whole file.
+   [[nodiscard]] static bool parseCorner(
+      const char*& ptr,
+      const char* end,
+      const size_t (&defined_num)[3],
+      Corner& corner
+   );
+   [[nodiscard]] static std::vector<Chunk> splitIntoChunks(const char* begin, const char* end);
+   static void countChunk(Chunk& chunk);
+   static void parseChunk(Chunk& chunk, Attributes& attributes);
+   static void generateNormals(const Attributes& attributes, std::vector<glm::vec3>& normals);
+};
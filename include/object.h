@@ -1,11 +1,133 @@
 #pragma once
 
 #include "base.h"
+#include "geometry_arena.h"
+#include "bounding_volume.h"
+#include <cstddef>
 
 class ObjectGL
 {
 public:
-   enum LayoutLocation { VertexLocation = 0, NormalLocation, TextureLocation };
+   enum LayoutLocation { VertexLocation = 0, NormalLocation, TextureLocation, TangentLocation };
+
+   // DropCPUCopy keeps the vertices only in the GL buffer; KeepCPUCopy also retains them in DataBuffer,
+   // which makes frequent replaceVertices() calls cheaper at the cost of doubling the memory.
+   enum CPUCopyPolicy { DropCPUCopy = 0, KeepCPUCopy };
+
+   // Interleaved packs position/normal/texture per vertex in one binding. Separated stores each attribute in its
+   // own block and binding, so position-only updates and depth-only passes never touch the other attributes.
+   enum VertexLayout { Interleaved = 0, Separated };
+
+   // A vertex attribute kept in its source format, such as a glTF accessor. A zero stride means tightly packed.
+   struct VertexStream
+   {
+      LayoutLocation Location;
+      GLint ComponentNum;
+      GLenum ComponentType;
+      GLboolean IsNormalized;
+      GLsizei Stride;
+      const uint8_t* Data;
+      GLsizeiptr Size;
+   };
+
+   // A level of detail is a range of the index buffer. Error is the largest distance its surface moved from the
+   // full mesh, in object space.
+   struct LOD
+   {
+      GLsizei FirstIndex;
+      GLsizei IndexNum;
+      float Error;
+   };
+
+   // A cluster of triangles that is a contiguous index range, laid out for std430 storage buffers.
+   // NormalCone holds the average normal and the sine of the widest angle to it; 1 never culls.
+   struct Meshlet
+   {
+      glm::vec4 BoundingSphere;
+      glm::vec4 NormalCone;
+      GLuint FirstIndex;
+      GLuint IndexNum;
+      GLuint Padding[2];
+   };
+   static_assert( sizeof( Meshlet ) == 48, "Meshlet has to match its std430 layout." );
+
+   // The bones that move a vertex and how much each of them weighs, laid out for std430 storage buffers.
+   struct SkinWeight
+   {
+      glm::uvec4 BoneIndices;
+      glm::vec4 BoneWeights;
+   };
+   static_assert( sizeof( SkinWeight ) == 32, "SkinWeight has to match its std430 layout." );
+
+   // A sparse blend shape: at full weight, the vertex Indices[i] moves by PositionDeltas[i] and its normal bends by
+   // NormalDeltas[i], which may be empty when the normals do not change.
+   struct MorphTarget
+   {
+      std::vector<GLuint> Indices;
+      std::vector<glm::vec3> PositionDeltas;
+      std::vector<glm::vec3> NormalDeltas;
+   };
+
+   // One delta of the vertex it is listed under, laid out for std430 storage buffers.
+   struct MorphDelta
+   {
+      glm::vec3 PositionDelta;
+      GLuint Target;
+      glm::vec3 NormalDelta;
+      float Padding;
+   };
+   static_assert( sizeof( MorphDelta ) == 32, "MorphDelta has to match its std430 layout." );
+
+   // The weights reach the morphing pass as a uniform array of this size.
+   static constexpr int MaxMorphTargetNum = 64;
+
+   // Where the position and normal of the i-th vertex are in the vertex buffer, counted in floats: the position
+   // starts at FirstFloat + PositionStride * i, and the normal at FirstFloat + NormalOffset + NormalStride * i.
+   // NormalStride is 0 when the object has no normals.
+   struct SkinLayout
+   {
+      GLuint FirstFloat;
+      GLuint PositionStride;
+      GLuint NormalOffset;
+      GLuint NormalStride;
+   };
+
+   // What an instanced draw reads for each of its instances, laid out for std430 storage buffers.
+   // MaterialIndex selects one of the instance materials.
+   struct Instance
+   {
+      glm::mat4 WorldMatrix;
+      GLuint MaterialIndex;
+      GLuint Padding[3];
+   };
+   static_assert( sizeof( Instance ) == 80, "Instance has to match its std430 layout." );
+
+   struct InstanceMaterial
+   {
+      glm::vec4 EmissionColor;
+      glm::vec4 AmbientColor;
+      glm::vec4 DiffuseColor;
+      glm::vec4 SpecularColor;
+      float SpecularExponent;
+      // The layer in a TextureSetGL array, or -1 for no texture.
+      GLint TextureIndex;
+      // The bindless handle of the texture, or 0 for none.
+      GLuint64 TextureHandle;
+   };
+   static_assert(
+      sizeof( InstanceMaterial ) == 80 && offsetof( InstanceMaterial, TextureHandle ) == 72,
+      "InstanceMaterial has to match its std430 layout."
+   );
+
+   // The command layout of glDrawElementsIndirect() and glMultiDrawElementsIndirect().
+   struct DrawElementsIndirectCommand
+   {
+      GLuint Count;
+      GLuint InstanceCount;
+      GLuint FirstIndex;
+      GLint BaseVertex;
+      GLuint BaseInstance;
+   };
 
    ObjectGL();
    ~ObjectGL();
@@ -15,6 +137,30 @@ public:
    void setDiffuseReflectionColor(const glm::vec4& diffuse_reflection_color);
    void setSpecularReflectionColor(const glm::vec4& specular_reflection_color);
    void setSpecularReflectionExponent(const float& specular_reflection_exponent);
+   void setCPUCopyPolicy(CPUCopyPolicy policy);
+   void setVertexLayout(VertexLayout layout);
+   // Places the vertices and indices in ranges of the shared arena instead of buffers of this object, which must be
+   // set before the object is. Only the interleaved layout is supported, and the object cannot be made dynamic.
+   void setGeometryArena(GeometryArenaGL* arena);
+   void setObject(
+      GLenum draw_mode,
+      GLsizei vertex_num,
+      const glm::vec3* vertices,
+      const glm::vec3* normals = nullptr,
+      const glm::vec2* textures = nullptr
+   );
+   // packed_vertices already follow the interleaved layout, as packVertices() writes them, so they are handed to the
+   // buffer storage without any copy or conversion. The object must use the interleaved layout.
+   void setPackedObject(
+      GLenum draw_mode,
+      GLsizei vertex_num,
+      const GLfloat* packed_vertices,
+      bool normals_exist,
+      bool textures_exist
+   );
+   // The stream bytes are copied as they are into one block and binding per stream, without reinterleaving.
+   // Objects made this way cannot be edited with updateDataBuffer() or replaceVertices().
+   void setObject(GLenum draw_mode, GLsizei vertex_num, const std::vector<VertexStream>& streams);
    void setObject(GLenum draw_mode, const std::vector<glm::vec3>& vertices);
    void setObject(
       GLenum draw_mode,
@@ -48,6 +194,38 @@ public:
       const std::string& texture_file_path,
       bool is_grayscale = false
    );
+   void setIndexBuffer(GLenum index_type, GLsizei index_num, const void* indices);
+   void setIndexBuffer(const std::vector<GLuint>& indices);
+   // lods go from the full mesh to the coarsest level. Setting the index buffer again clears them.
+   void setLODs(const std::vector<LOD>& lods);
+   // Picks the coarsest level whose error covers at most pixel_error pixels when the bounding sphere covers
+   // projected_radius pixels. A coarser level is only taken within (1 - hysteresis) of pixel_error, so the choice
+   // does not flicker around the threshold.
+   int selectLOD(float projected_radius, float pixel_error = 1.0f, float hysteresis = 0.25f);
+   // Overrides the sphere that is otherwise computed whenever the vertices change, e.g. with a cooked one.
+   void setBoundingSphere(const glm::vec3& center, float radius);
+   // Uploads the meshlets of the index buffer along with a command buffer that a culling pass fills with one
+   // DrawElementsIndirectCommand per visible meshlet, and the buffer holding how many it wrote.
+   void setMeshlets(const std::vector<Meshlet>& meshlets);
+   // Partitions indices, a triangle list of this object, into meshlets with MeshletBuilder, and sets the reordered
+   // indices as the index buffer along with the meshlets. The positions come from the CPU copy, or are read back once
+   // from the vertex buffer without one, so objects made from vertex streams are not supported.
+   void setIndexBufferWithMeshlets(std::vector<GLuint> indices);
+   // Skinning blends up to four bones per vertex in a compute pass that rewrites the positions and normals in the
+   // vertex buffer from a GPU copy of the current ones, the bind pose, so only the bone palette crosses the bus
+   // afterwards. The skinned vertices never reach the CPU copy, and the bounds stay those of the bind pose.
+   void setSkin(const std::vector<SkinWeight>& weights, int bone_num);
+   void setBoneMatrices(const std::vector<glm::mat4>& bone_matrices);
+   // Morphing runs in a compute pass before skinning and blends the deltas of every target by its weight into the
+   // bind pose, so a frame only sends the weights. The deltas are grouped by vertex, so that each vertex only reads
+   // its own, and the same caveats as for skinning apply to the CPU copy and the bounds.
+   void setMorphTargets(const std::vector<MorphTarget>& targets);
+   void setMorphWeights(const std::vector<float>& weights);
+   // Instanced draws read the instance gl_BaseInstance + gl_InstanceID from the instance buffer, so any range of
+   // the instances can be drawn with one call. The buffer is only reallocated when the instance count changes.
+   void setInstances(const std::vector<Instance>& instances);
+   void updateInstances(GLsizei first_instance, const Instance* instances, GLsizei instance_num);
+   void setInstanceMaterials(const std::vector<InstanceMaterial>& materials);
    int addTexture(const std::string& texture_file_path, bool is_grayscale = false);
    void addTexture(int width, int height, bool is_grayscale = false);
    int addTexture(const uint8_t* image_buffer, int width, int height, bool is_grayscale = false);
@@ -59,9 +237,78 @@ public:
    );
    void replaceVertices(const std::vector<glm::vec3>& vertices, bool normals_exist, bool textures_exist);
    void replaceVertices(const std::vector<float>& vertices, bool normals_exist, bool textures_exist);
+   // Moves only the listed vertices: vertices[i] becomes the position of the vertex indices[i].
+   void replaceVertices(
+      const std::vector<glm::vec3>& vertices,
+      const std::vector<GLuint>& indices,
+      bool normals_exist,
+      bool textures_exist
+   );
+   // When more than this fraction of the vertices is dirty, replaceVertices() uploads the whole buffer at once.
+   void setFullUploadThreshold(float threshold) { FullUploadThreshold = threshold; }
+   // Turns the vertex buffer into region_num persistently mapped copies for meshes that change every frame.
+   // Each update goes to a copy the GPU is done with, and the VAO is rebound to it.
+   void setDynamicMode(int region_num = 3);
+   [[nodiscard]] bool isDynamic() const { return DynamicRegionNum > 0; }
    [[nodiscard]] GLuint getVAO() const { return VAO; }
+   // In an arena, the buffer name changes whenever the arena grows, so it is never kept in VBO.
+   [[nodiscard]] GLuint getVertexBuffer() const
+   {
+      return Arena != nullptr ? Arena->getVertexBuffer( NormalsExist, TexturesExist ) : VBO;
+   }
+   // This VAO enables the position attribute only, for depth-only passes.
+   [[nodiscard]] GLuint getPositionVAO() const { return PositionVAO; }
+   [[nodiscard]] bool usesGeometryArena() const { return Arena != nullptr; }
+   // Where the object starts in its vertex and index buffers; both are 0 outside an arena.
+   [[nodiscard]] GLint getBaseVertex() const { return BaseVertex; }
+   [[nodiscard]] GLuint getFirstIndex() const { return FirstIndex; }
+   [[nodiscard]] VertexLayout getVertexLayout() const { return Layout; }
    [[nodiscard]] GLenum getDrawMode() const { return DrawMode; }
+   [[nodiscard]] CPUCopyPolicy getCPUCopyPolicy() const { return CopyPolicy; }
    [[nodiscard]] GLsizei getVertexNum() const { return VerticesCount; }
+   [[nodiscard]] static GLsizei getComponentSize(GLenum component_type);
+   // Writes vertices [begin, end) into destination as interleaved position/normal/texture floats.
+   // normals and textures can be null when the object does not have them.
+   static void packVertices(
+      GLfloat* destination,
+      const glm::vec3* vertices,
+      const glm::vec3* normals,
+      const glm::vec2* textures,
+      size_t vertex_num,
+      size_t begin,
+      size_t end
+   );
+   [[nodiscard]] bool isIndexed() const { return IndicesCount > 0; }
+   [[nodiscard]] GLenum getIndexType() const { return IndexType; }
+   [[nodiscard]] GLsizei getIndexNum() const { return IndicesCount; }
+   [[nodiscard]] int getLODNum() const { return static_cast<int>(LODs.size()); }
+   [[nodiscard]] const LOD& getLOD(int index) const { return LODs[index]; }
+   // The bounds follow every change of the positions in object space. A partial replaceVertices() only grows them,
+   // unless a CPU copy tells that a vertex on the boundary moved inward, in which case they are fitted again.
+   [[nodiscard]] const BoundingVolume& getBounds() const { return Bounds; }
+   [[nodiscard]] const glm::vec3& getBoundingBoxMin() const { return Bounds.BoxMin; }
+   [[nodiscard]] const glm::vec3& getBoundingBoxMax() const { return Bounds.BoxMax; }
+   [[nodiscard]] const glm::vec3& getBoundingSphereCenter() const { return Bounds.SphereCenter; }
+   [[nodiscard]] float getBoundingSphereRadius() const { return Bounds.SphereRadius; }
+   [[nodiscard]] GLsizei getMeshletNum() const { return MeshletNum; }
+   [[nodiscard]] GLuint getMeshletBuffer() const { return MeshletBuffer; }
+   [[nodiscard]] GLuint getMeshletCommandBuffer() const { return MeshletCommandBuffer; }
+   [[nodiscard]] GLuint getMeshletDrawCountBuffer() const { return MeshletDrawCountBuffer; }
+   [[nodiscard]] bool isSkinned() const { return BoneNum > 0; }
+   [[nodiscard]] int getBoneNum() const { return BoneNum; }
+   [[nodiscard]] GLuint getBindPoseBuffer() const { return BindPoseBuffer; }
+   [[nodiscard]] GLuint getSkinWeightBuffer() const { return SkinWeightBuffer; }
+   [[nodiscard]] GLuint getBoneBuffer() const { return BoneBuffer; }
+   [[nodiscard]] bool isMorphed() const { return !MorphWeights.empty(); }
+   [[nodiscard]] const std::vector<float>& getMorphWeights() const { return MorphWeights; }
+   [[nodiscard]] GLuint getMorphDeltaBuffer() const { return MorphDeltaBuffer; }
+   // MorphDeltaBuffer[ranges[i], ranges[i + 1]) are the deltas of the i-th vertex.
+   [[nodiscard]] GLuint getMorphRangeBuffer() const { return MorphRangeBuffer; }
+   [[nodiscard]] SkinLayout getSkinLayout() const;
+   [[nodiscard]] bool isInstanced() const { return InstanceNum > 0; }
+   [[nodiscard]] GLsizei getInstanceNum() const { return InstanceNum; }
+   [[nodiscard]] GLuint getInstanceBuffer() const { return InstanceBuffer; }
+   [[nodiscard]] GLuint getInstanceMaterialBuffer() const { return InstanceMaterialBuffer; }
    [[nodiscard]] GLuint getTextureID(int index) const { return TextureID[index]; }
    [[nodiscard]] int getTextureNum() const { return static_cast<int>(TextureID.size()); }
    [[nodiscard]] glm::vec4 getEmissionColor() const { return EmissionColor; }
@@ -105,14 +352,55 @@ public:
    }
 
 private:
-   uint8_t* ImageBuffer;
+   using VertexRange = std::pair<size_t, size_t>;
+
+   CPUCopyPolicy CopyPolicy;
+   VertexLayout Layout;
+   bool NormalsExist;
+   bool TexturesExist;
    std::vector<GLfloat> DataBuffer;
    GLuint VAO;
+   GLuint PositionVAO;
    GLuint VBO;
+   GLuint IBO;
+   GeometryArenaGL* Arena;
+   GeometryArenaGL::VertexAllocation ArenaVertices;
+   TLSFAllocator::Allocation ArenaIndices;
+   GLintptr VertexBufferOffset;
+   GLint BaseVertex;
+   GLuint FirstIndex;
+   GLenum IndexType;
+   GLsizei IndicesCount;
+   std::vector<LOD> LODs;
+   int CurrentLOD;
+   BoundingVolume Bounds;
+   GLsizei MeshletNum;
+   GLuint MeshletBuffer;
+   GLuint MeshletCommandBuffer;
+   GLuint MeshletDrawCountBuffer;
+   int BoneNum;
+   GLuint BindPoseBuffer;
+   GLuint SkinWeightBuffer;
+   GLuint BoneBuffer;
+   std::vector<float> MorphWeights;
+   GLuint MorphDeltaBuffer;
+   GLuint MorphRangeBuffer;
+   GLsizei InstanceNum;
+   GLuint InstanceBuffer;
+   GLsizei InstanceMaterialNum;
+   GLuint InstanceMaterialBuffer;
    GLenum DrawMode;
+   GLsizei VertexStride;
+   size_t AllocatedVertexNum;
+   int DynamicRegionNum;
+   int DynamicRegionIndex;
+   GLsizeiptr DynamicRegionSize;
+   uint8_t* DynamicBuffer;
+   std::vector<GLsync> DynamicFences;
    std::vector<GLuint> TextureID;
    std::map<std::string, GLuint> CustomBuffers;
    GLsizei VerticesCount;
+   float FullUploadThreshold;
    glm::vec4 EmissionColor;
    glm::vec4 AmbientReflectionColor; // It is usually set to the same color with DiffuseReflectionColor.
                                      // Otherwise, it should be in balance with DiffuseReflectionColor.
@@ -122,8 +410,24 @@ private:
 
    [[nodiscard]] bool prepareTexture2DUsingFreeImage(const std::string& file_path, bool is_grayscale) const;
    void prepareTexture(bool normals_exist) const;
-   void prepareVertexBuffer(int n_bytes_per_vertex);
+   void bindVertexBuffer(GLintptr base_offset) const;
+   void prepareVertexBuffer(int n_bytes_per_vertex, const void* data = nullptr);
+   void releaseVertexBuffer();
+   void releaseMeshletBuffers();
+   void createBindPoseBuffer();
+   void releaseBindPoseBuffer();
+   void releaseSkinBuffers();
+   void releaseMorphBuffers();
+   void releaseInstanceBuffers();
+   void writeDynamicRegion();
    void prepareNormal() const;
+   void uploadVertices(const glm::vec3* vertices, const glm::vec3* normals, const glm::vec2* textures);
+   [[nodiscard]] int getPositionStep(bool normals_exist, bool textures_exist) const;
+   static void mergeVertexRanges(std::vector<VertexRange>& ranges);
+   [[nodiscard]] bool needsFullUpload(const std::vector<VertexRange>& ranges) const;
+   void uploadDirtyRanges(std::vector<VertexRange>& ranges, int step);
+   void writePositions(const GLfloat* vertices, size_t vertex_num, int step);
+   void writePositions(const GLfloat* vertices, const std::vector<GLuint>& indices, int step);
    static void getSquareObject(
       std::vector<glm::vec3>& vertices,
       std::vector<glm::vec3>& normals,
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "base.h"
+#include <array>
+
+// Orders draws by a packed 64-bit key so that draws with the same state end up next to each other. From the most
+// significant bits down, the key holds the pass, program, material, texture, mesh and view depth, so opaque draws
+// are grouped by state and go front to back within a group, which helps early depth rejection. The keys are
+// sorted by a parallel LSD radix sort that skips the digits on which all keys agree.
+class RenderQueue final
+{
+public:
+   enum Pass { Opaque = 0, Transparent };
+
+   struct Item
+   {
+      uint64_t Key;
+      // Whatever the caller needs to find the draw again, such as an index into its own list.
+      uint32_t Payload;
+   };
+
+   struct StateChanges
+   {
+      size_t ProgramChanges = 0;
+      size_t MaterialChanges = 0;
+      size_t TextureChanges = 0;
+      size_t MeshChanges = 0;
+   };
+
+   // The state changes that drawing the items in the submitted order and in the sorted order would take.
+   struct Statistics
+   {
+      size_t DrawNum = 0;
+      StateChanges Submitted;
+      StateChanges Sorted;
+   };
+
+   RenderQueue() = default;
+   ~RenderQueue() = default;
+
+   // IDs wider than their field are wrapped, which only costs sorting quality. Depth is the distance along the
+   // view direction; transparent draws go back to front instead.
+   [[nodiscard]] static uint64_t getKey(
+      Pass pass,
+      uint32_t program,
+      uint32_t material,
+      uint32_t texture,
+      uint32_t mesh,
+      float depth
+   );
+
+   void clear() { Items.clear(); }
+   void submit(uint64_t key, uint32_t payload) { Items.push_back( { key, payload } ); }
+   // Makes room for draw_num items that can then be set from several threads.
+   void resize(size_t draw_num) { Items.resize( draw_num ); }
+   void setItem(size_t index, uint64_t key, uint32_t payload) { Items[index] = { key, payload }; }
+   // Sorts the items by key, keeping the submitted order of equal keys, and updates the statistics.
+   void sort();
+   [[nodiscard]] const std::vector<Item>& getItems() const { return Items; }
+   [[nodiscard]] const Statistics& getStatistics() const { return Stats; }
+
+private:
+   static constexpr int DepthBits = 20;
+   static constexpr int MeshBits = 10;
+   static constexpr int TextureBits = 12;
+   static constexpr int MaterialBits = 12;
+   static constexpr int ProgramBits = 8;
+   static constexpr int MeshShift = DepthBits;
+   static constexpr int TextureShift = MeshShift + MeshBits;
+   static constexpr int MaterialShift = TextureShift + TextureBits;
+   static constexpr int ProgramShift = MaterialShift + MaterialBits;
+   static constexpr int PassShift = ProgramShift + ProgramBits;
+   static_assert( PassShift + 2 == 64, "The key fields have to fill 64 bits." );
+
+   std::vector<Item> Items;
+   std::vector<Item> SortBuffer;
+   Statistics Stats;
+
+   [[nodiscard]] static uint32_t getField(uint64_t key, int shift, int bits)
+   {
+      return static_cast<uint32_t>(key >> shift) & ((1u << bits) - 1);
+   }
+   [[nodiscard]] static StateChanges countStateChanges(const std::vector<Item>& items);
+   void radixSort();
+};
@@ -12,7 +12,13 @@
 #include "light.h"
 #include "camera.h"
 #include "object.h"
+#include "indirect_batcher.h"
+#include "render_queue.h"
+#include "command_list.h"
+#include "hi_z_buffer.h"
 #include "shader.h"
+#include "scene_graph.h"
+#include "stress_scene.h"
 
 class RendererGL
 {
@@ -29,6 +35,8 @@ public:
    void play();
 
 private:
+   enum StressDrawPath { MultiDrawPath = 0, InstancingPath, CommandListPath, GPUCullingPath, StressDrawPathNum };
+
    inline static RendererGL* Renderer = nullptr;
    GLFWwindow* Window;
    int FrameWidth;
@@ -36,11 +44,40 @@ private:
    glm::ivec2 ClickedPoint;
    std::unique_ptr<CameraGL> MainCamera;
    std::unique_ptr<ShaderGL> ObjectShader;
+   std::unique_ptr<ClusterCullShaderGL> ClusterCullShader;
+   std::unique_ptr<InstanceCullShaderGL> InstanceCullShader;
+   std::unique_ptr<HiZShaderGL> HiZShader;
+   std::unique_ptr<SkinningShaderGL> SkinningShader;
+   std::unique_ptr<MorphShaderGL> MorphShader;
+   std::unique_ptr<GeometryArenaGL> Arena;
    std::unique_ptr<ObjectGL> Object;
    std::unique_ptr<LightGL> Lights;
+   std::unique_ptr<StressSceneGL> StressScene;
+   std::unique_ptr<SceneGraph> Scene;
+   std::unique_ptr<IndirectBatcherGL> Batcher;
+   std::unique_ptr<RenderQueue> Queue;
+   std::unique_ptr<CommandListSetGL> CommandLists;
+   std::unique_ptr<HiZBufferGL> HiZ;
+   // The demo object hangs from a pivot that spins it around the z-axis.
+   SceneGraph::Node ObjectPivot;
+   SceneGraph::Node ObjectNode;
 
    bool DrawMovingObject;
    int ObjectRotationAngle;
+   // The number of objects of the stress scene, which replaces the demo object while it is not zero.
+   size_t StressObjectNum;
+   // The stress scene goes through the indirect batcher, one instanced call per batch, one draw per object
+   // recorded into command lists in parallel, or commands that a compute pass writes for the visible objects.
+   StressDrawPath DrawPath;
+   // Whether the multi-draw and command list paths sort the draws by state and depth first.
+   bool UseRenderQueue;
+   // Whether the stress scene only draws the objects whose bounding spheres touch the view frustum.
+   bool UseFrustumCulling;
+   // Whether the GPU culling path also culls what the Hi-Z pyramid hides, in two phases.
+   bool UseOcclusionCulling;
+   // Whether the instanced draws of the stress scene take their textures from their materials, so that the
+   // multi-draw path and the render queue no longer split the draws by texture.
+   bool UseTextureSet;
  
    void registerCallbacks() const;
    void initialize();
@@ -72,8 +109,47 @@ private:
    static void reshapeWrapper(GLFWwindow* window, int width, int height) { Renderer->reshape( window, width, height ); }
 
    void setLights() const;
-   void setObject() const;
-   void drawObject(const float& scale_factor = 1.0f) const;
+   void setObject();
+   // Cycles the stress scene through 10^3 to 10^6 objects and then back to the demo object.
+   void toggleStressScene();
+   void printRenderQueueStatistics() const;
+   void setLightUniforms(LightGL& lights) const;
+   // The radius in pixels of the object's bounding sphere, or the largest float when the camera is inside it.
+   [[nodiscard]] float getProjectedRadius(const ObjectGL& object, const glm::mat4& to_world) const;
+   // Writes the positions and normals posed by the bone palette into the vertex buffer of the object.
+   // A morphed object is skinned from the pose its morphing wrote.
+   void skinObject(const ObjectGL& object) const;
+   // Writes the bind pose with the weighted morph target deltas into the vertex buffer of the object.
+   void morphObject(const ObjectGL& object) const;
+   // Culls the meshlets against the frustum and by their normal cones, and draws the rest with one call.
+   void drawMeshlets(const ObjectGL& object, const glm::mat4& to_world) const;
+   // Draws instance_num instances of the object from first_instance on with one instanced call. An object without
+   // instance materials uses the material buffer that is already bound.
+   void drawInstances(const ObjectGL& object, GLsizei first_instance, GLsizei instance_num) const;
+   // The command list path draws without instancing, so it always binds the textures.
+   [[nodiscard]] bool usesTextureSet() const
+   {
+      return UseTextureSet && DrawPath != CommandListPath && !StressScene->getTextureSet().isEmpty();
+   }
+   // The texture a stress-scene draw has to bind, which is none when the materials pick it.
+   [[nodiscard]] GLuint getStressBoundTexture(int texture) const;
+   // Submits every visible instance of the stress scene to the render queue and sorts it.
+   void sortStressScene() const;
+   // Adds every visible instance of the stress scene to the batcher, in the order of the sorted render queue when it
+   // is used.
+   void batchStressScene() const;
+   // Records the uniforms, bindings and draw call of every visible instance into the command lists on the thread pool.
+   void recordStressScene() const;
+   // Submits every bucket of the batcher with one multi-draw call.
+   void drawBatches() const;
+   // Culls the instances of the stress scene in a compute pass that writes a draw command per visible instance.
+   void cullStressSceneOnGPU(InstanceCullShaderGL::PHASE phase) const;
+   // Draws each batch with the commands and the count that the culling pass wrote, never reading them back.
+   void drawCulledStressScene() const;
+   // Reduces the depth of the Hi-Z framebuffer into the pyramid level by level.
+   void buildHiZPyramid() const;
+   void drawObject() const;
+   void drawStressScene() const;
    void render() const;
    void update();
 };
\ No newline at end of file
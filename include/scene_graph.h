@@ -0,0 +1,73 @@
+#pragma once
+
+#include "base.h"
+#include <limits>
+
+// A hierarchy of transforms kept as structure-of-arrays. Nodes are stored level by level, so every parent comes
+// before its children and each depth is a contiguous range of slots; a node keeps its handle while slots move.
+// update() walks the levels in order and, within a level, splits the slots across threads, recomputing the world
+// matrix only of the nodes that changed or whose ancestor changed.
+class SceneGraph final
+{
+public:
+   using Node = uint32_t;
+   static constexpr Node NoNode = std::numeric_limits<Node>::max();
+
+   SceneGraph() = default;
+   ~SceneGraph() = default;
+
+   void clear();
+   void reserve(size_t node_num);
+   // A node without a parent is a root. The new node starts with the identity transform.
+   Node addNode(Node parent = NoNode);
+   // Adds node_num siblings with consecutive handles and returns the first of them.
+   Node addNodes(Node parent, size_t node_num);
+
+   // The setters only touch the given node, so different nodes can be set from different threads.
+   void setTranslation(Node node, const glm::vec3& translation);
+   void setRotation(Node node, const glm::quat& rotation);
+   void setScale(Node node, const glm::vec3& scale);
+   // Decomposes an affine matrix without shear into the local translation, rotation and scale.
+   void setLocalMatrix(Node node, const glm::mat4& matrix);
+   [[nodiscard]] const glm::vec3& getTranslation(Node node) const { return Translations[Slots[node]]; }
+   [[nodiscard]] const glm::quat& getRotation(Node node) const { return Rotations[Slots[node]]; }
+   [[nodiscard]] const glm::vec3& getScale(Node node) const { return Scales[Slots[node]]; }
+   [[nodiscard]] Node getParent(Node node) const
+   {
+      const uint32_t parent = Parents[Slots[node]];
+      return parent == NoNode ? NoNode : Nodes[parent];
+   }
+   // Valid after update() for every node added or changed before it.
+   [[nodiscard]] const glm::mat4& getWorldMatrix(Node node) const { return WorldMatrices[Slots[node]]; }
+   [[nodiscard]] size_t getNodeNum() const { return Nodes.size(); }
+
+   void update();
+
+private:
+   // Indexed by slot.
+   std::vector<glm::vec3> Translations;
+   std::vector<glm::quat> Rotations;
+   std::vector<glm::vec3> Scales;
+   std::vector<glm::mat4> WorldMatrices;
+   std::vector<uint32_t> Parents;
+   std::vector<uint32_t> Depths;
+   std::vector<uint8_t> Dirty;
+   std::vector<Node> Nodes;
+   // Indexed by node.
+   std::vector<uint32_t> Slots;
+   // LevelRanges[d] to LevelRanges[d + 1] are the slots at the depth d, once the slots are sorted by depth.
+   std::vector<uint32_t> LevelRanges;
+   bool NeedsSorting = false;
+   bool NeedsLevels = false;
+
+   // Restores the level order by a stable counting sort of the slots on their depths.
+   void sortByDepth();
+   void setLevelRanges();
+   template<typename T>
+   static void permute(std::vector<T>& values, const std::vector<uint32_t>& new_slots)
+   {
+      std::vector<T> permuted(values.size());
+      for (size_t i = 0; i < values.size(); ++i) permuted[new_slots[i]] = std::move( values[i] );
+      values.swap( permuted );
+   }
+};
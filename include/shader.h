@@ -14,9 +14,19 @@ public:
       UseTexture = 296,
       UseLight,
       LightNum,
-      GlobalAmbient
+      GlobalAmbient,
+      UseInstancing,
+      ProjectionMatrix,
+      TextureMode
    };
 
+   enum BINDING { InstanceBuffer = 0, InstanceMaterialBuffer };
+
+   enum TEXTURE_UNIT { BaseTextureUnit = 0, TextureArrayUnit };
+
+   // Where an instanced draw finds its texture: the base texture under UseTexture, or what its material holds.
+   enum TEXTURE_MODE { BoundTexture = 0, ArrayTexture, BindlessTexture };
+
    enum LIGHT_UNIFORM {
       LightSwitch = 0,
       LightPosition,
@@ -130,4 +140,117 @@ protected:
    [[nodiscard]] static std::string getShaderTypeString(GLenum shader_type);
    [[nodiscard]] static bool checkCompileError(GLenum shader_type, const GLuint& shader);
    [[nodiscard]] static GLuint getCompiledShader(GLenum shader_type, const char* shader_path);
+};
+
+class ClusterCullShaderGL final : public ShaderGL
+{
+public:
+   enum UNIFORM {
+      FrustumPlanes = 0,
+      CameraPosition = 6,
+      MeshletNum,
+      BaseVertex,
+      FirstIndex
+   };
+
+   enum BINDING {
+      MeshletBuffer = 0,
+      CommandBuffer,
+      DrawCountBuffer
+   };
+
+   ClusterCullShaderGL() = default;
+   ~ClusterCullShaderGL() override = default;
+};
+
+class InstanceCullShaderGL final : public ShaderGL
+{
+public:
+   enum UNIFORM {
+      FrustumPlanes = 0,
+      BoundingSphere = 6,
+      FirstInstance,
+      InstanceNum,
+      FirstCommand,
+      DrawCountIndex,
+      IndexNum,
+      FirstIndex,
+      BaseVertex,
+      ViewProjectionMatrix,
+      BoundingBoxMin,
+      BoundingBoxMax,
+      Phase
+   };
+
+   enum BINDING {
+      InstanceBuffer = 0,
+      CommandBuffer,
+      DrawCountBuffer,
+      VisibilityBuffer
+   };
+
+   // The occlusion phases go in this order, with the Hi-Z pyramid built between them from what the first one drew.
+   enum PHASE {
+      FrustumPhase = 0,
+      LastVisiblePhase,
+      OcclusionPhase
+   };
+
+   InstanceCullShaderGL() = default;
+   ~InstanceCullShaderGL() override = default;
+};
+
+class HiZShaderGL final : public ShaderGL
+{
+public:
+   enum UNIFORM { SourceLevel = 0 };
+
+   HiZShaderGL() = default;
+   ~HiZShaderGL() override = default;
+};
+
+class SkinningShaderGL final : public ShaderGL
+{
+public:
+   enum UNIFORM {
+      VertexNum = 0,
+      FirstFloat,
+      PositionStride,
+      NormalOffset,
+      NormalStride,
+      SourceFirstFloat
+   };
+
+   enum BINDING {
+      BindPoseBuffer = 0,
+      SkinWeightBuffer,
+      BoneBuffer,
+      VertexBuffer
+   };
+
+   SkinningShaderGL() = default;
+   ~SkinningShaderGL() override = default;
+};
+
+class MorphShaderGL final : public ShaderGL
+{
+public:
+   enum UNIFORM {
+      VertexNum = 0,
+      FirstFloat,
+      PositionStride,
+      NormalOffset,
+      NormalStride,
+      Weights
+   };
+
+   enum BINDING {
+      BindPoseBuffer = 0,
+      DeltaBuffer,
+      RangeBuffer,
+      VertexBuffer
+   };
+
+   MorphShaderGL() = default;
+   ~MorphShaderGL() override = default;
 };
\ No newline at end of file
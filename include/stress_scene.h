@@ -0,0 +1,167 @@
+#pragma once
+
+#include "frustum_culler.h"
+#include "light.h"
+#include "object.h"
+#include "scene_graph.h"
+#include "texture_set.h"
+#include <array>
+#include <functional>
+
+// A procedural scene for scaling benchmarks: a cubic grid of spheres, cubes and tori with random transforms,
+// materials, textures and lights. Everything random is derived from the seed and the index of the element alone,
+// so the scene is the same on every run however the parallel work is split among threads.
+class StressSceneGL final
+{
+public:
+   enum ShapeType { Sphere = 0, Cube, Torus };
+   static constexpr int ShapeTypeNum = 3;
+
+   struct Description
+   {
+      uint64_t Seed = 1;
+      size_t ObjectNum = 1000;
+      // Segments around each shape; a cube face gets Tessellation / 4 segments per side.
+      int Tessellation = 32;
+      float Spacing = 4.0f;
+      // The scene shader takes at most 32 lights.
+      int LightNum = 8;
+      int TextureNum = 8;
+      int TextureSize = 256;
+   };
+
+   struct Instance
+   {
+      SceneGraph::Node Node;
+      glm::vec4 DiffuseColor;
+      glm::vec4 SpecularColor;
+      float SpecularExponent;
+      ShapeType Shape;
+      int Texture;
+   };
+
+   // The instances of a shape with the same texture are consecutive in the instance buffer of the shape, so each
+   // batch is drawn with one instanced call.
+   struct Batch
+   {
+      ShapeType Shape;
+      int Texture;
+      GLsizei FirstInstance;
+      GLsizei InstanceNum;
+      size_t FirstDraw;
+   };
+
+   StressSceneGL(const StressSceneGL&) = delete;
+   StressSceneGL(const StressSceneGL&&) = delete;
+   StressSceneGL& operator=(const StressSceneGL&) = delete;
+   StressSceneGL& operator=(const StressSceneGL&&) = delete;
+
+   StressSceneGL();
+   ~StressSceneGL();
+
+   // The shapes are placed in the arena when one is given, so that they share a vertex array.
+   void generate(const Description& description, GeometryArenaGL* arena = nullptr);
+   // Updates the scene graph, writes the world matrices of the instances into the instance buffers and moves the
+   // bounding spheres of the culler along.
+   void updateTransforms();
+   [[nodiscard]] bool isGenerated() const { return Shapes[0] != nullptr; }
+   [[nodiscard]] const ObjectGL& getShape(ShapeType shape) const { return *Shapes[shape]; }
+   [[nodiscard]] const std::vector<Instance>& getInstances() const { return Instances; }
+   [[nodiscard]] const std::vector<Batch>& getBatches() const { return Batches; }
+   // The instances of the shape in the order of the batches; their material indices refer to the material buffer.
+   [[nodiscard]] const std::vector<ObjectGL::Instance>& getShapeInstances(ShapeType shape) const
+   {
+      return ShapeInstances[shape];
+   }
+   // The draws are the shape instances in the order of the batches, the sphere ones first and then the cube and
+   // torus ones, and the culler holds the world bounding sphere of each draw.
+   [[nodiscard]] size_t getDrawNum() const { return ShapeDrawOffsets[ShapeTypeNum]; }
+   [[nodiscard]] ShapeType getDrawShape(size_t draw) const
+   {
+      int shape = 0;
+      while (draw >= ShapeDrawOffsets[shape + 1]) ++shape;
+      return static_cast<ShapeType>(shape);
+   }
+   [[nodiscard]] const ObjectGL::Instance& getDrawInstance(size_t draw) const
+   {
+      const ShapeType shape = getDrawShape( draw );
+      return ShapeInstances[shape][draw - ShapeDrawOffsets[shape]];
+   }
+   [[nodiscard]] FrustumCuller& getCuller() { return Culler; }
+   [[nodiscard]] const FrustumCuller& getCuller() const { return Culler; }
+   // Calls draw(batch, first_instance, instance_num) for each run of instances of a batch that the culler last
+   // found visible and that are consecutive in the instance buffer of the shape.
+   void forEachVisibleRun(const std::function<void(const Batch&, GLsizei, GLsizei)>& draw) const;
+   // The material of Instances[i] is the i-th one.
+   [[nodiscard]] GLuint getMaterialBuffer() const { return MaterialBuffer; }
+   // Room for a DrawElementsIndirectCommand per draw, where a GPU culling pass appends the visible instances of each
+   // batch from its first draw on, and a count per batch of what it appended.
+   [[nodiscard]] GLuint getCulledCommandBuffer() const { return CulledCommandBuffer; }
+   [[nodiscard]] GLuint getCulledDrawCountBuffer() const { return CulledDrawCountBuffer; }
+   // A flag per draw telling whether it was visible in the last frame that was culled for occlusion.
+   [[nodiscard]] GLuint getVisibilityBuffer() const { return VisibilityBuffer; }
+   // The instances are the children of the root, which places the whole grid.
+   [[nodiscard]] SceneGraph& getSceneGraph() { return Graph; }
+   [[nodiscard]] const SceneGraph& getSceneGraph() const { return Graph; }
+   [[nodiscard]] SceneGraph::Node getRoot() const { return Root; }
+   [[nodiscard]] GLuint getTextureID(int index) const { return TextureIDs[index]; }
+   [[nodiscard]] int getTextureNum() const { return static_cast<int>(TextureIDs.size()); }
+   // The textures as bindless handles or as layers of an array texture, which the materials refer to both ways.
+   [[nodiscard]] const TextureSetGL& getTextureSet() const { return TextureSet; }
+   [[nodiscard]] LightGL& getLights() const { return *Lights; }
+   // The grid is centered at the origin and spans [-getExtent(), getExtent()] on every axis.
+   [[nodiscard]] float getExtent() const { return Extent; }
+
+private:
+   struct Mesh
+   {
+      std::vector<glm::vec3> Vertices;
+      std::vector<glm::vec3> Normals;
+      std::vector<glm::vec2> Textures;
+      std::vector<GLuint> Indices;
+   };
+
+   std::array<std::unique_ptr<ObjectGL>, ShapeTypeNum> Shapes;
+   std::vector<Instance> Instances;
+   std::vector<Batch> Batches;
+   // ShapeInstances[s][j] is what the shape s draws for Instances[InstanceOrders[s][j]].
+   std::array<std::vector<ObjectGL::Instance>, ShapeTypeNum> ShapeInstances;
+   std::array<std::vector<uint32_t>, ShapeTypeNum> InstanceOrders;
+   std::array<size_t, ShapeTypeNum + 1> ShapeDrawOffsets;
+   FrustumCuller Culler;
+   GLuint MaterialBuffer;
+   GLuint CulledCommandBuffer;
+   GLuint CulledDrawCountBuffer;
+   GLuint VisibilityBuffer;
+   SceneGraph Graph;
+   SceneGraph::Node Root;
+   std::vector<GLuint> TextureIDs;
+   TextureSetGL TextureSet;
+   std::unique_ptr<LightGL> Lights;
+   float Extent;
+
+   // A counter-based generator: the i-th number of a stream only depends on the seed, the stream and i.
+   [[nodiscard]] static uint64_t getRandomBits(uint64_t seed, uint64_t stream, uint64_t index);
+   [[nodiscard]] static float getRandomFloat(uint64_t seed, uint64_t stream, uint64_t index)
+   {
+      return static_cast<float>(getRandomBits( seed, stream, index ) >> 40) * 0x1.0p-24f;
+   }
+   // Lays out a grid of (column_num + 1) x (row_num + 1) vertices whose rows are filled in parallel by get_vertex.
+   static void setGrid(
+      Mesh& mesh,
+      int column_num,
+      int row_num,
+      const std::function<void(float, float, glm::vec3&, glm::vec3&)>& get_vertex
+   );
+   static void getSphere(Mesh& mesh, int tessellation);
+   static void getCube(Mesh& mesh, int tessellation);
+   static void getTorus(Mesh& mesh, int tessellation);
+   void releaseTextures();
+   void releaseBuffers();
+   void createTextures(const Description& description);
+   void createInstances(const Description& description);
+   void createLights(const Description& description);
+   // Groups the instances by shape and then by texture, uploads the materials of all instances and allocates the
+   // buffers for culling on the GPU.
+   void createBatches();
+};
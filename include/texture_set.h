@@ -0,0 +1,48 @@
+#pragma once
+
+#include "base.h"
+
+// Textures that shaders pick by what the material holds instead of by a binding, so that draws with different
+// textures can share one multi-draw call. With ARB_bindless_texture and NV_gpu_shader5, every texture gets a resident
+// handle; without them, the textures, which then have to share their size, format and levels, are copied into the
+// layers of one array texture. The set does not own the textures it was given, and has to be released before they
+// are deleted.
+class TextureSetGL final
+{
+public:
+   TextureSetGL(const TextureSetGL&) = delete;
+   TextureSetGL(const TextureSetGL&&) = delete;
+   TextureSetGL& operator=(const TextureSetGL&) = delete;
+   TextureSetGL& operator=(const TextureSetGL&&) = delete;
+
+   TextureSetGL();
+   ~TextureSetGL();
+
+   // Whether the context exposes ARB_bindless_texture, and NV_gpu_shader5 for handles that vary within a draw.
+   // glad is not generated with them, so the bindless functions are loaded here.
+   [[nodiscard]] static bool isBindlessSupported();
+   // Returns false, with an empty set, when the array fallback gets textures that do not match.
+   bool setTextures(const std::vector<GLuint>& textures, bool use_bindless);
+   void release();
+   [[nodiscard]] bool isBindless() const { return !Handles.empty(); }
+   [[nodiscard]] bool isEmpty() const { return Handles.empty() && ArrayTexture == 0; }
+   // The handle of the index-th texture, or 0 for the array fallback.
+   [[nodiscard]] GLuint64 getHandle(int index) const { return Handles.empty() ? 0 : Handles[index]; }
+   // The index-th texture is the index-th layer.
+   [[nodiscard]] GLuint getArrayTexture() const { return ArrayTexture; }
+
+private:
+   struct BindlessFunctions
+   {
+      GLuint64 (APIENTRYP GetTextureHandle)(GLuint texture) = nullptr;
+      void (APIENTRYP MakeTextureHandleResident)(GLuint64 handle) = nullptr;
+      void (APIENTRYP MakeTextureHandleNonResident)(GLuint64 handle) = nullptr;
+   };
+
+   std::vector<GLuint64> Handles;
+   GLuint ArrayTexture;
+
+   [[nodiscard]] static const BindlessFunctions& getBindlessFunctions();
+   void setHandles(const std::vector<GLuint>& textures);
+   bool setArrayTexture(const std::vector<GLuint>& textures);
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include "base.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <atomic>
+
+class ThreadPool final
+{
+public:
+   ThreadPool(const ThreadPool&) = delete;
+   ThreadPool(const ThreadPool&&) = delete;
+   ThreadPool& operator=(const ThreadPool&) = delete;
+   ThreadPool& operator=(const ThreadPool&&) = delete;
+
+   ~ThreadPool();
+
+   [[nodiscard]] static ThreadPool& getInstance();
+   [[nodiscard]] int getThreadNum() const { return static_cast<int>(Workers.size()) + 1; }
+
+   // Splits [0, count) into contiguous ranges of at least min_count_per_task elements and calls
+   // task(begin, end) for each of them. The calling thread takes part and returns when all ranges are done.
+   void parallelFor(size_t count, size_t min_count_per_task, const std::function<void(size_t, size_t)>& task);
+
+private:
+   inline static thread_local bool IsWorkerThread = false;
+   bool Terminate;
+   uint64_t JobID;
+   size_t Count;
+   size_t CountPerTask;
+   size_t TaskNum;
+   int ActiveWorkerNum;
+   std::atomic<size_t> NextTask;
+   const std::function<void(size_t, size_t)>* Task;
+   std::vector<std::thread> Workers;
+   std::mutex Lock;
+   std::mutex JobLock;
+   std::condition_variable JobReady;
+   std::condition_variable JobDone;
+
+   ThreadPool();
+
+   void work();
+   void runTasks();
+};
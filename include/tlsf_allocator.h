@@ -0,0 +1,66 @@
+#pragma once
+
+#include "base.h"
+#include <limits>
+
+// A two-level segregated fit allocator over an abstract range [0, capacity) of units, such as vertices or indices.
+// Allocation and release take constant time: free blocks are bucketed by the highest bit of their size and
+// SecondLevelNum subdivisions below it, and neighboring free blocks are merged on release.
+class TLSFAllocator final
+{
+public:
+   static constexpr uint32_t InvalidHandle = std::numeric_limits<uint32_t>::max();
+
+   struct Allocation
+   {
+      size_t Offset = 0;
+      size_t Size = 0;
+      uint32_t Handle = InvalidHandle;
+
+      [[nodiscard]] bool isValid() const { return Handle != InvalidHandle; }
+   };
+
+   explicit TLSFAllocator(size_t capacity = 0);
+
+   // Returns an invalid allocation when no free block is large enough.
+   [[nodiscard]] Allocation allocate(size_t size);
+   void free(const Allocation& allocation);
+   // Appends [capacity, new_capacity) as free space; allocations keep their offsets.
+   void grow(size_t new_capacity);
+   [[nodiscard]] size_t getCapacity() const { return Capacity; }
+   [[nodiscard]] size_t getUsedSize() const { return UsedSize; }
+
+private:
+   static constexpr int SecondLevelLog2 = 4;
+   static constexpr int SecondLevelNum = 1 << SecondLevelLog2;
+   static constexpr int FirstLevelNum = 64 - SecondLevelLog2 + 1;
+
+   struct Block
+   {
+      size_t Offset;
+      size_t Size;
+      uint32_t PreviousPhysical;
+      uint32_t NextPhysical;
+      uint32_t PreviousFree;
+      uint32_t NextFree;
+      bool IsFree;
+   };
+
+   size_t Capacity;
+   size_t UsedSize;
+   uint64_t FirstLevelBitmap;
+   uint32_t SecondLevelBitmaps[FirstLevelNum];
+   uint32_t FreeHeads[FirstLevelNum][SecondLevelNum];
+   uint32_t LastPhysical;
+   std::vector<Block> Blocks;
+   std::vector<uint32_t> UnusedBlocks;
+
+   [[nodiscard]] static int getHighestBit(uint64_t value);
+   [[nodiscard]] static int getLowestBit(uint64_t value);
+   static void getLevels(size_t size, int& first_level, int& second_level);
+   [[nodiscard]] uint32_t createBlock(size_t offset, size_t size);
+   void destroyBlock(uint32_t block);
+   void insertFreeBlock(uint32_t block);
+   void removeFreeBlock(uint32_t block);
+   [[nodiscard]] uint32_t findFreeBlock(size_t size) const;
+};
@@ -1,4 +1,6 @@
 #version 460
+#extension GL_ARB_bindless_texture : enable
+#extension GL_NV_gpu_shader5 : enable
 
 #define MAX_LIGHTS 32
 
@@ -26,17 +28,36 @@ struct MateralInfo
 };
 layout (location = 291) uniform MateralInfo Material;
 
+// The instanced materials also pick their texture: a layer of the texture array, where -1 is none, or a bindless
+// handle, where 0 is none.
+struct InstanceMaterialInfo
+{
+   vec4 EmissionColor;
+   vec4 AmbientColor;
+   vec4 DiffuseColor;
+   vec4 SpecularColor;
+   float SpecularExponent;
+   int TextureIndex;
+   uvec2 TextureHandle;
+};
+layout (binding = 1, std430) readonly buffer InstanceMaterialBuffer { InstanceMaterialInfo Materials[]; };
+
 layout (binding = 0) uniform sampler2D BaseTexture;
+layout (binding = 1) uniform sampler2DArray TextureArray;
 
 layout (location = 1) uniform mat4 ViewMatrix;
 layout (location = 296) uniform int UseTexture;
 layout (location = 297) uniform int UseLight;
 layout (location = 298) uniform int LightNum;
 layout (location = 299) uniform vec4 GlobalAmbient;
+layout (location = 300) uniform int UseInstancing;
+// 0 samples the base texture under UseTexture, 1 the texture array, and 2 the bindless handles.
+layout (location = 302) uniform int TextureMode;
 
 in vec3 position_in_ec;
 in vec3 normal_in_ec;
 in vec2 tex_coord;
+flat in uint material_index;
 
 layout (location = 0) out vec4 final_color;
 
@@ -76,9 +97,9 @@ float getSpotlightFactor(in vec3 normalized_light_vector, in int light_index)
    return zero;
 }
 
-vec4 calculateLightingEquation()
+vec4 calculateLightingEquation(in MateralInfo material)
 {
-   vec4 color = Material.EmissionColor + GlobalAmbient * Material.AmbientColor;
+   vec4 color = material.EmissionColor + GlobalAmbient * material.AmbientColor;
 
    for (int i = 0; i < LightNum; ++i) {
       if (Lights[i].LightSwitch == 0) continue;
@@ -98,29 +119,57 @@ vec4 calculateLightingEquation()
    
       if (final_effect_factor <= zero) continue;
 
-      vec4 local_color = Lights[i].AmbientColor * Material.AmbientColor;
+      vec4 local_color = Lights[i].AmbientColor * material.AmbientColor;
 
       float diffuse_intensity = max( dot( normal_in_ec, light_vector ), zero );
-      local_color += diffuse_intensity * Lights[i].DiffuseColor * Material.DiffuseColor;
+      local_color += diffuse_intensity * Lights[i].DiffuseColor * material.DiffuseColor;
 
       vec3 halfway_vector = normalize( light_vector - normalize( position_in_ec ) );
       float specular_intensity = max( dot( normal_in_ec, halfway_vector ), zero );
       local_color += 
-         pow( specular_intensity, Material.SpecularExponent ) * 
-         Lights[i].SpecularColor * Material.SpecularColor;
+         pow( specular_intensity, material.SpecularExponent ) * 
+         Lights[i].SpecularColor * material.SpecularColor;
 
       color += local_color * final_effect_factor;
    }
    return color;
 }
 
+vec4 getTextureColor(in InstanceMaterialInfo instance_material)
+{
+   if (TextureMode == 1) {
+      if (instance_material.TextureIndex < 0) return vec4(one);
+      return texture( TextureArray, vec3(tex_coord, float(instance_material.TextureIndex)) );
+   }
+#if defined(GL_ARB_bindless_texture) && defined(GL_NV_gpu_shader5)
+   if (TextureMode == 2) {
+      // The handle varies between the instances of a draw, which NV_gpu_shader5 allows.
+      if (instance_material.TextureHandle == uvec2(0u)) return vec4(one);
+      return texture( sampler2D(instance_material.TextureHandle), tex_coord );
+   }
+#endif
+   return UseTexture == 0 ? vec4(one) : texture( BaseTexture, tex_coord );
+}
+
 void main()
 {
-   if (UseTexture == 0) final_color = vec4(one);
+   MateralInfo material = Material;
+   if (UseInstancing != 0) {
+      InstanceMaterialInfo instance_material = Materials[material_index];
+      material = MateralInfo(
+         instance_material.EmissionColor,
+         instance_material.AmbientColor,
+         instance_material.DiffuseColor,
+         instance_material.SpecularColor,
+         instance_material.SpecularExponent
+      );
+      final_color = getTextureColor( instance_material );
+   }
+   else if (UseTexture == 0) final_color = vec4(one);
    else final_color = texture( BaseTexture, tex_coord );
 
    if (UseLight != 0) {
-      final_color *= calculateLightingEquation();
+      final_color *= calculateLightingEquation( material );
    }
-   else final_color *= Material.DiffuseColor;
+   else final_color *= material.DiffuseColor;
 }
\ No newline at end of file
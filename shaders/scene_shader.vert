@@ -3,6 +3,15 @@
 layout (location = 0) uniform mat4 WorldMatrix;
 layout (location = 1) uniform mat4 ViewMatrix;
 layout (location = 2) uniform mat4 ModelViewProjectionMatrix;
+layout (location = 300) uniform int UseInstancing;
+layout (location = 301) uniform mat4 ProjectionMatrix;
+
+struct InstanceInfo
+{
+   mat4 WorldMatrix;
+   uint MaterialIndex;
+};
+layout (binding = 0, std430) readonly buffer InstanceBuffer { InstanceInfo Instances[]; };
 
 layout (location = 0) in vec3 v_position;
 layout (location = 1) in vec3 v_normal;
@@ -11,15 +20,25 @@ layout (location = 2) in vec2 v_tex_coord;
 out vec3 position_in_ec;
 out vec3 normal_in_ec;
 out vec2 tex_coord;
+flat out uint material_index;
 
 void main()
 {   
-   vec4 e_position = ViewMatrix * WorldMatrix * vec4(v_position, 1.0f);
-   vec4 e_normal = transpose( inverse( ViewMatrix * WorldMatrix ) ) * vec4(v_normal, 1.0f);
+   mat4 world_matrix = WorldMatrix;
+   material_index = 0;
+   if (UseInstancing != 0) {
+      InstanceInfo instance = Instances[gl_BaseInstance + gl_InstanceID];
+      world_matrix = instance.WorldMatrix;
+      material_index = instance.MaterialIndex;
+   }
+
+   vec4 e_position = ViewMatrix * world_matrix * vec4(v_position, 1.0f);
+   vec4 e_normal = transpose( inverse( ViewMatrix * world_matrix ) ) * vec4(v_normal, 1.0f);
    position_in_ec = e_position.xyz;
    normal_in_ec = normalize( e_normal.xyz );
 
    tex_coord = v_tex_coord;  
 
-   gl_Position = ModelViewProjectionMatrix * vec4(v_position, 1.0f);
+   gl_Position = UseInstancing != 0 ?
+      ProjectionMatrix * e_position : ModelViewProjectionMatrix * vec4(v_position, 1.0f);
 }
\ No newline at end of file
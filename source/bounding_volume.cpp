@@ -0,0 +1,148 @@
+#include "bounding_volume.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BOUNDING_VOLUME_USE_SSE
+#include <emmintrin.h>
+#endif
+
+void BoundingVolume::growSphere(const glm::vec3& position)
+{
+   const glm::vec3 offset = position - SphereCenter;
+   const float squared_distance = glm::dot( offset, offset );
+   if (squared_distance <= SphereRadius * SphereRadius) return;
+
+   const float distance = std::sqrt( squared_distance );
+   const float radius = (SphereRadius + distance) * 0.5f;
+   SphereCenter += offset * ((radius - SphereRadius) / distance);
+   SphereRadius = radius;
+}
+
+void BoundingVolume::expand(const glm::vec3& position)
+{
+   if (isEmpty()) {
+      BoxMin = BoxMax = SphereCenter = position;
+      SphereRadius = 0.0f;
+      return;
+   }
+
+   BoxMin = glm::min( BoxMin, position );
+   BoxMax = glm::max( BoxMax, position );
+   growSphere( position );
+}
+
+void BoundingVolume::getBox(
+   const GLfloat* positions,
+   size_t stride,
+   size_t begin,
+   size_t end,
+   glm::vec3& min_point,
+   glm::vec3& max_point
+)
+{
+   size_t i = begin;
+#ifdef BOUNDING_VOLUME_USE_SSE
+   // _mm_loadu_ps reads one float past the position, which only the last position of a packed array cannot afford.
+   // The fourth lane holds whatever follows and is dropped at the end.
+   const size_t vector_end = stride > 3 ? end : std::max( begin, end - 1 );
+   if (i < vector_end) {
+      __m128 min_vector = _mm_loadu_ps( positions + stride * i );
+      __m128 max_vector = min_vector;
+      for (++i; i < vector_end; ++i) {
+         const __m128 p = _mm_loadu_ps( positions + stride * i );
+         min_vector = _mm_min_ps( min_vector, p );
+         max_vector = _mm_max_ps( max_vector, p );
+      }
+      alignas(16) float min_values[4], max_values[4];
+      _mm_store_ps( min_values, min_vector );
+      _mm_store_ps( max_values, max_vector );
+      min_point = glm::min( min_point, glm::vec3(min_values[0], min_values[1], min_values[2]) );
+      max_point = glm::max( max_point, glm::vec3(max_values[0], max_values[1], max_values[2]) );
+   }
+#endif
+   for (; i < end; ++i) {
+      const glm::vec3 position = getPosition( positions, stride, i );
+      min_point = glm::min( min_point, position );
+      max_point = glm::max( max_point, position );
+   }
+}
+
+void BoundingVolume::setSphere(BoundingVolume& volume, const GLfloat* positions, size_t stride, size_t vertex_num)
+{
+   // The extreme positions along the widest axis seed the sphere, which a single pass then grows over the rest.
+   const glm::vec3 size = volume.BoxMax - volume.BoxMin;
+   const int axis = size.x >= size.y && size.x >= size.z ? 0 : (size.y >= size.z ? 1 : 2);
+   const size_t block_num = (vertex_num + BlockSize - 1) / BlockSize;
+   std::vector<size_t> min_indices(block_num), max_indices(block_num);
+   std::vector<float> box_radii(block_num, 0.0f);
+   const glm::vec3 box_center = volume.getBoxCenter();
+   ThreadPool::getInstance().parallelFor(
+      block_num, 1,
+      [&](size_t begin, size_t end) {
+         for (size_t b = begin; b < end; ++b) {
+            const size_t first = b * BlockSize;
+            const size_t last = std::min( first + BlockSize, vertex_num );
+            size_t min_index = first, max_index = first;
+            float squared_radius = 0.0f;
+            for (size_t i = first; i < last; ++i) {
+               const GLfloat* p = positions + stride * i;
+               if (p[axis] < positions[stride * min_index + axis]) min_index = i;
+               if (p[axis] > positions[stride * max_index + axis]) max_index = i;
+               const glm::vec3 offset = glm::vec3(p[0], p[1], p[2]) - box_center;
+               squared_radius = std::max( squared_radius, glm::dot( offset, offset ) );
+            }
+            min_indices[b] = min_index;
+            max_indices[b] = max_index;
+            box_radii[b] = squared_radius;
+         }
+      }
+   );
+
+   size_t min_index = min_indices[0], max_index = max_indices[0];
+   for (size_t b = 1; b < block_num; ++b) {
+      if (positions[stride * min_indices[b] + axis] < positions[stride * min_index + axis]) min_index = min_indices[b];
+      if (positions[stride * max_indices[b] + axis] > positions[stride * max_index + axis]) max_index = max_indices[b];
+   }
+   const glm::vec3 p = getPosition( positions, stride, min_index );
+   const glm::vec3 q = getPosition( positions, stride, max_index );
+   volume.SphereCenter = (p + q) * 0.5f;
+   volume.SphereRadius = glm::length( q - p ) * 0.5f;
+   for (size_t i = 0; i < vertex_num; ++i) volume.growSphere( getPosition( positions, stride, i ) );
+
+   const float box_radius = std::sqrt( *std::max_element( box_radii.begin(), box_radii.end() ) );
+   if (box_radius < volume.SphereRadius) {
+      volume.SphereCenter = box_center;
+      volume.SphereRadius = box_radius;
+   }
+}
+
+BoundingVolume BoundingVolume::get(const GLfloat* positions, size_t stride, size_t vertex_num)
+{
+   assert( stride >= 3 );
+
+   BoundingVolume volume;
+   if (positions == nullptr || vertex_num == 0) return volume;
+
+   const size_t block_num = (vertex_num + BlockSize - 1) / BlockSize;
+   std::vector<glm::vec3> min_points(block_num, volume.BoxMin), max_points(block_num, volume.BoxMax);
+   ThreadPool::getInstance().parallelFor(
+      block_num, 1,
+      [&](size_t begin, size_t end) {
+         for (size_t b = begin; b < end; ++b) {
+            getBox(
+               positions, stride,
+               b * BlockSize, std::min( (b + 1) * BlockSize, vertex_num ),
+               min_points[b], max_points[b]
+            );
+         }
+      }
+   );
+   for (size_t b = 0; b < block_num; ++b) {
+      volume.BoxMin = glm::min( volume.BoxMin, min_points[b] );
+      volume.BoxMax = glm::max( volume.BoxMax, max_points[b] );
+   }
+   setSphere( volume, positions, stride, vertex_num );
+   return volume;
+}
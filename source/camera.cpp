@@ -124,4 +124,16 @@ void CameraGL::updateWindowSize(int width, int height)
    Height = height;
    AspectRatio = static_cast<float>(width) / static_cast<float>(height);
    ProjectionMatrix = glm::perspective( glm::radians( FOV ), AspectRatio, NearPlane, FarPlane );
+}
+
+std::array<glm::vec4, 6> CameraGL::getFrustumPlanes(const glm::mat4& matrix)
+{
+   const glm::mat4 rows = glm::transpose( matrix );
+   std::array<glm::vec4, 6> planes = {
+      rows[3] + rows[0], rows[3] - rows[0],
+      rows[3] + rows[1], rows[3] - rows[1],
+      rows[3] + rows[2], rows[3] - rows[2]
+   };
+   for (auto& plane : planes) plane /= glm::length( glm::vec3(plane) );
+   return planes;
 }
\ No newline at end of file
@@ -0,0 +1,158 @@
+#include "command_list.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+
+void CommandListGL::clear()
+{
+   Arena.clear();
+   CommandNum = 0;
+   BoundVAO = 0;
+   UsedProgram = 0;
+   BoundTextures.fill( 0 );
+}
+
+void CommandListGL::bindVertexArray(GLuint vao)
+{
+   if (vao != 0 && vao == BoundVAO) return;
+
+   BoundVAO = vao;
+   push( BindVertexArrayCommand{ vao } );
+}
+
+void CommandListGL::useProgram(GLuint program)
+{
+   if (program != 0 && program == UsedProgram) return;
+
+   UsedProgram = program;
+   push( UseProgramCommand{ program } );
+}
+
+void CommandListGL::bindTextureUnit(GLuint unit, GLuint texture)
+{
+   if (unit < MaxFilteredTextureUnitNum) {
+      if (texture != 0 && texture == BoundTextures[unit]) return;
+      BoundTextures[unit] = texture;
+   }
+   push( BindTextureUnitCommand{ unit, texture } );
+}
+
+void CommandListGL::bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+   push( BindBufferBaseCommand{ target, index, buffer } );
+}
+
+void CommandListGL::drawElements(
+   GLenum mode,
+   GLsizei count,
+   GLenum index_type,
+   size_t offset,
+   GLsizei instance_num,
+   GLint base_vertex,
+   GLuint base_instance
+)
+{
+   push(
+      DrawElementsCommand{
+         mode, count, index_type, instance_num, base_vertex, base_instance, static_cast<uint64_t>(offset)
+      }
+   );
+}
+
+void CommandListGL::multiDrawElementsIndirect(GLenum mode, GLenum index_type, size_t offset, GLsizei draw_num)
+{
+   push( MultiDrawElementsIndirectCommand{ mode, index_type, draw_num, static_cast<uint64_t>(offset) } );
+}
+
+void CommandListGL::execute() const
+{
+   const uint8_t* data = Arena.data();
+   const uint8_t* end = data + Arena.size();
+   while (data < end) {
+      const auto header = read<Header>( data );
+      const uint8_t* command = data + sizeof( Header );
+      switch (header.Type) {
+         case BindVertexArray:
+            glBindVertexArray( read<BindVertexArrayCommand>( command ).VAO );
+            break;
+         case UseProgram:
+            glUseProgram( read<UseProgramCommand>( command ).Program );
+            break;
+         case BindTextureUnit: {
+            const auto c = read<BindTextureUnitCommand>( command );
+            glBindTextureUnit( c.Unit, c.Texture );
+         } break;
+         case BindBufferBase: {
+            const auto c = read<BindBufferBaseCommand>( command );
+            glBindBufferBase( c.Target, c.Index, c.Buffer );
+         } break;
+         case Uniform1i: {
+            const auto c = read<Uniform1iCommand>( command );
+            glProgramUniform1i( c.Program, c.Location, c.Value );
+         } break;
+         case Uniform1f: {
+            const auto c = read<Uniform1fCommand>( command );
+            glProgramUniform1f( c.Program, c.Location, c.Value );
+         } break;
+         case Uniform4fv: {
+            const auto c = read<Uniform4fvCommand>( command );
+            glProgramUniform4fv( c.Program, c.Location, 1, glm::value_ptr( c.Value ) );
+         } break;
+         case UniformMatrix4fv: {
+            const auto c = read<UniformMatrix4fvCommand>( command );
+            glProgramUniformMatrix4fv( c.Program, c.Location, 1, GL_FALSE, glm::value_ptr( c.Value ) );
+         } break;
+         case DrawElements: {
+            const auto c = read<DrawElementsCommand>( command );
+            glDrawElementsInstancedBaseVertexBaseInstance(
+               c.Mode, c.Count, c.IndexType, reinterpret_cast<const void*>(c.Offset), c.InstanceNum, c.BaseVertex,
+               c.BaseInstance
+            );
+         } break;
+         case MultiDrawElementsIndirect: {
+            const auto c = read<MultiDrawElementsIndirectCommand>( command );
+            glMultiDrawElementsIndirect( c.Mode, c.IndexType, reinterpret_cast<const void*>(c.Offset), c.DrawNum, 0 );
+         } break;
+      }
+      data = command + header.Size;
+   }
+}
+
+void CommandListSetGL::record(
+   size_t count,
+   size_t min_count_per_list,
+   const std::function<void(CommandListGL&, size_t, size_t)>& recorder
+)
+{
+   ThreadPool& pool = ThreadPool::getInstance();
+   ListNum = count == 0 ? 0 : std::clamp(
+      count / std::max( min_count_per_list, size_t{ 1 } ), size_t{ 1 }, static_cast<size_t>(pool.getThreadNum()) * 4
+   );
+   if (Lists.size() < ListNum) Lists.resize( ListNum );
+   if (ListNum == 0) return;
+
+   const size_t count_per_list = (count + ListNum - 1) / ListNum;
+   pool.parallelFor(
+      ListNum, 1,
+      [&](size_t list_begin, size_t list_end) {
+         for (size_t l = list_begin; l < list_end; ++l) {
+            Lists[l].clear();
+            const size_t begin = std::min( l * count_per_list, count );
+            const size_t end = std::min( begin + count_per_list, count );
+            if (begin < end) recorder( Lists[l], begin, end );
+         }
+      }
+   );
+}
+
+void CommandListSetGL::execute() const
+{
+   for (size_t l = 0; l < ListNum; ++l) Lists[l].execute();
+}
+
+size_t CommandListSetGL::getCommandNum() const
+{
+   size_t command_num = 0;
+   for (size_t l = 0; l < ListNum; ++l) command_num += Lists[l].getCommandNum();
+   return command_num;
+}
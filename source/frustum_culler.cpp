@@ -0,0 +1,133 @@
+#include "frustum_culler.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#if defined(__AVX__)
+#define FRUSTUM_CULLER_USE_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_CULLER_USE_SSE
+#include <emmintrin.h>
+#endif
+
+void FrustumCuller::resize(size_t sphere_num)
+{
+   assert( sphere_num < std::numeric_limits<uint32_t>::max() );
+
+   // The padding spheres have a negative infinite radius, so they fail the first plane.
+   const size_t padded_num = (sphere_num + LaneNum - 1) / LaneNum * LaneNum;
+   SphereNum = sphere_num;
+   CentersX.assign( padded_num, 0.0f );
+   CentersY.assign( padded_num, 0.0f );
+   CentersZ.assign( padded_num, 0.0f );
+   Radii.assign( padded_num, -std::numeric_limits<float>::infinity() );
+   VisibleIndices.clear();
+}
+
+size_t FrustumCuller::cullBlock(
+   const std::array<glm::vec4, 6>& planes,
+   size_t begin,
+   size_t end,
+   uint32_t* visible
+) const
+{
+   size_t visible_num = 0;
+   for (size_t i = begin; i < end; i += LaneNum) {
+      int mask;
+#if defined(FRUSTUM_CULLER_USE_AVX)
+      const __m256 x = _mm256_loadu_ps( CentersX.data() + i );
+      const __m256 y = _mm256_loadu_ps( CentersY.data() + i );
+      const __m256 z = _mm256_loadu_ps( CentersZ.data() + i );
+      const __m256 negative_radius = _mm256_sub_ps( _mm256_setzero_ps(), _mm256_loadu_ps( Radii.data() + i ) );
+      __m256 inside = _mm256_castsi256_ps( _mm256_set1_epi32( -1 ) );
+      for (const auto& plane : planes) {
+         const __m256 distance = _mm256_add_ps(
+            _mm256_add_ps(
+               _mm256_mul_ps( x, _mm256_set1_ps( plane.x ) ), _mm256_mul_ps( y, _mm256_set1_ps( plane.y ) )
+            ),
+            _mm256_add_ps( _mm256_mul_ps( z, _mm256_set1_ps( plane.z ) ), _mm256_set1_ps( plane.w ) )
+         );
+         inside = _mm256_and_ps( inside, _mm256_cmp_ps( distance, negative_radius, _CMP_GE_OQ ) );
+      }
+      mask = _mm256_movemask_ps( inside );
+#elif defined(FRUSTUM_CULLER_USE_SSE)
+      mask = 0;
+      for (size_t half = 0; half < LaneNum; half += 4) {
+         const __m128 x = _mm_loadu_ps( CentersX.data() + i + half );
+         const __m128 y = _mm_loadu_ps( CentersY.data() + i + half );
+         const __m128 z = _mm_loadu_ps( CentersZ.data() + i + half );
+         const __m128 negative_radius = _mm_sub_ps( _mm_setzero_ps(), _mm_loadu_ps( Radii.data() + i + half ) );
+         __m128 inside = _mm_castsi128_ps( _mm_set1_epi32( -1 ) );
+         for (const auto& plane : planes) {
+            const __m128 distance = _mm_add_ps(
+               _mm_add_ps( _mm_mul_ps( x, _mm_set1_ps( plane.x ) ), _mm_mul_ps( y, _mm_set1_ps( plane.y ) ) ),
+               _mm_add_ps( _mm_mul_ps( z, _mm_set1_ps( plane.z ) ), _mm_set1_ps( plane.w ) )
+            );
+            inside = _mm_and_ps( inside, _mm_cmpge_ps( distance, negative_radius ) );
+         }
+         mask |= _mm_movemask_ps( inside ) << half;
+      }
+#else
+      mask = 0;
+      for (size_t lane = 0; lane < LaneNum; ++lane) {
+         const glm::vec3 center(CentersX[i + lane], CentersY[i + lane], CentersZ[i + lane]);
+         bool inside = true;
+         for (const auto& plane : planes) {
+            inside = inside && glm::dot( glm::vec3(plane), center ) + plane.w >= -Radii[i + lane];
+         }
+         mask |= (inside ? 1 : 0) << lane;
+      }
+#endif
+      // Most groups are usually outside, so they skip the compaction. Otherwise every lane is written, and only
+      // the visible ones advance the count.
+      if (mask == 0) continue;
+      for (size_t lane = 0; lane < LaneNum; ++lane) {
+         visible[visible_num] = static_cast<uint32_t>(i + lane);
+         visible_num += static_cast<size_t>((mask >> lane) & 1);
+      }
+   }
+   return visible_num;
+}
+
+void FrustumCuller::cull(const std::array<glm::vec4, 6>& planes, bool parallel)
+{
+   const size_t padded_num = Radii.size();
+   const size_t block_num = (padded_num + BlockSize - 1) / BlockSize;
+   // The branchless compaction may write one lane past the last visible index of a block.
+   BlockVisibleIndices.resize( padded_num + LaneNum );
+   BlockVisibleNums.resize( block_num );
+   const auto cull_blocks = [&](size_t block_begin, size_t block_end) {
+      for (size_t b = block_begin; b < block_end; ++b) {
+         const size_t begin = b * BlockSize;
+         BlockVisibleNums[b] = cullBlock(
+            planes, begin, std::min( begin + BlockSize, padded_num ), BlockVisibleIndices.data() + begin
+         );
+      }
+   };
+   if (parallel) ThreadPool::getInstance().parallelFor( block_num, 1, cull_blocks );
+   else cull_blocks( 0, block_num );
+
+   std::vector<size_t> offsets(block_num + 1, 0);
+   for (size_t b = 0; b < block_num; ++b) offsets[b + 1] = offsets[b] + BlockVisibleNums[b];
+   VisibleIndices.resize( offsets[block_num] );
+   const auto gather_blocks = [&](size_t block_begin, size_t block_end) {
+      for (size_t b = block_begin; b < block_end; ++b) {
+         if (BlockVisibleNums[b] == 0) continue;
+         std::memcpy(
+            VisibleIndices.data() + offsets[b], BlockVisibleIndices.data() + b * BlockSize,
+            BlockVisibleNums[b] * sizeof( uint32_t )
+         );
+      }
+   };
+   if (parallel) ThreadPool::getInstance().parallelFor( block_num, 4, gather_blocks );
+   else gather_blocks( 0, block_num );
+}
+
+void FrustumCuller::setAllVisible()
+{
+   VisibleIndices.resize( SphereNum );
+   std::iota( VisibleIndices.begin(), VisibleIndices.end(), 0u );
+}
@@ -0,0 +1,139 @@
+#include "geometry_arena.h"
+#include "object.h"
+#include <algorithm>
+
+GeometryArenaGL::GeometryArenaGL(size_t initial_vertex_num, size_t initial_index_num) :
+   InitialVertexNum( initial_vertex_num ), InitialIndexNum( initial_index_num ), IndexBuffer( 0 )
+{
+}
+
+GeometryArenaGL::~GeometryArenaGL()
+{
+   for (const auto& pool : VertexPools) {
+      if (pool.Buffer == 0) continue;
+      glDeleteVertexArrays( 1, &pool.VAO );
+      glDeleteVertexArrays( 1, &pool.PositionVAO );
+      glDeleteBuffers( 1, &pool.Buffer );
+   }
+   if (IndexBuffer != 0) glDeleteBuffers( 1, &IndexBuffer );
+}
+
+GLuint GeometryArenaGL::createBuffer(GLsizeiptr size, GLuint old_buffer, GLsizeiptr old_size)
+{
+   GLuint buffer = 0;
+   glCreateBuffers( 1, &buffer );
+   glNamedBufferStorage( buffer, size, nullptr, GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT );
+   if (old_buffer != 0) {
+      glCopyNamedBufferSubData( old_buffer, buffer, 0, 0, old_size );
+      glDeleteBuffers( 1, &old_buffer );
+   }
+   return buffer;
+}
+
+void GeometryArenaGL::createVertexPool(bool normals_exist, bool textures_exist)
+{
+   VertexPool& pool = VertexPools[getLayoutIndex( normals_exist, textures_exist )];
+   const GLsizei stride = getVertexStride( normals_exist, textures_exist );
+   pool.Allocator.grow( InitialVertexNum );
+   pool.Buffer = createBuffer( static_cast<GLsizeiptr>(stride) * InitialVertexNum );
+
+   glCreateVertexArrays( 1, &pool.VAO );
+   glCreateVertexArrays( 1, &pool.PositionVAO );
+   for (const auto& vao : { pool.VAO, pool.PositionVAO }) {
+      glVertexArrayVertexBuffer( vao, 0, pool.Buffer, 0, stride );
+      glVertexArrayAttribFormat( vao, ObjectGL::VertexLocation, 3, GL_FLOAT, GL_FALSE, 0 );
+      glVertexArrayAttribBinding( vao, ObjectGL::VertexLocation, 0 );
+      glEnableVertexArrayAttrib( vao, ObjectGL::VertexLocation );
+      if (IndexBuffer != 0) glVertexArrayElementBuffer( vao, IndexBuffer );
+   }
+   if (normals_exist) {
+      glVertexArrayAttribFormat( pool.VAO, ObjectGL::NormalLocation, 3, GL_FLOAT, GL_FALSE, 3 * sizeof( GLfloat ) );
+      glVertexArrayAttribBinding( pool.VAO, ObjectGL::NormalLocation, 0 );
+      glEnableVertexArrayAttrib( pool.VAO, ObjectGL::NormalLocation );
+   }
+   if (textures_exist) {
+      const GLuint offset = (normals_exist ? 6 : 3) * sizeof( GLfloat );
+      glVertexArrayAttribFormat( pool.VAO, ObjectGL::TextureLocation, 2, GL_FLOAT, GL_FALSE, offset );
+      glVertexArrayAttribBinding( pool.VAO, ObjectGL::TextureLocation, 0 );
+      glEnableVertexArrayAttrib( pool.VAO, ObjectGL::TextureLocation );
+   }
+}
+
+void GeometryArenaGL::growVertexPool(bool normals_exist, bool textures_exist, size_t required_vertex_num)
+{
+   VertexPool& pool = VertexPools[getLayoutIndex( normals_exist, textures_exist )];
+   const GLsizei stride = getVertexStride( normals_exist, textures_exist );
+   const size_t capacity = pool.Allocator.getCapacity();
+   const size_t new_capacity = std::max( capacity * 2, capacity + required_vertex_num );
+   pool.Buffer = createBuffer(
+      static_cast<GLsizeiptr>(stride) * new_capacity, pool.Buffer, static_cast<GLsizeiptr>(stride) * capacity
+   );
+   pool.Allocator.grow( new_capacity );
+   glVertexArrayVertexBuffer( pool.VAO, 0, pool.Buffer, 0, stride );
+   glVertexArrayVertexBuffer( pool.PositionVAO, 0, pool.Buffer, 0, stride );
+}
+
+void GeometryArenaGL::growIndexBuffer(size_t required_index_num)
+{
+   const size_t capacity = IndexAllocator.getCapacity();
+   const size_t new_capacity = capacity == 0 ?
+      std::max( InitialIndexNum, required_index_num ) : std::max( capacity * 2, capacity + required_index_num );
+   IndexBuffer = createBuffer(
+      static_cast<GLsizeiptr>(sizeof( GLuint ) * new_capacity),
+      IndexBuffer,
+      static_cast<GLsizeiptr>(sizeof( GLuint ) * capacity)
+   );
+   IndexAllocator.grow( new_capacity );
+   for (const auto& pool : VertexPools) {
+      if (pool.Buffer == 0) continue;
+      glVertexArrayElementBuffer( pool.VAO, IndexBuffer );
+      glVertexArrayElementBuffer( pool.PositionVAO, IndexBuffer );
+   }
+}
+
+GeometryArenaGL::VertexAllocation GeometryArenaGL::allocateVertices(
+   bool normals_exist,
+   bool textures_exist,
+   size_t vertex_num
+)
+{
+   VertexPool& pool = VertexPools[getLayoutIndex( normals_exist, textures_exist )];
+   if (pool.Buffer == 0) createVertexPool( normals_exist, textures_exist );
+
+   VertexAllocation allocation;
+   allocation.NormalsExist = normals_exist;
+   allocation.TexturesExist = textures_exist;
+   // The allocator fails on an empty range, which must not be taken for a full pool.
+   if (vertex_num == 0) return allocation;
+
+   allocation.Range = pool.Allocator.allocate( vertex_num );
+   if (!allocation.Range.isValid()) {
+      growVertexPool( normals_exist, textures_exist, vertex_num );
+      allocation.Range = pool.Allocator.allocate( vertex_num );
+   }
+   return allocation;
+}
+
+TLSFAllocator::Allocation GeometryArenaGL::allocateIndices(size_t index_num)
+{
+   if (index_num == 0) return {};
+
+   TLSFAllocator::Allocation allocation = IndexAllocator.allocate( index_num );
+   if (!allocation.isValid()) {
+      growIndexBuffer( index_num );
+      allocation = IndexAllocator.allocate( index_num );
+   }
+   return allocation;
+}
+
+void GeometryArenaGL::freeVertices(const VertexAllocation& allocation)
+{
+   if (!allocation.Range.isValid()) return;
+
+   VertexPools[getLayoutIndex( allocation.NormalsExist, allocation.TexturesExist )].Allocator.free( allocation.Range );
+}
+
+void GeometryArenaGL::freeIndices(const TLSFAllocator::Allocation& allocation)
+{
+   IndexAllocator.free( allocation );
+}
@@ -0,0 +1,579 @@
+#include "gltf_loader.h"
+#include "mapped_file.h"
+#include "mesh_processor.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+const GLTFLoader::JSON* GLTFLoader::JSON::find(const char* key) const
+{
+   for (const auto& member : Members) {
+      if (member.first == key) return &member.second;
+   }
+   return nullptr;
+}
+
+int GLTFLoader::JSON::getInt(const char* key, int default_value) const
+{
+   const JSON* value = find( key );
+   if (value == nullptr || value->Type != Number) return default_value;
+
+   // Converting a double out of the int range is undefined, so such values are clamped and fail later checks.
+   const double clamped = std::clamp(
+      value->NumberValue,
+      static_cast<double>(std::numeric_limits<int>::lowest()),
+      static_cast<double>(std::numeric_limits<int>::max())
+   );
+   return static_cast<int>(clamped);
+}
+
+float GLTFLoader::JSON::getFloat(const char* key, float default_value) const
+{
+   const JSON* value = find( key );
+   return value != nullptr && value->Type == Number ? static_cast<float>(value->NumberValue) : default_value;
+}
+
+std::string GLTFLoader::JSON::getString(const char* key) const
+{
+   const JSON* value = find( key );
+   return value != nullptr && value->Type == String ? value->StringValue : std::string();
+}
+
+void GLTFLoader::skipWhitespace(const char*& ptr, const char* end)
+{
+   while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\n' || *ptr == '\r')) ++ptr;
+}
+
+bool GLTFLoader::parseJSONString(const char*& ptr, const char* end, std::string& value)
+{
+   if (ptr >= end || *ptr != '"') return false;
+
+   value.clear();
+   for (++ptr; ptr < end && *ptr != '"'; ++ptr) {
+      if (*ptr != '\\') {
+         value.push_back( *ptr );
+         continue;
+      }
+      if (++ptr >= end) return false;
+      switch (*ptr) {
+         case 'b': value.push_back( '\b' ); break;
+         case 'f': value.push_back( '\f' ); break;
+         case 'n': value.push_back( '\n' ); break;
+         case 'r': value.push_back( '\r' ); break;
+         case 't': value.push_back( '\t' ); break;
+         case 'u': {
+            if (end - ptr < 5) return false;
+            const uint code = static_cast<uint>(std::strtoul( std::string(ptr + 1, 4).c_str(), nullptr, 16 ));
+            ptr += 4;
+            if (code < 0x80) value.push_back( static_cast<char>(code) );
+            else if (code < 0x800) {
+               value.push_back( static_cast<char>(0xC0 | (code >> 6)) );
+               value.push_back( static_cast<char>(0x80 | (code & 0x3F)) );
+            }
+            else {
+               value.push_back( static_cast<char>(0xE0 | (code >> 12)) );
+               value.push_back( static_cast<char>(0x80 | ((code >> 6) & 0x3F)) );
+               value.push_back( static_cast<char>(0x80 | (code & 0x3F)) );
+            }
+         } break;
+         default: value.push_back( *ptr );
+      }
+   }
+   if (ptr >= end) return false;
+   ++ptr;
+   return true;
+}
+
+bool GLTFLoader::parseJSON(const char*& ptr, const char* end, JSON& value, int depth)
+{
+   constexpr int max_depth = 256;
+   if (depth > max_depth) return false;
+
+   skipWhitespace( ptr, end );
+   if (ptr >= end) return false;
+
+   if (*ptr == '{') {
+      value.Type = JSON::Object;
+      ++ptr;
+      skipWhitespace( ptr, end );
+      if (ptr < end && *ptr == '}') {
+         ++ptr;
+         return true;
+      }
+      while (true) {
+         std::string key;
+         skipWhitespace( ptr, end );
+         if (!parseJSONString( ptr, end, key )) return false;
+         skipWhitespace( ptr, end );
+         if (ptr >= end || *ptr != ':') return false;
+         ++ptr;
+         value.Members.emplace_back( std::move( key ), JSON() );
+         if (!parseJSON( ptr, end, value.Members.back().second, depth + 1 )) return false;
+         skipWhitespace( ptr, end );
+         if (ptr >= end) return false;
+         if (*ptr == '}') {
+            ++ptr;
+            return true;
+         }
+         if (*ptr != ',') return false;
+         ++ptr;
+      }
+   }
+   if (*ptr == '[') {
+      value.Type = JSON::Array;
+      ++ptr;
+      skipWhitespace( ptr, end );
+      if (ptr < end && *ptr == ']') {
+         ++ptr;
+         return true;
+      }
+      while (true) {
+         value.Elements.emplace_back();
+         if (!parseJSON( ptr, end, value.Elements.back(), depth + 1 )) return false;
+         skipWhitespace( ptr, end );
+         if (ptr >= end) return false;
+         if (*ptr == ']') {
+            ++ptr;
+            return true;
+         }
+         if (*ptr != ',') return false;
+         ++ptr;
+      }
+   }
+   if (*ptr == '"') {
+      value.Type = JSON::String;
+      return parseJSONString( ptr, end, value.StringValue );
+   }
+   if (end - ptr >= 4 && std::strncmp( ptr, "true", 4 ) == 0) {
+      value.Type = JSON::Boolean;
+      value.BooleanValue = true;
+      ptr += 4;
+      return true;
+   }
+   if (end - ptr >= 5 && std::strncmp( ptr, "false", 5 ) == 0) {
+      value.Type = JSON::Boolean;
+      ptr += 5;
+      return true;
+   }
+   if (end - ptr >= 4 && std::strncmp( ptr, "null", 4 ) == 0) {
+      ptr += 4;
+      return true;
+   }
+
+   // The chunk is not null-terminated, so the number is copied out before strtod reads it.
+   char number[64];
+   size_t length = 0;
+   while (ptr < end && length < sizeof( number ) - 1 && std::strchr( "+-.0123456789eE", *ptr ) != nullptr) {
+      number[length++] = *ptr++;
+   }
+   if (length == 0) return false;
+   number[length] = '\0';
+   value.Type = JSON::Number;
+   value.NumberValue = std::strtod( number, nullptr );
+   return true;
+}
+
+const GLTFLoader::JSON* GLTFLoader::getBufferView(const JSON& document, int buffer_view_index)
+{
+   const JSON* buffer_views = document.find( "bufferViews" );
+   if (buffer_views == nullptr || buffer_view_index < 0) return nullptr;
+   return buffer_views->at( static_cast<size_t>(buffer_view_index) );
+}
+
+const uint8_t* GLTFLoader::getBufferViewData(
+   const JSON& buffer_view,
+   const BinaryChunk& binary,
+   size_t byte_offset,
+   size_t byte_size
+)
+{
+   // Only the binary chunk of the .glb file itself is supported as a buffer.
+   if (buffer_view.getInt( "buffer", 0 ) != 0 || binary.Data == nullptr) return nullptr;
+
+   const int view_offset = buffer_view.getInt( "byteOffset", 0 );
+   const int view_length = buffer_view.getInt( "byteLength", 0 );
+   if (view_offset < 0 || view_length < 0) return nullptr;
+
+   // Every range is checked by subtraction from its limit, so that no sum can wrap around.
+   const auto offset = static_cast<size_t>(view_offset);
+   const auto length = static_cast<size_t>(view_length);
+   if (length > binary.Size || offset > binary.Size - length) return nullptr;
+   if (byte_size > length || byte_offset > length - byte_size) return nullptr;
+   return binary.Data + offset + byte_offset;
+}
+
+bool GLTFLoader::getAccessorStream(
+   const JSON& document,
+   const BinaryChunk& binary,
+   int accessor_index,
+   ObjectGL::LayoutLocation location,
+   ObjectGL::VertexStream& stream,
+   GLsizei& count
+)
+{
+   const JSON* accessors = document.find( "accessors" );
+   const JSON* accessor = accessors != nullptr && accessor_index >= 0 ?
+      accessors->at( static_cast<size_t>(accessor_index) ) : nullptr;
+   if (accessor == nullptr || accessor->find( "sparse" ) != nullptr) return false;
+
+   const JSON* buffer_view = getBufferView( document, accessor->getInt( "bufferView", -1 ) );
+   if (buffer_view == nullptr) return false;
+
+   const std::string type = accessor->getString( "type" );
+   GLint component_num;
+   if (type == "SCALAR") component_num = 1;
+   else if (type == "VEC2") component_num = 2;
+   else if (type == "VEC3") component_num = 3;
+   else if (type == "VEC4") component_num = 4;
+   else return false;
+
+   // glTF component types use the same values as the GL enums.
+   const auto component_type = static_cast<GLenum>(accessor->getInt( "componentType", 0 ));
+   const GLsizei component_size = ObjectGL::getComponentSize( component_type );
+   count = static_cast<GLsizei>(accessor->getInt( "count", 0 ));
+   if (component_size == 0 || count <= 0) return false;
+
+   // A zero stride means tightly packed elements; glTF limits any other stride to [element size, 252].
+   const GLsizei element_size = component_num * component_size;
+   const int byte_stride = buffer_view->getInt( "byteStride", 0 );
+   const int byte_offset = accessor->getInt( "byteOffset", 0 );
+   if (byte_offset < 0 || byte_stride < 0) return false;
+   if (byte_stride != 0 && (byte_stride < element_size || byte_stride > 252)) return false;
+
+   const GLsizei stride = byte_stride != 0 ? byte_stride : element_size;
+   const GLsizeiptr size = static_cast<GLsizeiptr>(stride) * (count - 1) + element_size;
+   const uint8_t* data = getBufferViewData(
+      *buffer_view, binary, static_cast<size_t>(byte_offset), static_cast<size_t>(size)
+   );
+   if (data == nullptr) return false;
+
+   const JSON* normalized = accessor->find( "normalized" );
+   stream.Location = location;
+   stream.ComponentNum = component_num;
+   stream.ComponentType = component_type;
+   stream.IsNormalized = normalized != nullptr && normalized->BooleanValue ? GL_TRUE : GL_FALSE;
+   stream.Stride = stride;
+   stream.Data = data;
+   stream.Size = size;
+   return true;
+}
+
+GLuint GLTFLoader::readIndex(const ObjectGL::VertexStream& indices, size_t i)
+{
+   if (indices.ComponentType == GL_UNSIGNED_BYTE) return indices.Data[i];
+   if (indices.ComponentType == GL_UNSIGNED_SHORT) {
+      uint16_t index;
+      std::memcpy( &index, indices.Data + i * sizeof( index ), sizeof( index ) );
+      return index;
+   }
+   GLuint index;
+   std::memcpy( &index, indices.Data + i * sizeof( index ), sizeof( index ) );
+   return index;
+}
+
+void GLTFLoader::generateStreams(
+   std::vector<ObjectGL::VertexStream>& streams,
+   GLsizei vertex_num,
+   const ObjectGL::VertexStream* indices,
+   GLsizei index_num,
+   GeneratedStreams& generated
+)
+{
+   const auto find_stream = [&streams](ObjectGL::LayoutLocation location, GLint component_num) {
+      const auto it = std::find_if(
+         streams.begin(), streams.end(),
+         [location](const ObjectGL::VertexStream& stream) { return stream.Location == location; }
+      );
+      return it != streams.end() && it->ComponentType == GL_FLOAT && it->ComponentNum == component_num &&
+         it->IsNormalized == GL_FALSE ? &*it : nullptr;
+   };
+   const auto read_stream = [vertex_num](const ObjectGL::VertexStream& stream, auto& values) {
+      values.resize( static_cast<size_t>(vertex_num) );
+      for (size_t i = 0; i < values.size(); ++i) {
+         std::memcpy( &values[i], stream.Data + static_cast<size_t>(stream.Stride) * i, sizeof( values[i] ) );
+      }
+   };
+
+   const ObjectGL::VertexStream* position_stream = find_stream( ObjectGL::VertexLocation, 3 );
+   const ObjectGL::VertexStream* normal_stream = find_stream( ObjectGL::NormalLocation, 3 );
+   const ObjectGL::VertexStream* texture_stream = find_stream( ObjectGL::TextureLocation, 2 );
+   const bool has_normals = std::any_of(
+      streams.begin(), streams.end(),
+      [](const ObjectGL::VertexStream& stream) { return stream.Location == ObjectGL::NormalLocation; }
+   );
+   const bool has_tangents = std::any_of(
+      streams.begin(), streams.end(),
+      [](const ObjectGL::VertexStream& stream) { return stream.Location == ObjectGL::TangentLocation; }
+   );
+   const bool needs_tangents = !has_tangents && texture_stream != nullptr && (!has_normals || normal_stream != nullptr);
+   if (position_stream == nullptr || (has_normals && !needs_tangents)) return;
+
+   std::vector<GLuint> triangle_indices;
+   if (indices == nullptr) {
+      triangle_indices.resize( static_cast<size_t>(vertex_num) );
+      for (size_t i = 0; i < triangle_indices.size(); ++i) triangle_indices[i] = static_cast<GLuint>(i);
+   }
+   else {
+      triangle_indices.resize( static_cast<size_t>(index_num) );
+      // The loader has already checked that every index is in range.
+      for (size_t i = 0; i < triangle_indices.size(); ++i) triangle_indices[i] = readIndex( *indices, i );
+   }
+   triangle_indices.resize( triangle_indices.size() / 3 * 3 );
+
+   std::vector<glm::vec3> positions;
+   read_stream( *position_stream, positions );
+   if (has_normals) read_stream( *normal_stream, generated.Normals );
+   else {
+      generated.Normals = MeshProcessor::getNormals(
+         positions.data(), positions.size(), triangle_indices.data(), triangle_indices.size()
+      );
+      streams.push_back(
+         {
+            ObjectGL::NormalLocation, 3, GL_FLOAT, GL_FALSE, static_cast<GLsizei>(sizeof( glm::vec3 )),
+            reinterpret_cast<const uint8_t*>(generated.Normals.data()),
+            static_cast<GLsizeiptr>(generated.Normals.size() * sizeof( glm::vec3 ))
+         }
+      );
+   }
+   if (!needs_tangents) return;
+
+   std::vector<glm::vec2> textures;
+   read_stream( *texture_stream, textures );
+   generated.Tangents = MeshProcessor::getTangents(
+      positions.data(), generated.Normals.data(), textures.data(), positions.size(),
+      triangle_indices.data(), triangle_indices.size()
+   );
+   streams.push_back(
+      {
+         ObjectGL::TangentLocation, 4, GL_FLOAT, GL_FALSE, static_cast<GLsizei>(sizeof( glm::vec4 )),
+         reinterpret_cast<const uint8_t*>(generated.Tangents.data()),
+         static_cast<GLsizeiptr>(generated.Tangents.size() * sizeof( glm::vec4 ))
+      }
+   );
+}
+
+std::vector<GLTFLoader::Image> GLTFLoader::decodeImages(const JSON& document, const BinaryChunk& binary)
+{
+   const JSON* images = document.find( "images" );
+   if (images == nullptr) return {};
+
+   std::vector<Image> decoded(images->Elements.size());
+   ThreadPool::getInstance().parallelFor(
+      decoded.size(), 1,
+      [&](size_t begin, size_t end) {
+         for (size_t i = begin; i < end; ++i) {
+            // Images referenced by URI instead of a buffer view are not supported.
+            const JSON* buffer_view = getBufferView( document, images->Elements[i].getInt( "bufferView", -1 ) );
+            if (buffer_view == nullptr) continue;
+
+            const auto byte_length = static_cast<size_t>(buffer_view->getInt( "byteLength", 0 ));
+            const uint8_t* data = getBufferViewData( *buffer_view, binary, 0, byte_length );
+            if (data == nullptr) continue;
+
+            FIMEMORY* memory = FreeImage_OpenMemory( const_cast<BYTE*>(data), static_cast<DWORD>(byte_length) );
+            const FREE_IMAGE_FORMAT format = FreeImage_GetFileTypeFromMemory( memory, 0 );
+            FIBITMAP* bitmap = format != FIF_UNKNOWN ? FreeImage_LoadFromMemory( format, memory ) : nullptr;
+            FreeImage_CloseMemory( memory );
+            if (bitmap == nullptr) continue;
+
+            FIBITMAP* converted = FreeImage_ConvertTo32Bits( bitmap );
+            FreeImage_Unload( bitmap );
+            if (converted == nullptr) continue;
+
+            // glTF puts the texture origin at the top-left, while FreeImage stores the bottom row first.
+            FreeImage_FlipVertical( converted );
+            Image& result = decoded[i];
+            result.Width = static_cast<int>(FreeImage_GetWidth( converted ));
+            result.Height = static_cast<int>(FreeImage_GetHeight( converted ));
+            result.Pixels.resize( static_cast<size_t>(result.Width) * result.Height * 4 );
+            for (int y = 0; y < result.Height; ++y) {
+               const BYTE* row = FreeImage_GetScanLine( converted, y );
+               uint8_t* pixel = result.Pixels.data() + static_cast<size_t>(y) * result.Width * 4;
+               for (int x = 0; x < result.Width; ++x, row += 4, pixel += 4) {
+                  pixel[0] = row[FI_RGBA_RED];
+                  pixel[1] = row[FI_RGBA_GREEN];
+                  pixel[2] = row[FI_RGBA_BLUE];
+                  pixel[3] = row[FI_RGBA_ALPHA];
+               }
+            }
+            FreeImage_Unload( converted );
+         }
+      }
+   );
+   return decoded;
+}
+
+void GLTFLoader::setMaterial(ObjectGL& object, const JSON& document, int material_index, const std::vector<Image>& images)
+{
+   const JSON* materials = document.find( "materials" );
+   const JSON* material = materials != nullptr ? materials->at( static_cast<size_t>(material_index) ) : nullptr;
+   if (material == nullptr || material_index < 0) return;
+
+   glm::vec4 base_color(1.0f);
+   float metallic = 1.0f;
+   float roughness = 1.0f;
+   int texture_index = -1;
+   if (const JSON* pbr = material->find( "pbrMetallicRoughness" )) {
+      if (const JSON* factor = pbr->find( "baseColorFactor" )) {
+         for (int i = 0; i < 4 && i < static_cast<int>(factor->Elements.size()); ++i) {
+            base_color[i] = static_cast<float>(factor->Elements[i].NumberValue);
+         }
+      }
+      metallic = pbr->getFloat( "metallicFactor", 1.0f );
+      roughness = pbr->getFloat( "roughnessFactor", 1.0f );
+      if (const JSON* texture = pbr->find( "baseColorTexture" )) texture_index = texture->getInt( "index", -1 );
+   }
+   glm::vec4 emission(0.0f, 0.0f, 0.0f, 1.0f);
+   if (const JSON* factor = material->find( "emissiveFactor" )) {
+      for (int i = 0; i < 3 && i < static_cast<int>(factor->Elements.size()); ++i) {
+         emission[i] = static_cast<float>(factor->Elements[i].NumberValue);
+      }
+   }
+
+   // The metallic-roughness model is approximated with the Blinn-Phong terms the scene shader has.
+   const float roughness4 = std::max( roughness * roughness * roughness * roughness, 1e-4f );
+   object.setEmissionColor( emission );
+   object.setAmbientReflectionColor( base_color );
+   object.setDiffuseReflectionColor( base_color );
+   object.setSpecularReflectionColor( glm::vec4(glm::mix( glm::vec3(0.04f), glm::vec3(base_color), metallic ), 1.0f) );
+   object.setSpecularReflectionExponent( glm::clamp( 2.0f / roughness4 - 2.0f, 1.0f, 256.0f ) );
+
+   const JSON* textures = document.find( "textures" );
+   const JSON* texture = textures != nullptr ? textures->at( static_cast<size_t>(texture_index) ) : nullptr;
+   if (texture == nullptr || texture_index < 0) return;
+
+   const int source = texture->getInt( "source", -1 );
+   if (source < 0 || source >= static_cast<int>(images.size()) || images[source].Pixels.empty()) return;
+   object.addTexture( images[source].Pixels.data(), images[source].Width, images[source].Height );
+}
+
+bool GLTFLoader::load(std::vector<std::unique_ptr<ObjectGL>>& objects, const std::string& file_path)
+{
+   constexpr uint32_t glb_magic = 0x46546C67;
+   constexpr uint32_t json_chunk_type = 0x4E4F534A;
+   constexpr uint32_t binary_chunk_type = 0x004E4942;
+
+   MappedFile file;
+   if (!file.open( file_path )) {
+      std::cerr << "Could not open glTF file " << file_path.c_str() << "\n";
+      return false;
+   }
+
+   const uint8_t* data = file.getData();
+   const size_t size = file.getSize();
+   const auto read_u32 = [data](size_t offset) {
+      uint32_t value;
+      std::memcpy( &value, data + offset, sizeof( value ) );
+      return value;
+   };
+   if (size < 20 || read_u32( 0 ) != glb_magic || read_u32( 4 ) != 2 || read_u32( 16 ) != json_chunk_type) {
+      std::cerr << file_path.c_str() << " is not a glTF 2.0 binary file\n";
+      return false;
+   }
+
+   const size_t json_size = read_u32( 12 );
+   if (20 + json_size > size) return false;
+   const auto* json_begin = reinterpret_cast<const char*>(data + 20);
+   const char* json_end = json_begin + json_size;
+   JSON document;
+   if (!parseJSON( json_begin, json_end, document ) || document.Type != JSON::Object) {
+      std::cerr << "Could not parse the JSON chunk of " << file_path.c_str() << "\n";
+      return false;
+   }
+
+   BinaryChunk binary;
+   const size_t binary_header = 20 + ((json_size + 3) & ~size_t(3));
+   if (binary_header + 8 <= size && read_u32( binary_header + 4 ) == binary_chunk_type) {
+      binary.Data = data + binary_header + 8;
+      binary.Size = std::min( static_cast<size_t>(read_u32( binary_header )), size - binary_header - 8 );
+   }
+
+   const std::vector<Image> images = decodeImages( document, binary );
+
+   // Node transforms are not applied; each primitive is created in its mesh space.
+   const JSON* meshes = document.find( "meshes" );
+   if (meshes == nullptr) return true;
+
+   for (const auto& mesh : meshes->Elements) {
+      const JSON* primitives = mesh.find( "primitives" );
+      if (primitives == nullptr) continue;
+
+      for (const auto& primitive : primitives->Elements) {
+         const JSON* attributes = primitive.find( "attributes" );
+         if (attributes == nullptr) continue;
+
+         std::vector<ObjectGL::VertexStream> streams;
+         GLsizei vertex_num = 0;
+         GLsizei min_attribute_num = std::numeric_limits<GLsizei>::max();
+         const std::pair<const char*, ObjectGL::LayoutLocation> semantics[] = {
+            { "POSITION", ObjectGL::VertexLocation },
+            { "NORMAL", ObjectGL::NormalLocation },
+            { "TEXCOORD_0", ObjectGL::TextureLocation },
+            { "TANGENT", ObjectGL::TangentLocation }
+         };
+         for (const auto& semantic : semantics) {
+            const int accessor_index = attributes->getInt( semantic.first, -1 );
+            if (accessor_index < 0) continue;
+
+            ObjectGL::VertexStream stream{};
+            GLsizei count = 0;
+            if (!getAccessorStream( document, binary, accessor_index, semantic.second, stream, count )) {
+               std::cerr << "Unsupported " << semantic.first << " accessor in " << file_path.c_str() << "\n";
+               continue;
+            }
+            if (semantic.second == ObjectGL::VertexLocation) vertex_num = count;
+            min_attribute_num = std::min( min_attribute_num, count );
+            streams.emplace_back( stream );
+         }
+         if (vertex_num == 0) continue;
+         // Every vertex is fetched from every stream, so a shorter attribute would be read past its end.
+         if (min_attribute_num < vertex_num) {
+            std::cerr << "An attribute accessor has fewer elements than POSITION in " << file_path.c_str() << "\n";
+            continue;
+         }
+
+         ObjectGL::VertexStream indices{};
+         GLsizei index_num = 0;
+         const int indices_accessor = primitive.getInt( "indices", -1 );
+         if (indices_accessor >= 0 &&
+             (!getAccessorStream( document, binary, indices_accessor, ObjectGL::VertexLocation, indices, index_num ) ||
+              indices.ComponentNum != 1 || indices.Stride != ObjectGL::getComponentSize( indices.ComponentType ) ||
+              (indices.ComponentType != GL_UNSIGNED_BYTE && indices.ComponentType != GL_UNSIGNED_SHORT &&
+               indices.ComponentType != GL_UNSIGNED_INT))) {
+            std::cerr << "Unsupported index accessor in " << file_path.c_str() << "\n";
+            continue;
+         }
+         // Indices are checked for every draw mode, so the GPU never fetches a vertex that does not exist.
+         bool indices_in_range = true;
+         for (size_t i = 0; i < static_cast<size_t>(index_num) && indices_in_range; ++i) {
+            indices_in_range = readIndex( indices, i ) < static_cast<GLuint>(vertex_num);
+         }
+         if (!indices_in_range) {
+            std::cerr << "An index is out of the vertex range in " << file_path.c_str() << "\n";
+            continue;
+         }
+
+         // glTF primitive modes 0 to 6 use the same values as GL_POINTS to GL_TRIANGLE_FAN.
+         const int mode = primitive.getInt( "mode", GL_TRIANGLES );
+         if (mode < GL_POINTS || mode > GL_TRIANGLE_FAN) {
+            std::cerr << "Unsupported primitive mode in " << file_path.c_str() << "\n";
+            continue;
+         }
+         const auto draw_mode = static_cast<GLenum>(mode);
+         GeneratedStreams generated;
+         if (draw_mode == GL_TRIANGLES) {
+            generateStreams( streams, vertex_num, index_num > 0 ? &indices : nullptr, index_num, generated );
+         }
+
+         auto object = std::make_unique<ObjectGL>();
+         object->setObject( draw_mode, vertex_num, streams );
+         if (index_num > 0) object->setIndexBuffer( indices.ComponentType, index_num, indices.Data );
+
+         setMaterial( *object, document, primitive.getInt( "material", -1 ), images );
+         objects.emplace_back( std::move( object ) );
+      }
+   }
+   return true;
+}
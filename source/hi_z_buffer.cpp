@@ -0,0 +1,66 @@
+#include "hi_z_buffer.h"
+
+#include <algorithm>
+#include <cmath>
+
+HiZBufferGL::HiZBufferGL() :
+   Width( 0 ), Height( 0 ), LevelNum( 0 ), Framebuffer( 0 ), ColorTexture( 0 ), DepthTexture( 0 ), Pyramid( 0 )
+{
+}
+
+HiZBufferGL::~HiZBufferGL()
+{
+   release();
+}
+
+void HiZBufferGL::release()
+{
+   if (Framebuffer != 0) glDeleteFramebuffers( 1, &Framebuffer );
+   if (ColorTexture != 0) glDeleteTextures( 1, &ColorTexture );
+   if (DepthTexture != 0) glDeleteTextures( 1, &DepthTexture );
+   if (Pyramid != 0) glDeleteTextures( 1, &Pyramid );
+   Framebuffer = 0;
+   ColorTexture = 0;
+   DepthTexture = 0;
+   Pyramid = 0;
+   LevelNum = 0;
+}
+
+void HiZBufferGL::setSize(int width, int height)
+{
+   assert( width > 0 && height > 0 );
+
+   if (Framebuffer != 0 && width == Width && height == Height) return;
+
+   release();
+   Width = width;
+   Height = height;
+   LevelNum = static_cast<int>(std::log2( static_cast<float>(std::max( width, height )) )) + 1;
+
+   glCreateTextures( GL_TEXTURE_2D, 1, &ColorTexture );
+   glTextureStorage2D( ColorTexture, 1, GL_RGBA8, width, height );
+   // The depth is read texel by texel, and a single level is only complete without mipmap filtering.
+   glCreateTextures( GL_TEXTURE_2D, 1, &DepthTexture );
+   glTextureStorage2D( DepthTexture, 1, GL_DEPTH_COMPONENT32F, width, height );
+   glTextureParameteri( DepthTexture, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+   glTextureParameteri( DepthTexture, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+   glCreateTextures( GL_TEXTURE_2D, 1, &Pyramid );
+   glTextureStorage2D( Pyramid, LevelNum, GL_R32F, width, height );
+   glTextureParameteri( Pyramid, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST );
+   glTextureParameteri( Pyramid, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+   glTextureParameteri( Pyramid, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+   glTextureParameteri( Pyramid, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+
+   glCreateFramebuffers( 1, &Framebuffer );
+   glNamedFramebufferTexture( Framebuffer, GL_COLOR_ATTACHMENT0, ColorTexture, 0 );
+   glNamedFramebufferTexture( Framebuffer, GL_DEPTH_ATTACHMENT, DepthTexture, 0 );
+   if (glCheckNamedFramebufferStatus( Framebuffer, GL_FRAMEBUFFER ) != GL_FRAMEBUFFER_COMPLETE) {
+      std::cerr << "Could not complete the Hi-Z framebuffer\n";
+      release();
+   }
+}
+
+void HiZBufferGL::blitToScreen() const
+{
+   glBlitNamedFramebuffer( Framebuffer, 0, 0, 0, Width, Height, 0, 0, Width, Height, GL_COLOR_BUFFER_BIT, GL_NEAREST );
+}
@@ -0,0 +1,89 @@
+#include "indirect_batcher.h"
+
+#include <algorithm>
+
+IndirectBatcherGL::IndirectBatcherGL() :
+   CommandNum( 0 ), CommandBuffer( 0 ), CommandBufferSize( 0 ), InstanceBuffer( 0 ), InstanceBufferSize( 0 )
+{
+}
+
+IndirectBatcherGL::~IndirectBatcherGL()
+{
+   if (CommandBuffer != 0) glDeleteBuffers( 1, &CommandBuffer );
+   if (InstanceBuffer != 0) glDeleteBuffers( 1, &InstanceBuffer );
+}
+
+void IndirectBatcherGL::clear()
+{
+   // The buckets and their command lists are kept, so that a frame like the last one does not allocate.
+   for (auto& bucket : Buckets) bucket.CommandNum = 0;
+   for (auto& commands : BucketCommands) commands.clear();
+   Instances.clear();
+   CommandNum = 0;
+}
+
+void IndirectBatcherGL::add(
+   const ObjectGL& object,
+   GLuint texture_id,
+   const ObjectGL::Instance* instances,
+   GLsizei instance_num
+)
+{
+   assert( object.isIndexed() );
+
+   if (instance_num <= 0) return;
+
+   const BucketKey key{ object.getVAO(), object.getDrawMode(), object.getIndexType(), texture_id };
+   auto it = BucketIndices.find( key );
+   if (it == BucketIndices.end()) {
+      it = BucketIndices.emplace( key, Buckets.size() ).first;
+      Buckets.push_back( { object.getVAO(), object.getDrawMode(), object.getIndexType(), texture_id, 0, 0 } );
+      BucketCommands.emplace_back();
+   }
+
+   std::vector<ObjectGL::DrawElementsIndirectCommand>& commands = BucketCommands[it->second];
+   const auto first_instance = static_cast<GLuint>(Instances.size());
+   const auto index_num = static_cast<GLuint>(object.getIndexNum());
+   if (!commands.empty()) {
+      ObjectGL::DrawElementsIndirectCommand& last = commands.back();
+      if (last.Count == index_num && last.FirstIndex == object.getFirstIndex() &&
+          last.BaseVertex == object.getBaseVertex() && last.BaseInstance + last.InstanceCount == first_instance) {
+         last.InstanceCount += static_cast<GLuint>(instance_num);
+         Instances.insert( Instances.end(), instances, instances + instance_num );
+         return;
+      }
+   }
+   commands.push_back(
+      { index_num, static_cast<GLuint>(instance_num), object.getFirstIndex(), object.getBaseVertex(), first_instance }
+   );
+   Instances.insert( Instances.end(), instances, instances + instance_num );
+}
+
+void IndirectBatcherGL::reserveBuffer(GLuint& buffer, GLsizeiptr& buffer_size, GLsizeiptr size)
+{
+   if (size <= buffer_size) return;
+
+   while (buffer_size < size) buffer_size = std::max( buffer_size * 2, GLsizeiptr{ 4096 } );
+   if (buffer != 0) glDeleteBuffers( 1, &buffer );
+   glCreateBuffers( 1, &buffer );
+   glNamedBufferStorage( buffer, buffer_size, nullptr, GL_DYNAMIC_STORAGE_BIT );
+}
+
+void IndirectBatcherGL::build()
+{
+   Commands.clear();
+   for (size_t i = 0; i < Buckets.size(); ++i) {
+      Buckets[i].CommandOffset = static_cast<GLsizei>(Commands.size());
+      Buckets[i].CommandNum = static_cast<GLsizei>(BucketCommands[i].size());
+      Commands.insert( Commands.end(), BucketCommands[i].begin(), BucketCommands[i].end() );
+   }
+   CommandNum = Commands.size();
+   if (Commands.empty()) return;
+
+   const auto command_size = static_cast<GLsizeiptr>(sizeof( ObjectGL::DrawElementsIndirectCommand ) * Commands.size());
+   const auto instance_size = static_cast<GLsizeiptr>(sizeof( ObjectGL::Instance ) * Instances.size());
+   reserveBuffer( CommandBuffer, CommandBufferSize, command_size );
+   reserveBuffer( InstanceBuffer, InstanceBufferSize, instance_size );
+   glNamedBufferSubData( CommandBuffer, 0, command_size, Commands.data() );
+   glNamedBufferSubData( InstanceBuffer, 0, instance_size, Instances.data() );
+}
@@ -0,0 +1,320 @@
+#include "mesh_cache.h"
+#include "mapped_file.h"
+#include "mesh_simplifier.h"
+#include "obj_loader.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+uint64_t MeshCache::hashBytes(const uint8_t* data, size_t size, uint64_t hash)
+{
+   // FNV-1a
+   for (size_t i = 0; i < size; ++i) {
+      hash ^= data[i];
+      hash *= 0x100000001B3ull;
+   }
+   return hash;
+}
+
+uint64_t MeshCache::getHash(const uint8_t* data, size_t size)
+{
+   // Fixed-size blocks are hashed in parallel, and then their hashes are hashed in order.
+   constexpr size_t block_size = 1 << 20;
+   const size_t block_num = (size + block_size - 1) / block_size;
+   std::vector<uint64_t> block_hashes(block_num);
+   ThreadPool::getInstance().parallelFor(
+      block_num, 1,
+      [&](size_t begin, size_t end) {
+         for (size_t i = begin; i < end; ++i) {
+            const size_t offset = i * block_size;
+            block_hashes[i] = hashBytes( data + offset, std::min( block_size, size - offset ) );
+         }
+      }
+   );
+
+   uint64_t hash = hashBytes( reinterpret_cast<const uint8_t*>(&size), sizeof( size ) );
+   for (const auto& block_hash : block_hashes) {
+      hash = hashBytes( reinterpret_cast<const uint8_t*>(&block_hash), sizeof( block_hash ), hash );
+   }
+   return hash;
+}
+
+const MeshCache::Header* MeshCache::getValidHeader(const uint8_t* data, size_t size, uint64_t source_hash)
+{
+   if (size < sizeof( Header )) return nullptr;
+
+   const auto* info = reinterpret_cast<const Header*>(data);
+   if (info->Magic != CacheMagic || info->Version != CacheVersion || info->SourceHash != source_hash) return nullptr;
+   if (info->AttributeNum == 0 || info->AttributeNum > 3) return nullptr;
+
+   // The layout has to be the interleaved one of ObjectGL: a position, then an optional normal and texture.
+   uint32_t offset = 0;
+   for (uint32_t i = 0; i < info->AttributeNum; ++i) {
+      const AttributeDescriptor& attribute = info->Attributes[i];
+      const uint32_t component_num = attribute.Location == ObjectGL::TextureLocation ? 2 : 3;
+      if (attribute.Location < i || attribute.Location > ObjectGL::TextureLocation) return nullptr;
+      if (i == 0 && attribute.Location != ObjectGL::VertexLocation) return nullptr;
+      if (attribute.ComponentNum != component_num || attribute.ComponentType != GL_FLOAT) return nullptr;
+      if (attribute.Offset != offset) return nullptr;
+      offset += component_num * sizeof( GLfloat );
+   }
+   if (info->VertexStride != offset) return nullptr;
+
+   const auto index_size = static_cast<uint64_t>(ObjectGL::getComponentSize( info->IndexType ));
+   // The writer always stores an index type, even without indices, so an unknown one means a corrupt file.
+   if (index_size == 0) return nullptr;
+   if (info->VertexDataSize != static_cast<uint64_t>(info->VertexStride) * info->VertexNum) return nullptr;
+   if (info->IndexDataSize != index_size * info->IndexNum) return nullptr;
+   if (info->VertexDataOffset % sizeof( GLfloat ) != 0 || info->IndexDataOffset % index_size != 0) return nullptr;
+   if (info->VertexDataOffset < sizeof( Header ) || info->VertexDataOffset > size) return nullptr;
+   if (info->VertexDataSize > size - info->VertexDataOffset) return nullptr;
+   if (info->IndexDataOffset < sizeof( Header ) || info->IndexDataOffset > size) return nullptr;
+   if (info->IndexDataSize > size - info->IndexDataOffset) return nullptr;
+   if (info->LODNum > MaxLODNum) return nullptr;
+   for (uint32_t i = 0; i < info->LODNum; ++i) {
+      if (static_cast<uint64_t>(info->LODs[i].FirstIndex) + info->LODs[i].IndexNum > info->IndexNum) return nullptr;
+   }
+   return info;
+}
+
+void MeshCache::weldVertices(
+   Mesh& mesh,
+   std::vector<GLuint>& indices,
+   const std::vector<GLfloat>& corners,
+   size_t corner_num,
+   size_t step
+)
+{
+   const size_t vertex_size = step * sizeof( GLfloat );
+   const auto* bytes = reinterpret_cast<const uint8_t*>(corners.data());
+   std::vector<uint64_t> keys(corner_num);
+   ThreadPool::getInstance().parallelFor(
+      corner_num, 1 << 14,
+      [&](size_t begin, size_t end) {
+         for (size_t i = begin; i < end; ++i) keys[i] = hashBytes( bytes + i * vertex_size, vertex_size );
+      }
+   );
+
+   // Bitwise equal corners end up next to each other, and the first corner of each run is the lowest one.
+   std::vector<uint32_t> order(corner_num);
+   std::iota( order.begin(), order.end(), 0u );
+   std::sort(
+      order.begin(), order.end(),
+      [&](uint32_t a, uint32_t b) {
+         if (keys[a] != keys[b]) return keys[a] < keys[b];
+         const int comparison = std::memcmp( bytes + a * vertex_size, bytes + b * vertex_size, vertex_size );
+         return comparison != 0 ? comparison < 0 : a < b;
+      }
+   );
+   std::vector<uint32_t> representatives(corner_num);
+   for (size_t i = 0; i < corner_num; ++i) {
+      const uint32_t corner = order[i];
+      const bool is_new = i == 0 || keys[order[i - 1]] != keys[corner] ||
+         std::memcmp( bytes + order[i - 1] * vertex_size, bytes + corner * vertex_size, vertex_size ) != 0;
+      representatives[corner] = is_new ? corner : representatives[order[i - 1]];
+   }
+
+   // Vertices are numbered in the order the triangles first use them, which keeps the vertex fetches local.
+   constexpr auto unassigned = std::numeric_limits<uint32_t>::max();
+   std::vector<uint32_t> remap(corner_num, unassigned);
+   indices.resize( corner_num );
+   mesh.Vertices.clear();
+   uint32_t vertex_num = 0;
+   for (size_t i = 0; i < corner_num; ++i) {
+      const uint32_t representative = representatives[i];
+      if (remap[representative] == unassigned) {
+         remap[representative] = vertex_num++;
+         const GLfloat* vertex = corners.data() + representative * step;
+         mesh.Vertices.insert( mesh.Vertices.end(), vertex, vertex + step );
+      }
+      indices[i] = remap[representative];
+   }
+
+   mesh.Info.VertexNum = vertex_num;
+}
+
+void MeshCache::setLODs(Mesh& mesh, std::vector<GLuint>& indices, size_t step)
+{
+   Header& info = mesh.Info;
+   const std::vector<ObjectGL::LOD> lods = MeshSimplifier::buildLODChain(
+      mesh.Vertices.data(), step, info.VertexNum, indices, MaxLODNum
+   );
+   info.LODNum = static_cast<uint32_t>(lods.size());
+   for (size_t i = 0; i < lods.size(); ++i) {
+      info.LODs[i] = {
+         static_cast<uint32_t>(lods[i].FirstIndex), static_cast<uint32_t>(lods[i].IndexNum), lods[i].Error
+      };
+   }
+
+   const size_t index_num = indices.size();
+   info.IndexNum = static_cast<uint32_t>(index_num);
+   if (info.VertexNum <= std::numeric_limits<uint16_t>::max()) {
+      info.IndexType = GL_UNSIGNED_SHORT;
+      mesh.Indices.resize( index_num * sizeof( uint16_t ) );
+      auto* destination = reinterpret_cast<uint16_t*>(mesh.Indices.data());
+      for (size_t i = 0; i < index_num; ++i) destination[i] = static_cast<uint16_t>(indices[i]);
+   }
+   else {
+      info.IndexType = GL_UNSIGNED_INT;
+      mesh.Indices.resize( index_num * sizeof( uint32_t ) );
+      std::memcpy( mesh.Indices.data(), indices.data(), mesh.Indices.size() );
+   }
+}
+
+void MeshCache::setBounds(Header& info, const std::vector<GLfloat>& vertices, size_t step)
+{
+   const BoundingVolume bounds = BoundingVolume::get( vertices.data(), step, vertices.size() / step );
+   for (int i = 0; i < 3; ++i) {
+      info.BoundsMin[i] = bounds.isEmpty() ? 0.0f : bounds.BoxMin[i];
+      info.BoundsMax[i] = bounds.isEmpty() ? 0.0f : bounds.BoxMax[i];
+      info.SphereCenter[i] = bounds.SphereCenter[i];
+   }
+   info.SphereRadius = bounds.SphereRadius;
+}
+
+bool MeshCache::build(Mesh& mesh, const std::string& file_path, uint64_t source_hash)
+{
+   std::vector<glm::vec3> vertices, normals;
+   std::vector<glm::vec2> textures;
+   if (!OBJLoader::load( file_path, vertices, normals, textures )) return false;
+
+   const size_t corner_num = vertices.size();
+   // The levels of detail take at most as many indices as the full mesh.
+   if (corner_num > std::numeric_limits<uint32_t>::max() / 2) {
+      std::cerr << "OBJ file " << file_path.c_str() << " has too many vertices to cache\n";
+      return false;
+   }
+
+   const glm::vec3* normal_data = normals.empty() ? nullptr : normals.data();
+   const glm::vec2* texture_data = textures.empty() ? nullptr : textures.data();
+   const size_t step = 3 + (normal_data != nullptr ? 3 : 0) + (texture_data != nullptr ? 2 : 0);
+   std::vector<GLfloat> corners(step * corner_num);
+   ThreadPool::getInstance().parallelFor(
+      corner_num, 1 << 16,
+      [&](size_t begin, size_t end) {
+         ObjectGL::packVertices(
+            corners.data(), vertices.data(), normal_data, texture_data, corner_num, begin, end
+         );
+      }
+   );
+
+   Header& info = mesh.Info;
+   info = Header{};
+   info.Magic = CacheMagic;
+   info.Version = CacheVersion;
+   info.SourceHash = source_hash;
+   info.DrawMode = GL_TRIANGLES;
+   info.VertexStride = static_cast<uint32_t>(step * sizeof( GLfloat ));
+   uint32_t offset = 0;
+   info.Attributes[info.AttributeNum++] = { ObjectGL::VertexLocation, 3, GL_FLOAT, offset };
+   offset += 3 * sizeof( GLfloat );
+   if (normal_data != nullptr) {
+      info.Attributes[info.AttributeNum++] = { ObjectGL::NormalLocation, 3, GL_FLOAT, offset };
+      offset += 3 * sizeof( GLfloat );
+   }
+   if (texture_data != nullptr) {
+      info.Attributes[info.AttributeNum++] = { ObjectGL::TextureLocation, 2, GL_FLOAT, offset };
+   }
+
+   std::vector<GLuint> indices;
+   weldVertices( mesh, indices, corners, corner_num, step );
+   corners.clear();
+   corners.shrink_to_fit();
+   setLODs( mesh, indices, step );
+   setBounds( info, mesh.Vertices, step );
+
+   info.VertexDataOffset = BlockAlignment;
+   info.VertexDataSize = sizeof( GLfloat ) * mesh.Vertices.size();
+   info.IndexDataOffset =
+      (info.VertexDataOffset + info.VertexDataSize + BlockAlignment - 1) / BlockAlignment * BlockAlignment;
+   info.IndexDataSize = mesh.Indices.size();
+   return true;
+}
+
+bool MeshCache::write(const std::string& cache_path, const Mesh& mesh)
+{
+   // The cache is written next to its final path and renamed, so a reader never maps a partial file.
+   const std::string temporary_path = cache_path + ".tmp";
+   std::ofstream file(temporary_path, std::ios::binary | std::ios::trunc);
+   if (!file.is_open()) return false;
+
+   const std::vector<char> zeros(BlockAlignment, 0);
+   uint64_t written = 0;
+   const auto write_block = [&](const void* data, uint64_t offset, uint64_t size) {
+      file.write( zeros.data(), static_cast<std::streamsize>(offset - written) );
+      file.write( static_cast<const char*>(data), static_cast<std::streamsize>(size) );
+      written = offset + size;
+   };
+   write_block( &mesh.Info, 0, sizeof( Header ) );
+   write_block( mesh.Vertices.data(), mesh.Info.VertexDataOffset, mesh.Info.VertexDataSize );
+   write_block( mesh.Indices.data(), mesh.Info.IndexDataOffset, mesh.Info.IndexDataSize );
+   file.close();
+   if (!file) {
+      std::remove( temporary_path.c_str() );
+      return false;
+   }
+
+   std::remove( cache_path.c_str() );
+   return std::rename( temporary_path.c_str(), cache_path.c_str() ) == 0;
+}
+
+void MeshCache::upload(ObjectGL& object, const Header& info, const GLfloat* vertices, const void* indices)
+{
+   bool normals_exist = false, textures_exist = false;
+   for (uint32_t i = 0; i < info.AttributeNum; ++i) {
+      if (info.Attributes[i].Location == ObjectGL::NormalLocation) normals_exist = true;
+      else if (info.Attributes[i].Location == ObjectGL::TextureLocation) textures_exist = true;
+   }
+   object.setPackedObject(
+      info.DrawMode, static_cast<GLsizei>(info.VertexNum), vertices, normals_exist, textures_exist
+   );
+   if (info.IndexNum > 0) object.setIndexBuffer( info.IndexType, static_cast<GLsizei>(info.IndexNum), indices );
+   if (info.LODNum > 1) {
+      std::vector<ObjectGL::LOD> lods;
+      for (uint32_t i = 0; i < info.LODNum; ++i) {
+         const LODDescriptor& lod = info.LODs[i];
+         lods.push_back(
+            { static_cast<GLsizei>(lod.FirstIndex), static_cast<GLsizei>(lod.IndexNum), lod.Error }
+         );
+      }
+      object.setLODs( lods );
+   }
+}
+
+bool MeshCache::load(ObjectGL& object, const std::string& file_path, const std::string& cache_path)
+{
+   uint64_t source_hash;
+   {
+      MappedFile source;
+      if (!source.open( file_path )) {
+         std::cerr << "Could not open mesh file " << file_path.c_str() << "\n";
+         return false;
+      }
+      source_hash = getHash( source.getData(), source.getSize() );
+   }
+
+   const std::string path = cache_path.empty() ? file_path + ".meshcache" : cache_path;
+   MappedFile cache;
+   if (cache.open( path )) {
+      const Header* info = getValidHeader( cache.getData(), cache.getSize(), source_hash );
+      if (info != nullptr) {
+         upload(
+            object, *info,
+            reinterpret_cast<const GLfloat*>(cache.getData() + info->VertexDataOffset),
+            cache.getData() + info->IndexDataOffset
+         );
+         return true;
+      }
+      cache.close();
+   }
+
+   Mesh mesh;
+   if (!build( mesh, file_path, source_hash )) return false;
+   if (!write( path, mesh )) std::cerr << "Could not write the mesh cache " << path.c_str() << "\n";
+   upload( object, mesh.Info, mesh.Vertices.data(), mesh.Indices.data() );
+   return true;
+}
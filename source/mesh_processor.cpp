@@ -0,0 +1,156 @@
+#include "mesh_processor.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+
+MeshProcessor::VertexCorners MeshProcessor::getVertexCorners(size_t vertex_num, const GLuint* indices, size_t index_num)
+{
+   VertexCorners table;
+   table.CornerRanges.assign( vertex_num + 1, 0 );
+   table.Corners.resize( index_num );
+   for (size_t i = 0; i < index_num; ++i) ++table.CornerRanges[indices[i] + 1];
+   for (size_t v = 0; v < vertex_num; ++v) table.CornerRanges[v + 1] += table.CornerRanges[v];
+
+   std::vector<GLuint> next(table.CornerRanges.begin(), table.CornerRanges.end() - 1);
+   for (size_t i = 0; i < index_num; ++i) table.Corners[next[indices[i]]++] = static_cast<GLuint>(i);
+   return table;
+}
+
+glm::vec3 MeshProcessor::getCornerAngles(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2)
+{
+   const auto get_angle = [](const glm::vec3& a, const glm::vec3& b) {
+      const float length = std::sqrt( glm::dot( a, a ) * glm::dot( b, b ) );
+      if (length <= 0.0f) return 0.0f;
+      return std::acos( std::clamp( glm::dot( a, b ) / length, -1.0f, 1.0f ) );
+   };
+   const glm::vec3 e01 = p1 - p0;
+   const glm::vec3 e12 = p2 - p1;
+   const glm::vec3 e20 = p0 - p2;
+   return { get_angle( e01, -e20 ), get_angle( e12, -e01 ), get_angle( e20, -e12 ) };
+}
+
+std::vector<glm::vec3> MeshProcessor::getNormals(
+   const glm::vec3* positions,
+   size_t vertex_num,
+   const GLuint* indices,
+   size_t index_num
+)
+{
+   assert( index_num % 3 == 0 );
+
+   const size_t triangle_num = index_num / 3;
+   std::vector<glm::vec3> contributions(index_num);
+   ThreadPool& pool = ThreadPool::getInstance();
+   pool.parallelFor(
+      triangle_num, 1 << 14,
+      [&](size_t begin, size_t end) {
+         for (size_t t = begin; t < end; ++t) {
+            const GLuint* triangle = indices + 3 * t;
+            const glm::vec3& p0 = positions[triangle[0]];
+            const glm::vec3& p1 = positions[triangle[1]];
+            const glm::vec3& p2 = positions[triangle[2]];
+            const glm::vec3 normal = glm::cross( p1 - p0, p2 - p0 );
+            const float length = glm::length( normal );
+            if (length <= 0.0f) {
+               contributions[3 * t] = contributions[3 * t + 1] = contributions[3 * t + 2] = glm::vec3(0.0f);
+               continue;
+            }
+            const glm::vec3 angles = getCornerAngles( p0, p1, p2 );
+            for (int c = 0; c < 3; ++c) contributions[3 * t + c] = normal * (angles[c] / length);
+         }
+      }
+   );
+
+   const VertexCorners table = getVertexCorners( vertex_num, indices, index_num );
+   std::vector<glm::vec3> normals(vertex_num);
+   pool.parallelFor(
+      vertex_num, 1 << 14,
+      [&](size_t begin, size_t end) {
+         for (size_t v = begin; v < end; ++v) {
+            glm::vec3 sum(0.0f);
+            for (GLuint i = table.CornerRanges[v]; i < table.CornerRanges[v + 1]; ++i) {
+               sum += contributions[table.Corners[i]];
+            }
+            const float length = glm::length( sum );
+            normals[v] = length > 0.0f ? sum / length : glm::vec3(0.0f, 0.0f, 1.0f);
+         }
+      }
+   );
+   return normals;
+}
+
+std::vector<glm::vec4> MeshProcessor::getTangents(
+   const glm::vec3* positions,
+   const glm::vec3* normals,
+   const glm::vec2* textures,
+   size_t vertex_num,
+   const GLuint* indices,
+   size_t index_num
+)
+{
+   assert( index_num % 3 == 0 );
+
+   // Each corner keeps the projected tangent and bitangent of its triangle, both already weighted by its angle.
+   const size_t triangle_num = index_num / 3;
+   std::vector<glm::vec3> corner_tangents(index_num), corner_bitangents(index_num);
+   ThreadPool& pool = ThreadPool::getInstance();
+   pool.parallelFor(
+      triangle_num, 1 << 14,
+      [&](size_t begin, size_t end) {
+         for (size_t t = begin; t < end; ++t) {
+            const GLuint* triangle = indices + 3 * t;
+            const glm::vec3& p0 = positions[triangle[0]];
+            const glm::vec3 e1 = positions[triangle[1]] - p0;
+            const glm::vec3 e2 = positions[triangle[2]] - p0;
+            const glm::vec2 d1 = textures[triangle[1]] - textures[triangle[0]];
+            const glm::vec2 d2 = textures[triangle[2]] - textures[triangle[0]];
+            // The sign of the texture area orients the derivatives; its magnitude cancels in the normalization.
+            const float orientation = d1.x * d2.y - d2.x * d1.y >= 0.0f ? 1.0f : -1.0f;
+            const glm::vec3 tangent = (e1 * d2.y - e2 * d1.y) * orientation;
+            const glm::vec3 bitangent = (e2 * d1.x - e1 * d2.x) * orientation;
+            const glm::vec3 angles = getCornerAngles( p0, positions[triangle[1]], positions[triangle[2]] );
+            for (int c = 0; c < 3; ++c) {
+               const glm::vec3& n = normals[triangle[c]];
+               const glm::vec3 projected_tangent = tangent - n * glm::dot( n, tangent );
+               const glm::vec3 projected_bitangent = bitangent - n * glm::dot( n, bitangent );
+               const float tangent_length = glm::length( projected_tangent );
+               const float bitangent_length = glm::length( projected_bitangent );
+               corner_tangents[3 * t + c] =
+                  tangent_length > 0.0f ? projected_tangent * (angles[c] / tangent_length) : glm::vec3(0.0f);
+               corner_bitangents[3 * t + c] =
+                  bitangent_length > 0.0f ? projected_bitangent * (angles[c] / bitangent_length) : glm::vec3(0.0f);
+            }
+         }
+      }
+   );
+
+   const VertexCorners table = getVertexCorners( vertex_num, indices, index_num );
+   std::vector<glm::vec4> tangents(vertex_num);
+   pool.parallelFor(
+      vertex_num, 1 << 14,
+      [&](size_t begin, size_t end) {
+         for (size_t v = begin; v < end; ++v) {
+            glm::vec3 tangent(0.0f), bitangent(0.0f);
+            for (GLuint i = table.CornerRanges[v]; i < table.CornerRanges[v + 1]; ++i) {
+               tangent += corner_tangents[table.Corners[i]];
+               bitangent += corner_bitangents[table.Corners[i]];
+            }
+
+            // Without any usable texture derivative, any direction in the tangent plane will do.
+            const glm::vec3& n = normals[v];
+            tangent -= n * glm::dot( n, tangent );
+            float length = glm::length( tangent );
+            if (length <= 0.0f) {
+               tangent = std::abs( n.x ) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+               tangent -= n * glm::dot( n, tangent );
+               length = glm::length( tangent );
+            }
+            tangent /= length;
+            const float handedness = glm::dot( glm::cross( n, tangent ), bitangent ) < 0.0f ? -1.0f : 1.0f;
+            tangents[v] = glm::vec4(tangent, handedness);
+         }
+      }
+   );
+   return tangents;
+}
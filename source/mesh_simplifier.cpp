@@ -0,0 +1,295 @@
+#include "mesh_simplifier.h"
+#include "thread_pool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+MeshSimplifier::Quadric& MeshSimplifier::Quadric::operator+=(const Quadric& q)
+{
+   A00 += q.A00; A01 += q.A01; A02 += q.A02; A03 += q.A03;
+   A11 += q.A11; A12 += q.A12; A13 += q.A13;
+   A22 += q.A22; A23 += q.A23;
+   A33 += q.A33;
+   Weight += q.Weight;
+   return *this;
+}
+
+double MeshSimplifier::Quadric::evaluate(const glm::dvec3& p) const
+{
+   const double x = p.x, y = p.y, z = p.z;
+   const double cost =
+      A00 * x * x + 2.0 * A01 * x * y + 2.0 * A02 * x * z + 2.0 * A03 * x +
+      A11 * y * y + 2.0 * A12 * y * z + 2.0 * A13 * y +
+      A22 * z * z + 2.0 * A23 * z +
+      A33;
+   return std::max( cost, 0.0 );
+}
+
+MeshSimplifier::Quadric MeshSimplifier::getPlaneQuadric(
+   const glm::dvec3& p0,
+   const glm::dvec3& p1,
+   const glm::dvec3& p2
+)
+{
+   // The plane is weighted by the triangle area, so small triangles do not dominate the error.
+   const glm::dvec3 cross = glm::cross( p1 - p0, p2 - p0 );
+   const double length = glm::length( cross );
+   if (length <= 0.0) return {};
+
+   const glm::dvec3 n = cross / length;
+   const double d = -glm::dot( n, p0 );
+   const double w = length * 0.5;
+   return {
+      w * n.x * n.x, w * n.x * n.y, w * n.x * n.z, w * n.x * d,
+      w * n.y * n.y, w * n.y * n.z, w * n.y * d,
+      w * n.z * n.z, w * n.z * d,
+      w * d * d,
+      w
+   };
+}
+
+std::vector<GLuint> MeshSimplifier::getPositionIDs(const GLfloat* positions, size_t stride, size_t vertex_num)
+{
+   // Vertices at the same position get the lowest index among them as their ID.
+   const auto compare = [&](GLuint a, GLuint b) {
+      const int comparison = std::memcmp( positions + stride * a, positions + stride * b, 3 * sizeof( GLfloat ) );
+      return comparison != 0 ? comparison < 0 : a < b;
+   };
+   std::vector<GLuint> order(vertex_num);
+   std::iota( order.begin(), order.end(), 0u );
+   std::sort( order.begin(), order.end(), compare );
+
+   std::vector<GLuint> ids(vertex_num);
+   for (size_t i = 0; i < vertex_num; ++i) {
+      const GLuint vertex = order[i];
+      const bool is_new = i == 0 ||
+         std::memcmp( positions + stride * order[i - 1], positions + stride * vertex, 3 * sizeof( GLfloat ) ) != 0;
+      ids[vertex] = is_new ? vertex : ids[order[i - 1]];
+   }
+   return ids;
+}
+
+std::vector<uint64_t> MeshSimplifier::getEdges(const std::vector<GLuint>& indices, const std::vector<GLuint>& ids)
+{
+   // Each triangle edge is keyed by its two IDs, the smaller one in the upper half.
+   std::vector<uint64_t> edges;
+   edges.reserve( indices.size() );
+   for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      for (size_t j = 0; j < 3; ++j) {
+         const GLuint a = ids[indices[i + j]];
+         const GLuint b = ids[indices[i + (j + 1) % 3]];
+         if (a == b) continue;
+         edges.emplace_back( static_cast<uint64_t>(std::min( a, b )) << 32 | std::max( a, b ) );
+      }
+   }
+   std::sort( edges.begin(), edges.end() );
+   return edges;
+}
+
+std::vector<uint8_t> MeshSimplifier::getLockedVertices(
+   const std::vector<GLuint>& position_ids,
+   const std::vector<GLuint>& indices
+)
+{
+   const size_t vertex_num = position_ids.size();
+   std::vector<uint8_t> locked_positions(vertex_num, 0);
+
+   // A position shared by several vertices lies on an attribute seam.
+   for (size_t i = 0; i < vertex_num; ++i) {
+      if (position_ids[i] != i) locked_positions[position_ids[i]] = 1;
+   }
+
+   // An edge used by one triangle is on a border, and an edge used by more than two is non-manifold.
+   const std::vector<uint64_t> edges = getEdges( indices, position_ids );
+   for (size_t i = 0; i < edges.size();) {
+      size_t j = i + 1;
+      while (j < edges.size() && edges[j] == edges[i]) ++j;
+      if (j - i != 2) {
+         locked_positions[edges[i] >> 32] = 1;
+         locked_positions[edges[i] & 0xFFFFFFFFu] = 1;
+      }
+      i = j;
+   }
+
+   std::vector<uint8_t> locked(vertex_num);
+   for (size_t i = 0; i < vertex_num; ++i) locked[i] = locked_positions[position_ids[i]];
+   return locked;
+}
+
+bool MeshSimplifier::flipsTriangle(
+   const GLfloat* positions,
+   size_t stride,
+   const std::vector<GLuint>& indices,
+   const GLuint* triangles,
+   size_t triangle_num,
+   const Collapse& collapse
+)
+{
+   const glm::dvec3 target = getPosition( positions, stride, collapse.To );
+   for (size_t i = 0; i < triangle_num; ++i) {
+      const GLuint* triangle = &indices[3 * static_cast<size_t>(triangles[i])];
+      if (triangle[0] == collapse.To || triangle[1] == collapse.To || triangle[2] == collapse.To) continue;
+
+      glm::dvec3 before[3], after[3];
+      for (int j = 0; j < 3; ++j) {
+         before[j] = getPosition( positions, stride, triangle[j] );
+         after[j] = triangle[j] == collapse.From ? target : before[j];
+      }
+      const glm::dvec3 normal_before = glm::cross( before[1] - before[0], before[2] - before[0] );
+      const glm::dvec3 normal_after = glm::cross( after[1] - after[0], after[2] - after[0] );
+      if (glm::dot( normal_before, normal_after ) <= 0.0) return true;
+   }
+   return false;
+}
+
+std::vector<GLuint> MeshSimplifier::simplify(
+   const GLfloat* positions,
+   size_t stride,
+   size_t vertex_num,
+   const std::vector<GLuint>& indices,
+   size_t target_index_num,
+   float& error
+)
+{
+   error = 0.0f;
+   std::vector<GLuint> result = indices;
+   if (result.size() <= target_index_num || vertex_num == 0) return result;
+
+   const std::vector<GLuint> position_ids = getPositionIDs( positions, stride, vertex_num );
+   const std::vector<uint8_t> locked = getLockedVertices( position_ids, result );
+   std::vector<Quadric> quadrics(vertex_num, Quadric{});
+   for (size_t i = 0; i + 2 < result.size(); i += 3) {
+      const Quadric plane = getPlaneQuadric(
+         getPosition( positions, stride, result[i] ),
+         getPosition( positions, stride, result[i + 1] ),
+         getPosition( positions, stride, result[i + 2] )
+      );
+      for (size_t j = 0; j < 3; ++j) quadrics[result[i + j]] += plane;
+   }
+
+   // Collapses are done in passes: each pass sorts every edge by its cost and collapses the cheapest ones whose
+   // neighborhoods do not overlap, so the flip tests of a pass stay valid.
+   std::vector<GLuint> identity(vertex_num);
+   std::iota( identity.begin(), identity.end(), 0u );
+   std::vector<uint32_t> first_triangles(vertex_num + 1);
+   std::vector<GLuint> adjacent_triangles;
+   std::vector<uint8_t> touched(vertex_num);
+   double max_cost = 0.0;
+   while (result.size() > target_index_num) {
+      std::vector<uint64_t> edges = getEdges( result, identity );
+      edges.erase( std::unique( edges.begin(), edges.end() ), edges.end() );
+
+      std::vector<Collapse> collapses(edges.size());
+      ThreadPool::getInstance().parallelFor(
+         edges.size(), 1 << 12,
+         [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+               const auto a = static_cast<GLuint>(edges[i] >> 32);
+               const auto b = static_cast<GLuint>(edges[i] & 0xFFFFFFFFu);
+               Quadric q = quadrics[a];
+               q += quadrics[b];
+               const double scale = q.Weight > 0.0 ? 1.0 / q.Weight : 0.0;
+               Collapse& collapse = collapses[i];
+               collapse = { a, b, std::numeric_limits<double>::max() };
+               if (!locked[a]) collapse.Cost = q.evaluate( getPosition( positions, stride, b ) ) * scale;
+               if (!locked[b]) {
+                  const double cost = q.evaluate( getPosition( positions, stride, a ) ) * scale;
+                  if (cost < collapse.Cost) collapse = { b, a, cost };
+               }
+            }
+         }
+      );
+      collapses.erase(
+         std::remove_if(
+            collapses.begin(), collapses.end(),
+            [](const Collapse& c) { return c.Cost == std::numeric_limits<double>::max(); }
+         ),
+         collapses.end()
+      );
+      std::sort(
+         collapses.begin(), collapses.end(),
+         [](const Collapse& a, const Collapse& b) { return a.Cost < b.Cost || (a.Cost == b.Cost && a.From < b.From); }
+      );
+
+      const size_t triangle_num = result.size() / 3;
+      std::fill( first_triangles.begin(), first_triangles.end(), 0u );
+      for (const auto& index : result) ++first_triangles[index + 1];
+      std::partial_sum( first_triangles.begin(), first_triangles.end(), first_triangles.begin() );
+      adjacent_triangles.resize( result.size() );
+      std::vector<uint32_t> fill_offsets(first_triangles.begin(), first_triangles.end() - 1);
+      for (size_t i = 0; i < result.size(); ++i) {
+         adjacent_triangles[fill_offsets[result[i]]++] = static_cast<GLuint>(i / 3);
+      }
+
+      // Each collapse of an interior edge removes two triangles.
+      const size_t triangles_to_remove = (result.size() - target_index_num + 2) / 3;
+      size_t removed_triangle_num = 0;
+      std::vector<GLuint> remap = identity;
+      std::fill( touched.begin(), touched.end(), 0 );
+      for (const auto& collapse : collapses) {
+         if (removed_triangle_num >= triangles_to_remove) break;
+         if (touched[collapse.From] || touched[collapse.To]) continue;
+
+         const GLuint* triangles = adjacent_triangles.data() + first_triangles[collapse.From];
+         const size_t adjacent_num = first_triangles[collapse.From + 1] - first_triangles[collapse.From];
+         if (flipsTriangle( positions, stride, result, triangles, adjacent_num, collapse )) continue;
+
+         remap[collapse.From] = collapse.To;
+         quadrics[collapse.To] += quadrics[collapse.From];
+         max_cost = std::max( max_cost, collapse.Cost );
+         for (size_t i = 0; i < adjacent_num; ++i) {
+            const GLuint* triangle = &result[3 * static_cast<size_t>(triangles[i])];
+            for (int j = 0; j < 3; ++j) {
+               touched[triangle[j]] = 1;
+               if (triangle[j] == collapse.To) ++removed_triangle_num;
+            }
+         }
+      }
+      if (removed_triangle_num == 0) break;
+
+      size_t kept = 0;
+      for (size_t i = 0; i < triangle_num; ++i) {
+         const GLuint a = remap[result[3 * i]], b = remap[result[3 * i + 1]], c = remap[result[3 * i + 2]];
+         if (a == b || b == c || c == a) continue;
+         result[kept++] = a;
+         result[kept++] = b;
+         result[kept++] = c;
+      }
+      result.resize( kept );
+   }
+   error = static_cast<float>(std::sqrt( max_cost ));
+   return result;
+}
+
+std::vector<ObjectGL::LOD> MeshSimplifier::buildLODChain(
+   const GLfloat* positions,
+   size_t stride,
+   size_t vertex_num,
+   std::vector<GLuint>& indices,
+   int max_lod_num,
+   float reduction
+)
+{
+   std::vector<ObjectGL::LOD> lods;
+   lods.push_back( { 0, static_cast<GLsizei>(indices.size()), 0.0f } );
+
+   // Each level is simplified from the previous one, so its error is bounded by the sum of the errors so far.
+   std::vector<GLuint> current = indices;
+   float error_sum = 0.0f;
+   for (int i = 1; i < max_lod_num; ++i) {
+      const size_t target_index_num = static_cast<size_t>(static_cast<float>(current.size()) * reduction) / 3 * 3;
+      if (target_index_num < 3) break;
+
+      float error = 0.0f;
+      std::vector<GLuint> next = simplify( positions, stride, vertex_num, current, target_index_num, error );
+      if (next.size() * 10 > current.size() * 9) break;
+
+      error_sum += error;
+      lods.push_back( { static_cast<GLsizei>(indices.size()), static_cast<GLsizei>(next.size()), error_sum } );
+      indices.insert( indices.end(), next.begin(), next.end() );
+      current = std::move( next );
+   }
+   return lods;
+}
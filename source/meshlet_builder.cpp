@@ -0,0 +1,155 @@
+#include "meshlet_builder.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+void MeshletBuilder::setBounds(
+   ObjectGL::Meshlet& meshlet,
+   const GLfloat* positions,
+   size_t stride,
+   const GLuint* triangles,
+   const std::vector<GLuint>& vertices
+)
+{
+   glm::vec3 min_point = getPosition( positions, stride, vertices[0] );
+   glm::vec3 max_point = min_point;
+   for (const auto& vertex : vertices) {
+      const glm::vec3 position = getPosition( positions, stride, vertex );
+      min_point = glm::min( min_point, position );
+      max_point = glm::max( max_point, position );
+   }
+   const glm::vec3 center = (min_point + max_point) * 0.5f;
+   float squared_radius = 0.0f;
+   for (const auto& vertex : vertices) {
+      const glm::vec3 offset = getPosition( positions, stride, vertex ) - center;
+      squared_radius = std::max( squared_radius, glm::dot( offset, offset ) );
+   }
+   meshlet.BoundingSphere = glm::vec4(center, std::sqrt( squared_radius ));
+
+   // The cone axis is the average triangle normal, and the cutoff is the sine of the widest angle to it.
+   // A cutoff of 1 never culls, which is kept when the normals spread over a hemisphere or more.
+   std::vector<glm::vec3> normals;
+   glm::vec3 axis(0.0f);
+   for (GLuint i = 0; i < meshlet.IndexNum; i += 3) {
+      const glm::vec3 p0 = getPosition( positions, stride, triangles[i] );
+      const glm::vec3 p1 = getPosition( positions, stride, triangles[i + 1] );
+      const glm::vec3 p2 = getPosition( positions, stride, triangles[i + 2] );
+      const glm::vec3 normal = glm::cross( p1 - p0, p2 - p0 );
+      const float length = glm::length( normal );
+      if (length <= 0.0f) continue;
+
+      normals.emplace_back( normal / length );
+      axis += normals.back();
+   }
+   meshlet.NormalCone = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+   const float axis_length = glm::length( axis );
+   if (axis_length <= std::numeric_limits<float>::epsilon()) return;
+
+   axis /= axis_length;
+   float min_dot = 1.0f;
+   for (const auto& normal : normals) min_dot = std::min( min_dot, glm::dot( axis, normal ) );
+   if (min_dot <= 0.0f) return;
+
+   meshlet.NormalCone = glm::vec4(axis, std::sqrt( 1.0f - min_dot * min_dot ));
+}
+
+std::vector<ObjectGL::Meshlet> MeshletBuilder::build(
+   const GLfloat* positions,
+   size_t stride,
+   size_t vertex_num,
+   GLuint* indices,
+   size_t index_num,
+   GLuint first_index
+)
+{
+   assert( std::all_of( indices, indices + index_num, [vertex_num](GLuint index) { return index < vertex_num; } ) );
+
+   const size_t triangle_num = index_num / 3;
+   std::vector<uint32_t> first_triangles(vertex_num + 1, 0);
+   for (size_t i = 0; i < triangle_num * 3; ++i) ++first_triangles[indices[i] + 1];
+   std::partial_sum( first_triangles.begin(), first_triangles.end(), first_triangles.begin() );
+   std::vector<uint32_t> adjacent_triangles(triangle_num * 3);
+   std::vector<uint32_t> fill_offsets(first_triangles.begin(), first_triangles.end() - 1);
+   for (size_t i = 0; i < triangle_num * 3; ++i) {
+      adjacent_triangles[fill_offsets[indices[i]]++] = static_cast<uint32_t>(i / 3);
+   }
+
+   constexpr auto none = std::numeric_limits<uint32_t>::max();
+   std::vector<uint32_t> live_triangle_nums(vertex_num);
+   for (size_t i = 0; i < vertex_num; ++i) live_triangle_nums[i] = first_triangles[i + 1] - first_triangles[i];
+   std::vector<uint8_t> emitted(triangle_num, 0);
+   std::vector<uint32_t> vertex_meshlets(vertex_num, none);
+
+   std::vector<ObjectGL::Meshlet> meshlets;
+   std::vector<GLuint> reordered;
+   reordered.reserve( triangle_num * 3 );
+   std::vector<GLuint> meshlet_vertices;
+   size_t meshlet_triangle_num = 0;
+   const auto get_new_vertex_num = [&](uint32_t triangle) {
+      const GLuint* t = indices + 3 * static_cast<size_t>(triangle);
+      const auto id = static_cast<uint32_t>(meshlets.size());
+      return static_cast<size_t>(vertex_meshlets[t[0]] != id) +
+         static_cast<size_t>(vertex_meshlets[t[1]] != id && t[1] != t[0]) +
+         static_cast<size_t>(vertex_meshlets[t[2]] != id && t[2] != t[0] && t[2] != t[1]);
+   };
+   const auto flush = [&]() {
+      if (meshlet_triangle_num == 0) return;
+
+      ObjectGL::Meshlet meshlet{};
+      meshlet.IndexNum = static_cast<GLuint>(3 * meshlet_triangle_num);
+      meshlet.FirstIndex = first_index + static_cast<GLuint>(reordered.size() - meshlet.IndexNum);
+      setBounds( meshlet, positions, stride, reordered.data() + (reordered.size() - meshlet.IndexNum), meshlet_vertices );
+      meshlets.emplace_back( meshlet );
+      meshlet_vertices.clear();
+      meshlet_triangle_num = 0;
+   };
+
+   // Each meshlet grows by the triangle that adds the fewest new vertices among those touching it. When none
+   // is left, it continues from the first triangle not emitted yet, which keeps the original order as the fallback.
+   size_t cursor = 0;
+   while (true) {
+      uint32_t best = none;
+      size_t best_new_vertex_num = 4;
+      for (const auto& vertex : meshlet_vertices) {
+         if (live_triangle_nums[vertex] == 0) continue;
+         for (uint32_t i = first_triangles[vertex]; i < first_triangles[vertex + 1]; ++i) {
+            const uint32_t triangle = adjacent_triangles[i];
+            if (emitted[triangle]) continue;
+
+            const size_t new_vertex_num = get_new_vertex_num( triangle );
+            if (new_vertex_num < best_new_vertex_num || (new_vertex_num == best_new_vertex_num && triangle < best)) {
+               best = triangle;
+               best_new_vertex_num = new_vertex_num;
+            }
+         }
+      }
+      if (best == none) {
+         while (cursor < triangle_num && emitted[cursor]) ++cursor;
+         if (cursor == triangle_num) break;
+         best = static_cast<uint32_t>(cursor);
+         best_new_vertex_num = get_new_vertex_num( best );
+      }
+      if (meshlet_vertices.size() + best_new_vertex_num > MaxVertexNum || meshlet_triangle_num == MaxTriangleNum) {
+         flush();
+      }
+
+      const GLuint* triangle = indices + 3 * static_cast<size_t>(best);
+      const auto id = static_cast<uint32_t>(meshlets.size());
+      for (int i = 0; i < 3; ++i) {
+         const GLuint vertex = triangle[i];
+         --live_triangle_nums[vertex];
+         if (vertex_meshlets[vertex] != id) {
+            vertex_meshlets[vertex] = id;
+            meshlet_vertices.emplace_back( vertex );
+         }
+         reordered.emplace_back( vertex );
+      }
+      emitted[best] = 1;
+      ++meshlet_triangle_num;
+   }
+   flush();
+
+   std::copy( reordered.begin(), reordered.end(), indices );
+   return meshlets;
+}
@@ -0,0 +1,367 @@
+#include "obj_loader.h"
+#include "mapped_file.h"
+#include "mesh_processor.h"
+#include "thread_pool.h"
+
+#include <cstring>
+#include <cmath>
+
+void OBJLoader::skipBlanks(const char*& ptr, const char* end)
+{
+   while (ptr < end && isBlank( *ptr )) ++ptr;
+}
+
+const char* OBJLoader::findLineEnd(const char* ptr, const char* end)
+{
+   const auto* line_end = static_cast<const char*>(std::memchr( ptr, '\n', static_cast<size_t>(end - ptr) ));
+   return line_end != nullptr ? line_end : end;
+}
+
+float OBJLoader::parseFloat(const char*& ptr, const char* end)
+{
+   // Up to 19 significant digits are gathered in an integer and scaled once, which never allocates
+   // and is accurate well beyond float precision.
+   constexpr double powers_of_ten[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+   };
+   constexpr int max_digit_num = 19;
+
+   skipBlanks( ptr, end );
+   bool is_negative = false;
+   if (ptr < end && (*ptr == '-' || *ptr == '+')) {
+      is_negative = *ptr == '-';
+      ++ptr;
+   }
+
+   uint64_t digits = 0;
+   int digit_num = 0;
+   int exponent = 0;
+   for (; ptr < end && isDigit( *ptr ); ++ptr) {
+      if (digit_num < max_digit_num) {
+         digits = digits * 10 + static_cast<uint64_t>(*ptr - '0');
+         if (digits != 0) digit_num++;
+      }
+      else exponent++;
+   }
+   if (ptr < end && *ptr == '.') {
+      for (++ptr; ptr < end && isDigit( *ptr ); ++ptr) {
+         if (digit_num < max_digit_num) {
+            digits = digits * 10 + static_cast<uint64_t>(*ptr - '0');
+            if (digits != 0) digit_num++;
+            exponent--;
+         }
+      }
+   }
+   if (ptr < end && (*ptr == 'e' || *ptr == 'E')) {
+      ++ptr;
+      bool is_negative_exponent = false;
+      if (ptr < end && (*ptr == '-' || *ptr == '+')) {
+         is_negative_exponent = *ptr == '-';
+         ++ptr;
+      }
+      int value = 0;
+      for (; ptr < end && isDigit( *ptr ); ++ptr) {
+         if (value < 10000) value = value * 10 + (*ptr - '0');
+      }
+      exponent += is_negative_exponent ? -value : value;
+   }
+
+   auto result = static_cast<double>(digits);
+   if (exponent < 0) {
+      result = exponent >= -22 ? result / powers_of_ten[-exponent] : result * std::pow( 10.0, exponent );
+   }
+   else if (exponent > 0) {
+      result = exponent <= 22 ? result * powers_of_ten[exponent] : result * std::pow( 10.0, exponent );
+   }
+   return static_cast<float>(is_negative ? -result : result);
+}
+
+bool OBJLoader::parseIndex(const char*& ptr, const char* end, size_t defined_num, int& index)
+{
+   bool is_negative = false;
+   if (ptr < end && *ptr == '-') {
+      is_negative = true;
+      ++ptr;
+   }
+   if (ptr >= end || !isDigit( *ptr )) return false;
+
+   int64_t value = 0;
+   for (; ptr < end && isDigit( *ptr ); ++ptr) {
+      if (value <= std::numeric_limits<int>::max()) value = value * 10 + (*ptr - '0');
+   }
+   if (value == 0 || value > std::numeric_limits<int>::max()) return false;
+
+   // Negative indices count backwards from the last element defined before this face.
+   const int64_t resolved = is_negative ? static_cast<int64_t>(defined_num) - value : value - 1;
+   if (resolved < 0) return false;
+
+   index = static_cast<int>(resolved);
+   return true;
+}
+
+bool OBJLoader::parseCorner(const char*& ptr, const char* end, const size_t (&defined_num)[3], Corner& corner)
+{
+   corner = { -1, -1, -1 };
+   if (!parseIndex( ptr, end, defined_num[0], corner.Position )) return false;
+   if (ptr < end && *ptr == '/') {
+      ++ptr;
+      if (ptr < end && *ptr != '/') {
+         if (!parseIndex( ptr, end, defined_num[1], corner.Texture )) return false;
+      }
+      if (ptr < end && *ptr == '/') {
+         ++ptr;
+         if (!parseIndex( ptr, end, defined_num[2], corner.Normal )) return false;
+      }
+   }
+   return ptr >= end || isBlank( *ptr ) || *ptr == '#';
+}
+
+std::vector<OBJLoader::Chunk> OBJLoader::splitIntoChunks(const char* begin, const char* end)
+{
+   constexpr size_t min_chunk_size = 1 << 20;
+   const auto file_size = static_cast<size_t>(end - begin);
+   const size_t chunk_num = static_cast<size_t>(ThreadPool::getInstance().getThreadNum()) * 4;
+   const size_t chunk_size = std::max( min_chunk_size, file_size / chunk_num );
+
+   // Chunks always end right after a line break, so every line belongs to exactly one chunk.
+   std::vector<Chunk> chunks;
+   const char* chunk_begin = begin;
+   while (chunk_begin < end) {
+      const char* chunk_end = chunk_begin + std::min( chunk_size, static_cast<size_t>(end - chunk_begin) );
+      if (chunk_end < end) chunk_end = std::min( findLineEnd( chunk_end, end ) + 1, end );
+      chunks.emplace_back( chunk_begin, chunk_end );
+      chunk_begin = chunk_end;
+   }
+   return chunks;
+}
+
+void OBJLoader::countChunk(Chunk& chunk)
+{
+   const char* ptr = chunk.Begin;
+   while (ptr < chunk.End) {
+      const char* line_end = findLineEnd( ptr, chunk.End );
+      skipBlanks( ptr, line_end );
+      const auto length = line_end - ptr;
+      if (length >= 2 && ptr[0] == 'v') {
+         if (isBlank( ptr[1] )) chunk.PositionNum++;
+         else if (length >= 3 && ptr[1] == 't' && isBlank( ptr[2] )) chunk.TextureNum++;
+         else if (length >= 3 && ptr[1] == 'n' && isBlank( ptr[2] )) chunk.NormalNum++;
+      }
+      else if (length >= 2 && ptr[0] == 'f' && isBlank( ptr[1] )) {
+         size_t corner_num = 0;
+         ptr += 2;
+         while (true) {
+            skipBlanks( ptr, line_end );
+            // A trailing comment ends the corners.
+            if (ptr >= line_end || *ptr == '#') break;
+            corner_num++;
+            while (ptr < line_end && !isBlank( *ptr ) && *ptr != '#') ++ptr;
+         }
+         if (corner_num >= 3) chunk.TriangleNum += corner_num - 2;
+      }
+      ptr = line_end + 1;
+   }
+}
+
+void OBJLoader::parseChunk(Chunk& chunk, Attributes& attributes)
+{
+   size_t defined_num[3] = { chunk.PositionOffset, chunk.TextureOffset, chunk.NormalOffset };
+   Corner* corners = attributes.Corners.data() + chunk.TriangleOffset * 3;
+   const char* ptr = chunk.Begin;
+   while (ptr < chunk.End) {
+      const char* line_end = findLineEnd( ptr, chunk.End );
+      skipBlanks( ptr, line_end );
+      const auto length = line_end - ptr;
+      if (length >= 2 && ptr[0] == 'v') {
+         if (isBlank( ptr[1] )) {
+            ptr += 1;
+            glm::vec3& position = attributes.Positions[defined_num[0]++];
+            position.x = parseFloat( ptr, line_end );
+            position.y = parseFloat( ptr, line_end );
+            position.z = parseFloat( ptr, line_end );
+         }
+         else if (length >= 3 && ptr[1] == 't' && isBlank( ptr[2] )) {
+            ptr += 2;
+            glm::vec2& texture = attributes.Textures[defined_num[1]++];
+            texture.x = parseFloat( ptr, line_end );
+            texture.y = parseFloat( ptr, line_end );
+         }
+         else if (length >= 3 && ptr[1] == 'n' && isBlank( ptr[2] )) {
+            ptr += 2;
+            glm::vec3& normal = attributes.Normals[defined_num[2]++];
+            normal.x = parseFloat( ptr, line_end );
+            normal.y = parseFloat( ptr, line_end );
+            normal.z = parseFloat( ptr, line_end );
+         }
+      }
+      else if (length >= 2 && ptr[0] == 'f' && isBlank( ptr[1] )) {
+         // Polygons are triangulated as a fan around their first corner.
+         Corner first{}, previous{}, corner{};
+         int corner_num = 0;
+         ptr += 2;
+         while (true) {
+            skipBlanks( ptr, line_end );
+            if (ptr >= line_end || *ptr == '#') break;
+            if (!parseCorner( ptr, line_end, defined_num, corner )) {
+               chunk.IsValid = false;
+               return;
+            }
+            if (corner.Texture < 0) chunk.AllCornersHaveTexture = false;
+            if (corner.Normal < 0) chunk.AllCornersHaveNormal = false;
+
+            if (corner_num == 0) first = corner;
+            else if (corner_num >= 2) {
+               *corners++ = first;
+               *corners++ = previous;
+               *corners++ = corner;
+            }
+            previous = corner;
+            corner_num++;
+         }
+      }
+      ptr = line_end + 1;
+   }
+}
+
+bool OBJLoader::load(
+   const std::string& file_path,
+   std::vector<glm::vec3>& vertices,
+   std::vector<glm::vec3>& normals,
+   std::vector<glm::vec2>& textures
+)
+{
+   vertices.clear();
+   normals.clear();
+   textures.clear();
+
+   MappedFile file;
+   if (!file.open( file_path )) {
+      std::cerr << "Could not open OBJ file " << file_path.c_str() << "\n";
+      return false;
+   }
+
+   // The first pass only counts, so the second pass can write every chunk straight to its final place.
+   const auto* begin = reinterpret_cast<const char*>(file.getData());
+   std::vector<Chunk> chunks = splitIntoChunks( begin, begin + file.getSize() );
+   ThreadPool& pool = ThreadPool::getInstance();
+   pool.parallelFor(
+      chunks.size(), 1,
+      [&chunks](size_t chunk_begin, size_t chunk_end) {
+         for (size_t i = chunk_begin; i < chunk_end; ++i) countChunk( chunks[i] );
+      }
+   );
+
+   Chunk total(nullptr, nullptr);
+   for (auto& chunk : chunks) {
+      chunk.PositionOffset = total.PositionNum;
+      chunk.TextureOffset = total.TextureNum;
+      chunk.NormalOffset = total.NormalNum;
+      chunk.TriangleOffset = total.TriangleNum;
+      total.PositionNum += chunk.PositionNum;
+      total.TextureNum += chunk.TextureNum;
+      total.NormalNum += chunk.NormalNum;
+      total.TriangleNum += chunk.TriangleNum;
+   }
+   if (total.TriangleNum == 0) {
+      std::cerr << "OBJ file " << file_path.c_str() << " has no faces\n";
+      return false;
+   }
+
+   Attributes attributes;
+   attributes.Positions.resize( total.PositionNum );
+   attributes.Textures.resize( total.TextureNum );
+   attributes.Normals.resize( total.NormalNum );
+   attributes.Corners.resize( total.TriangleNum * 3 );
+   pool.parallelFor(
+      chunks.size(), 1,
+      [&chunks, &attributes](size_t chunk_begin, size_t chunk_end) {
+         for (size_t i = chunk_begin; i < chunk_end; ++i) parseChunk( chunks[i], attributes );
+      }
+   );
+
+   bool has_textures = total.TextureNum > 0;
+   bool has_normals = total.NormalNum > 0;
+   for (const auto& chunk : chunks) {
+      if (!chunk.IsValid) {
+         std::cerr << "OBJ file " << file_path.c_str() << " has a malformed face\n";
+         return false;
+      }
+      has_textures = has_textures && chunk.AllCornersHaveTexture;
+      has_normals = has_normals && chunk.AllCornersHaveNormal;
+   }
+
+   const size_t corner_num = attributes.Corners.size();
+   vertices.resize( corner_num );
+   if (has_normals) normals.resize( corner_num );
+   if (has_textures) textures.resize( corner_num );
+   std::atomic<bool> is_out_of_range(false);
+   pool.parallelFor(
+      corner_num, 1 << 16,
+      [&](size_t corner_begin, size_t corner_end) {
+         for (size_t i = corner_begin; i < corner_end; ++i) {
+            const Corner& corner = attributes.Corners[i];
+            if (static_cast<size_t>(corner.Position) >= total.PositionNum ||
+                (has_textures && static_cast<size_t>(corner.Texture) >= total.TextureNum) ||
+                (has_normals && static_cast<size_t>(corner.Normal) >= total.NormalNum)) {
+               is_out_of_range = true;
+               return;
+            }
+            vertices[i] = attributes.Positions[corner.Position];
+            if (has_normals) normals[i] = attributes.Normals[corner.Normal];
+            if (has_textures) textures[i] = attributes.Textures[corner.Texture];
+         }
+      }
+   );
+   if (is_out_of_range) {
+      std::cerr << "OBJ file " << file_path.c_str() << " references an undefined vertex\n";
+      vertices.clear();
+      normals.clear();
+      textures.clear();
+      return false;
+   }
+   if (!has_normals) generateNormals( attributes, normals );
+   return true;
+}
+
+void OBJLoader::generateNormals(const Attributes& attributes, std::vector<glm::vec3>& normals)
+{
+   // The corners of a position share its normal, so the surface is smooth across every face that uses it.
+   const size_t corner_num = attributes.Corners.size();
+   std::vector<GLuint> position_indices(corner_num);
+   ThreadPool& pool = ThreadPool::getInstance();
+   pool.parallelFor(
+      corner_num, 1 << 16,
+      [&](size_t corner_begin, size_t corner_end) {
+         for (size_t i = corner_begin; i < corner_end; ++i) {
+            position_indices[i] = static_cast<GLuint>(attributes.Corners[i].Position);
+         }
+      }
+   );
+   const std::vector<glm::vec3> position_normals = MeshProcessor::getNormals(
+      attributes.Positions.data(), attributes.Positions.size(), position_indices.data(), corner_num
+   );
+   normals.resize( corner_num );
+   pool.parallelFor(
+      corner_num, 1 << 16,
+      [&](size_t corner_begin, size_t corner_end) {
+         for (size_t i = corner_begin; i < corner_end; ++i) normals[i] = position_normals[position_indices[i]];
+      }
+   );
+}
+
+bool OBJLoader::load(ObjectGL& object, const std::string& file_path)
+{
+   std::vector<glm::vec3> vertices, normals;
+   std::vector<glm::vec2> textures;
+   if (!load( file_path, vertices, normals, textures )) return false;
+
+   object.setObject(
+      GL_TRIANGLES,
+      static_cast<GLsizei>(vertices.size()),
+      vertices.data(),
+      normals.empty() ? nullptr : normals.data(),
+      textures.empty() ? nullptr : textures.data()
+   );
+   return true;
+}
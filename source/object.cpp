@@ -1,7 +1,25 @@
 #include "object.h"
+#include "thread_pool.h"
+#include "meshlet_builder.h"
+
+#include <cstring>
+#include <algorithm>
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OBJECT_GL_USE_SSE
+#include <emmintrin.h>
+#endif
 
 ObjectGL::ObjectGL() :
-   ImageBuffer( nullptr ), VAO( 0 ), VBO( 0 ), DrawMode( 0 ), VerticesCount( 0 ),
+   CopyPolicy( DropCPUCopy ), Layout( Interleaved ), NormalsExist( false ), TexturesExist( false ), VAO( 0 ),
+   PositionVAO( 0 ), VBO( 0 ), IBO( 0 ), Arena( nullptr ),
+   VertexBufferOffset( 0 ), BaseVertex( 0 ), FirstIndex( 0 ), IndexType( GL_UNSIGNED_INT ), IndicesCount( 0 ), CurrentLOD( 0 ),
+   MeshletNum( 0 ),
+   MeshletBuffer( 0 ), MeshletCommandBuffer( 0 ), MeshletDrawCountBuffer( 0 ), BoneNum( 0 ), BindPoseBuffer( 0 ),
+   SkinWeightBuffer( 0 ), BoneBuffer( 0 ), MorphDeltaBuffer( 0 ), MorphRangeBuffer( 0 ),
+   InstanceNum( 0 ), InstanceBuffer( 0 ), InstanceMaterialNum( 0 ), InstanceMaterialBuffer( 0 ), DrawMode( 0 ),
+   VertexStride( 0 ), AllocatedVertexNum( 0 ), DynamicRegionNum( 0 ),
+   DynamicRegionIndex( 0 ), DynamicRegionSize( 0 ), DynamicBuffer( nullptr ), VerticesCount( 0 ),
+   FullUploadThreshold( 0.5f ),
    EmissionColor( 0.0f, 0.0f, 0.0f, 1.0f ),
    AmbientReflectionColor( 0.2f, 0.2f, 0.2f, 1.0f ),
    DiffuseReflectionColor( 0.8f, 0.8f, 0.8f, 1.0f ),
@@ -11,17 +29,172 @@ ObjectGL::ObjectGL() :
 
 ObjectGL::~ObjectGL()
 {
-   if (VAO != 0) {
-      glDeleteVertexArrays( 1, &VAO );
-      glDeleteBuffers( 1, &VBO );
-   }
+   releaseVertexBuffer();
+   releaseInstanceBuffers();
    for (const auto& texture_id : TextureID) {
       if (texture_id != 0) glDeleteTextures( 1, &texture_id );
    }
    for (const auto& buffer : CustomBuffers) {
       if (buffer.second != 0) glDeleteBuffers( 1, &buffer.second );
    }
-   delete [] ImageBuffer;
+}
+
+void ObjectGL::releaseVertexBuffer()
+{
+   for (const auto& fence : DynamicFences) {
+      if (fence != nullptr) glDeleteSync( fence );
+   }
+   DynamicFences.clear();
+   DynamicRegionNum = 0;
+   DynamicRegionIndex = 0;
+   DynamicRegionSize = 0;
+   DynamicBuffer = nullptr;
+   if (Arena != nullptr) {
+      // The VAOs belong to the arena, which takes the ranges back.
+      Arena->freeVertices( ArenaVertices );
+      Arena->freeIndices( ArenaIndices );
+      ArenaVertices = {};
+      ArenaIndices = {};
+      VAO = 0;
+      PositionVAO = 0;
+      VertexBufferOffset = 0;
+      BaseVertex = 0;
+      FirstIndex = 0;
+      IndicesCount = 0;
+   }
+   else if (VAO != 0) {
+      glDeleteVertexArrays( 1, &VAO );
+      glDeleteVertexArrays( 1, &PositionVAO );
+      glDeleteBuffers( 1, &VBO );
+      VAO = 0;
+      PositionVAO = 0;
+      VBO = 0;
+   }
+   if (IBO != 0) {
+      glDeleteBuffers( 1, &IBO );
+      IBO = 0;
+      IndicesCount = 0;
+   }
+   LODs.clear();
+   CurrentLOD = 0;
+   Bounds = {};
+   releaseMeshletBuffers();
+   releaseSkinBuffers();
+   releaseMorphBuffers();
+   releaseBindPoseBuffer();
+}
+
+void ObjectGL::releaseMeshletBuffers()
+{
+   if (MeshletBuffer != 0) {
+      glDeleteBuffers( 1, &MeshletBuffer );
+      glDeleteBuffers( 1, &MeshletCommandBuffer );
+      glDeleteBuffers( 1, &MeshletDrawCountBuffer );
+      MeshletBuffer = 0;
+      MeshletCommandBuffer = 0;
+      MeshletDrawCountBuffer = 0;
+   }
+   MeshletNum = 0;
+}
+
+void ObjectGL::createBindPoseBuffer()
+{
+   if (BindPoseBuffer != 0) return;
+
+   // The bind pose is copied on the GPU, so the vertices never have to be sent again. Skinning and morphing share
+   // it, and it is kept until the vertices are released, since the vertex buffer only holds posed ones afterwards.
+   const auto size = static_cast<GLsizeiptr>(VertexStride) * static_cast<GLsizeiptr>(AllocatedVertexNum);
+   glCreateBuffers( 1, &BindPoseBuffer );
+   glNamedBufferStorage( BindPoseBuffer, size, nullptr, 0 );
+   glCopyNamedBufferSubData( getVertexBuffer(), BindPoseBuffer, VertexBufferOffset, 0, size );
+}
+
+void ObjectGL::releaseBindPoseBuffer()
+{
+   if (BindPoseBuffer == 0) return;
+
+   glDeleteBuffers( 1, &BindPoseBuffer );
+   BindPoseBuffer = 0;
+}
+
+void ObjectGL::releaseInstanceBuffers()
+{
+   if (InstanceBuffer != 0) glDeleteBuffers( 1, &InstanceBuffer );
+   if (InstanceMaterialBuffer != 0) glDeleteBuffers( 1, &InstanceMaterialBuffer );
+   InstanceBuffer = 0;
+   InstanceMaterialBuffer = 0;
+   InstanceNum = 0;
+   InstanceMaterialNum = 0;
+}
+
+void ObjectGL::releaseSkinBuffers()
+{
+   if (BoneNum > 0) {
+      glDeleteBuffers( 1, &SkinWeightBuffer );
+      glDeleteBuffers( 1, &BoneBuffer );
+      SkinWeightBuffer = 0;
+      BoneBuffer = 0;
+   }
+   BoneNum = 0;
+}
+
+void ObjectGL::releaseMorphBuffers()
+{
+   if (MorphDeltaBuffer != 0) {
+      glDeleteBuffers( 1, &MorphDeltaBuffer );
+      glDeleteBuffers( 1, &MorphRangeBuffer );
+      MorphDeltaBuffer = 0;
+      MorphRangeBuffer = 0;
+   }
+   MorphWeights.clear();
+}
+
+void ObjectGL::setCPUCopyPolicy(CPUCopyPolicy policy)
+{
+   if (policy == CopyPolicy) return;
+   if (policy == DropCPUCopy && isDynamic()) {
+      std::cerr << "A dynamic object needs its CPU copy\n";
+      return;
+   }
+
+   CopyPolicy = policy;
+   if (CopyPolicy == DropCPUCopy) {
+      DataBuffer.clear();
+      DataBuffer.shrink_to_fit();
+   }
+   else if (VAO != 0) {
+      GLint size = 0;
+      if (Arena != nullptr) size = VertexStride * static_cast<GLint>(AllocatedVertexNum);
+      else glGetNamedBufferParameteriv( VBO, GL_BUFFER_SIZE, &size );
+      DataBuffer.resize( size / sizeof( GLfloat ) );
+      glGetNamedBufferSubData( getVertexBuffer(), VertexBufferOffset, size, DataBuffer.data() );
+   }
+}
+
+void ObjectGL::setVertexLayout(VertexLayout layout)
+{
+   assert( VAO == 0 );
+   assert( Arena == nullptr || layout == Interleaved );
+
+   Layout = layout;
+}
+
+void ObjectGL::setGeometryArena(GeometryArenaGL* arena)
+{
+   assert( VAO == 0 );
+   assert( arena == nullptr || Layout == Interleaved );
+
+   Arena = arena;
+}
+
+int ObjectGL::getPositionStep(bool normals_exist, bool textures_exist) const
+{
+   if (Layout == Separated) return 3;
+
+   int step = 3;
+   if (normals_exist) step += 3;
+   if (textures_exist) step += 2;
+   return step;
 }
 
 void ObjectGL::setEmissionColor(const glm::vec4& emission_color)
@@ -134,29 +307,281 @@ int ObjectGL::addTexture(const uint8_t* image_buffer, int width, int height, boo
 
 void ObjectGL::prepareTexture(bool normals_exist) const
 {
-   const uint offset = normals_exist ? 6 : 3;
-   glVertexArrayAttribFormat( VAO, TextureLocation, 2, GL_FLOAT, GL_FALSE, offset * sizeof( GLfloat ) );
+   if (Arena != nullptr) return;
+
+   if (Layout == Separated) {
+      glVertexArrayAttribFormat( VAO, TextureLocation, 2, GL_FLOAT, GL_FALSE, 0 );
+      glVertexArrayAttribBinding( VAO, TextureLocation, TextureLocation );
+   }
+   else {
+      const uint offset = normals_exist ? 6 : 3;
+      glVertexArrayAttribFormat( VAO, TextureLocation, 2, GL_FLOAT, GL_FALSE, offset * sizeof( GLfloat ) );
+      glVertexArrayAttribBinding( VAO, TextureLocation, 0 );
+   }
    glEnableVertexArrayAttrib( VAO, TextureLocation );
-   glVertexArrayAttribBinding( VAO, TextureLocation, 0 );
 }
 
 void ObjectGL::prepareNormal() const
 {
-   glVertexArrayAttribFormat( VAO, NormalLocation, 3, GL_FLOAT, GL_FALSE, 3 * sizeof( GLfloat ) );
+   if (Arena != nullptr) return;
+
+   if (Layout == Separated) {
+      glVertexArrayAttribFormat( VAO, NormalLocation, 3, GL_FLOAT, GL_FALSE, 0 );
+      glVertexArrayAttribBinding( VAO, NormalLocation, NormalLocation );
+   }
+   else {
+      glVertexArrayAttribFormat( VAO, NormalLocation, 3, GL_FLOAT, GL_FALSE, 3 * sizeof( GLfloat ) );
+      glVertexArrayAttribBinding( VAO, NormalLocation, 0 );
+   }
    glEnableVertexArrayAttrib( VAO, NormalLocation );
-   glVertexArrayAttribBinding( VAO, NormalLocation, 0 );
 }
 
-void ObjectGL::prepareVertexBuffer(int n_bytes_per_vertex)
+void ObjectGL::bindVertexBuffer(GLintptr base_offset) const
 {
+   // The VAO of an arena binds the whole buffer, and base vertices address the objects in it.
+   if (Arena != nullptr) return;
+
+   if (Layout == Separated) {
+      // Each attribute lives in its own block of the buffer: all positions, then all normals, then all textures.
+      const auto block_size = static_cast<GLintptr>(sizeof( GLfloat ) * AllocatedVertexNum);
+      const GLintptr normal_offset = base_offset + 3 * block_size;
+      const GLintptr texture_offset = normal_offset + (NormalsExist ? 3 * block_size : 0);
+      glVertexArrayVertexBuffer( VAO, VertexLocation, VBO, base_offset, 3 * sizeof( GLfloat ) );
+      if (NormalsExist) glVertexArrayVertexBuffer( VAO, NormalLocation, VBO, normal_offset, 3 * sizeof( GLfloat ) );
+      if (TexturesExist) glVertexArrayVertexBuffer( VAO, TextureLocation, VBO, texture_offset, 2 * sizeof( GLfloat ) );
+      glVertexArrayVertexBuffer( PositionVAO, 0, VBO, base_offset, 3 * sizeof( GLfloat ) );
+   }
+   else {
+      glVertexArrayVertexBuffer( VAO, 0, VBO, base_offset, VertexStride );
+      glVertexArrayVertexBuffer( PositionVAO, 0, VBO, base_offset, VertexStride );
+   }
+}
+
+void ObjectGL::prepareVertexBuffer(int n_bytes_per_vertex, const void* data)
+{
+   releaseVertexBuffer();
+   VertexStride = n_bytes_per_vertex;
+   AllocatedVertexNum = static_cast<size_t>(VerticesCount);
+   if (Arena != nullptr) {
+      ArenaVertices = Arena->allocateVertices( NormalsExist, TexturesExist, AllocatedVertexNum );
+      BaseVertex = static_cast<GLint>(ArenaVertices.Range.Offset);
+      VertexBufferOffset = static_cast<GLintptr>(n_bytes_per_vertex) * BaseVertex;
+      VAO = Arena->getVAO( NormalsExist, TexturesExist );
+      PositionVAO = Arena->getPositionVAO( NormalsExist, TexturesExist );
+      if (data != nullptr) {
+         glNamedBufferSubData(
+            getVertexBuffer(), VertexBufferOffset, static_cast<GLsizeiptr>(n_bytes_per_vertex) * VerticesCount, data
+         );
+      }
+      return;
+   }
+
    glCreateBuffers( 1, &VBO );
-   glNamedBufferStorage( VBO, sizeof( GLfloat ) * DataBuffer.size(), DataBuffer.data(), GL_DYNAMIC_STORAGE_BIT );
+   glNamedBufferStorage(
+      VBO,
+      static_cast<GLsizeiptr>(n_bytes_per_vertex) * VerticesCount,
+      data,
+      GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT
+   );
 
    glCreateVertexArrays( 1, &VAO );
-   glVertexArrayVertexBuffer( VAO, 0, VBO, 0, n_bytes_per_vertex );
-   glVertexArrayAttribFormat( VAO, VertexLocation, 3, GL_FLOAT, GL_FALSE, 0 );
-   glEnableVertexArrayAttrib( VAO, VertexLocation );
-   glVertexArrayAttribBinding( VAO, VertexLocation, 0 );
+   glCreateVertexArrays( 1, &PositionVAO );
+   bindVertexBuffer( 0 );
+   for (const auto& vao : { VAO, PositionVAO }) {
+      glVertexArrayAttribFormat( vao, VertexLocation, 3, GL_FLOAT, GL_FALSE, 0 );
+      glEnableVertexArrayAttrib( vao, VertexLocation );
+      glVertexArrayAttribBinding( vao, VertexLocation, 0 );
+   }
+}
+
+void ObjectGL::packVertices(
+   GLfloat* destination,
+   const glm::vec3* vertices,
+   const glm::vec3* normals,
+   const glm::vec2* textures,
+   size_t vertex_num,
+   size_t begin,
+   size_t end
+)
+{
+   const size_t step = 3 + (normals != nullptr ? 3 : 0) + (textures != nullptr ? 2 : 0);
+   if (normals == nullptr && textures == nullptr) {
+      std::memcpy( destination + begin * step, vertices + begin, (end - begin) * sizeof( glm::vec3 ) );
+      return;
+   }
+
+   size_t i = begin;
+#ifdef OBJECT_GL_USE_SSE
+   // _mm_loadu_ps reads one float past a glm::vec3, so the last vertex of the stream is left to the scalar loop.
+   const size_t simd_end = std::max( std::min( end, vertex_num - 1 ), i );
+   GLfloat* out = destination + i * step;
+   if (normals != nullptr && textures != nullptr) {
+      for (; i < simd_end; ++i, out += step) {
+         const __m128 p = _mm_loadu_ps( &vertices[i].x );
+         const __m128 n = _mm_loadu_ps( &normals[i].x );
+         const __m128 t = _mm_castpd_ps( _mm_load_sd( reinterpret_cast<const double*>(&textures[i].x) ) );
+         const __m128 pz_nx = _mm_shuffle_ps( p, n, _MM_SHUFFLE( 0, 0, 2, 2 ) );
+         _mm_storeu_ps( out, _mm_shuffle_ps( p, pz_nx, _MM_SHUFFLE( 2, 0, 1, 0 ) ) );
+         _mm_storeu_ps( out + 4, _mm_shuffle_ps( n, t, _MM_SHUFFLE( 1, 0, 2, 1 ) ) );
+      }
+   }
+   else if (normals != nullptr) {
+      for (; i < simd_end; ++i, out += step) {
+         const __m128 p = _mm_loadu_ps( &vertices[i].x );
+         const __m128 n = _mm_loadu_ps( &normals[i].x );
+         const __m128 pz_nx = _mm_shuffle_ps( p, n, _MM_SHUFFLE( 0, 0, 2, 2 ) );
+         _mm_storeu_ps( out, _mm_shuffle_ps( p, pz_nx, _MM_SHUFFLE( 2, 0, 1, 0 ) ) );
+         _mm_storel_pi( reinterpret_cast<__m64*>(out + 4), _mm_shuffle_ps( n, n, _MM_SHUFFLE( 2, 1, 2, 1 ) ) );
+      }
+   }
+   else {
+      for (; i < simd_end; ++i, out += step) {
+         const __m128 p = _mm_loadu_ps( &vertices[i].x );
+         const __m128 t = _mm_castpd_ps( _mm_load_sd( reinterpret_cast<const double*>(&textures[i].x) ) );
+         const __m128 pz_u = _mm_shuffle_ps( p, t, _MM_SHUFFLE( 0, 0, 2, 2 ) );
+         _mm_storeu_ps( out, _mm_shuffle_ps( p, pz_u, _MM_SHUFFLE( 2, 0, 1, 0 ) ) );
+         _mm_store_ss( out + 4, _mm_shuffle_ps( t, t, _MM_SHUFFLE( 1, 1, 1, 1 ) ) );
+      }
+   }
+#endif
+   for (; i < end; ++i) {
+      GLfloat* vertex = destination + i * step;
+      *vertex++ = vertices[i].x;
+      *vertex++ = vertices[i].y;
+      *vertex++ = vertices[i].z;
+      if (normals != nullptr) {
+         *vertex++ = normals[i].x;
+         *vertex++ = normals[i].y;
+         *vertex++ = normals[i].z;
+      }
+      if (textures != nullptr) {
+         *vertex++ = textures[i].x;
+         *vertex = textures[i].y;
+      }
+   }
+}
+
+void ObjectGL::uploadVertices(const glm::vec3* vertices, const glm::vec3* normals, const glm::vec2* textures)
+{
+   assert( VertexStride != 0 );
+   assert( static_cast<size_t>(VerticesCount) <= AllocatedVertexNum );
+   assert( (normals != nullptr) == NormalsExist && (textures != nullptr) == TexturesExist );
+
+   // The separated blocks are placed for the allocated vertex number, so they are always written as a whole.
+   const size_t step = 3 + (normals != nullptr ? 3 : 0) + (textures != nullptr ? 2 : 0);
+   const auto vertex_num = static_cast<size_t>(VerticesCount);
+   const size_t float_num = step * (Layout == Separated ? AllocatedVertexNum : vertex_num);
+   const auto size = static_cast<GLsizeiptr>(sizeof( GLfloat ) * float_num);
+   Bounds = BoundingVolume::get( reinterpret_cast<const GLfloat*>(vertices), 3, vertex_num );
+   if (size == 0) return;
+
+   // Without a CPU copy, the vertices are packed straight into the driver's memory.
+   GLfloat* destination;
+   if (CopyPolicy == KeepCPUCopy) {
+      DataBuffer.resize( float_num );
+      destination = DataBuffer.data();
+   }
+   else {
+      // Inside an arena, only the range of this object may be invalidated.
+      const GLbitfield invalidation = Arena != nullptr ? GL_MAP_INVALIDATE_RANGE_BIT : GL_MAP_INVALIDATE_BUFFER_BIT;
+      destination = static_cast<GLfloat*>(
+         glMapNamedBufferRange( getVertexBuffer(), VertexBufferOffset, size, GL_MAP_WRITE_BIT | invalidation )
+      );
+      if (destination == nullptr) {
+         std::cerr << "Could not map the vertex buffer\n";
+         return;
+      }
+   }
+
+   if (Layout == Separated) {
+      GLfloat* normal_block = destination + 3 * AllocatedVertexNum;
+      GLfloat* texture_block = normal_block + (normals != nullptr ? 3 * AllocatedVertexNum : 0);
+      ThreadPool::getInstance().parallelFor(
+         vertex_num, 1 << 16,
+         [&](size_t begin, size_t end) {
+            std::memcpy( destination + 3 * begin, vertices + begin, (end - begin) * sizeof( glm::vec3 ) );
+            if (normals != nullptr) {
+               std::memcpy( normal_block + 3 * begin, normals + begin, (end - begin) * sizeof( glm::vec3 ) );
+            }
+            if (textures != nullptr) {
+               std::memcpy( texture_block + 2 * begin, textures + begin, (end - begin) * sizeof( glm::vec2 ) );
+            }
+         }
+      );
+   }
+   else {
+      ThreadPool::getInstance().parallelFor(
+         vertex_num, 1 << 16,
+         [&](size_t begin, size_t end) {
+            packVertices( destination, vertices, normals, textures, vertex_num, begin, end );
+         }
+      );
+   }
+
+   if (isDynamic()) writeDynamicRegion();
+   else if (CopyPolicy == KeepCPUCopy) glNamedBufferSubData( getVertexBuffer(), VertexBufferOffset, size, DataBuffer.data() );
+   else glUnmapNamedBuffer( getVertexBuffer() );
+}
+
+void ObjectGL::setDynamicMode(int region_num)
+{
+   assert( VBO != 0 && VertexStride != 0 );
+   assert( Arena == nullptr );
+   assert( !isDynamic() && !isSkinned() );
+   assert( region_num > 1 );
+
+   // Each write refills a whole region, so the CPU copy has to hold every attribute.
+   setCPUCopyPolicy( KeepCPUCopy );
+
+   GLint size = 0;
+   glGetNamedBufferParameteriv( VBO, GL_BUFFER_SIZE, &size );
+   constexpr GLsizeiptr alignment = 256;
+   const GLsizeiptr region_size = (static_cast<GLsizeiptr>(size) + alignment - 1) / alignment * alignment;
+   const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+   GLuint buffer = 0;
+   glCreateBuffers( 1, &buffer );
+   glNamedBufferStorage( buffer, region_size * region_num, nullptr, flags );
+   for (int i = 0; i < region_num; ++i) {
+      glCopyNamedBufferSubData( VBO, buffer, 0, region_size * i, size );
+   }
+   glDeleteBuffers( 1, &VBO );
+   VBO = buffer;
+
+   DynamicBuffer = static_cast<uint8_t*>(glMapNamedBufferRange( VBO, 0, region_size * region_num, flags ));
+   DynamicRegionNum = region_num;
+   DynamicRegionIndex = 0;
+   DynamicRegionSize = region_size;
+   DynamicFences.assign( region_num, nullptr );
+   bindVertexBuffer( 0 );
+}
+
+void ObjectGL::writeDynamicRegion()
+{
+   assert( DynamicBuffer != nullptr );
+   assert( static_cast<GLsizeiptr>(sizeof( GLfloat ) * DataBuffer.size()) <= DynamicRegionSize );
+
+   // Draws issued so far read the current region, so it is fenced before the binding moves away from it.
+   DynamicFences[DynamicRegionIndex] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+
+   const int next_index = (DynamicRegionIndex + 1) % DynamicRegionNum;
+   GLsync& fence = DynamicFences[next_index];
+   if (fence != nullptr) {
+      constexpr GLuint64 timeout_in_ns = 1000000;
+      GLbitfield wait_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+      while (true) {
+         const GLenum result = glClientWaitSync( fence, wait_flags, timeout_in_ns );
+         if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED) break;
+         wait_flags = 0;
+      }
+      glDeleteSync( fence );
+      fence = nullptr;
+   }
+
+   const GLsizeiptr offset = DynamicRegionSize * next_index;
+   std::memcpy( DynamicBuffer + offset, DataBuffer.data(), sizeof( GLfloat ) * DataBuffer.size() );
+   bindVertexBuffer( offset );
+   DynamicRegionIndex = next_index;
 }
 
 void ObjectGL::getSquareObject(
@@ -194,19 +619,407 @@ void ObjectGL::getSquareObject(
    };
 }
 
-void ObjectGL::setObject(GLenum draw_mode, const std::vector<glm::vec3>& vertices)
+void ObjectGL::setObject(
+   GLenum draw_mode,
+   GLsizei vertex_num,
+   const glm::vec3* vertices,
+   const glm::vec3* normals,
+   const glm::vec2* textures
+)
 {
    DrawMode = draw_mode;
-   VerticesCount = 0;
+   VerticesCount = vertex_num;
+   NormalsExist = normals != nullptr;
+   TexturesExist = textures != nullptr;
+   const int n_bytes_per_vertex =
+      (3 + (normals != nullptr ? 3 : 0) + (textures != nullptr ? 2 : 0)) * static_cast<int>(sizeof( GLfloat ));
+   prepareVertexBuffer( n_bytes_per_vertex );
+   uploadVertices( vertices, normals, textures );
+   if (normals != nullptr) prepareNormal();
+   if (textures != nullptr) prepareTexture( normals != nullptr );
+}
+
+void ObjectGL::setPackedObject(
+   GLenum draw_mode,
+   GLsizei vertex_num,
+   const GLfloat* packed_vertices,
+   bool normals_exist,
+   bool textures_exist
+)
+{
+   assert( Layout == Interleaved );
+
+   DrawMode = draw_mode;
+   VerticesCount = vertex_num;
+   NormalsExist = normals_exist;
+   TexturesExist = textures_exist;
+   const int step = 3 + (normals_exist ? 3 : 0) + (textures_exist ? 2 : 0);
+   prepareVertexBuffer( step * static_cast<int>(sizeof( GLfloat )), packed_vertices );
+   Bounds = BoundingVolume::get( packed_vertices, step, static_cast<size_t>(vertex_num) );
+   if (CopyPolicy == KeepCPUCopy) {
+      DataBuffer.assign( packed_vertices, packed_vertices + static_cast<size_t>(step) * vertex_num );
+   }
+   if (normals_exist) prepareNormal();
+   if (textures_exist) prepareTexture( normals_exist );
+}
+
+GLsizei ObjectGL::getComponentSize(GLenum component_type)
+{
+   switch (component_type) {
+      case GL_BYTE:
+      case GL_UNSIGNED_BYTE: return 1;
+      case GL_SHORT:
+      case GL_UNSIGNED_SHORT:
+      case GL_HALF_FLOAT: return 2;
+      case GL_INT:
+      case GL_UNSIGNED_INT:
+      case GL_FLOAT: return 4;
+      case GL_DOUBLE: return 8;
+      default: return 0;
+   }
+}
+
+void ObjectGL::setObject(GLenum draw_mode, GLsizei vertex_num, const std::vector<VertexStream>& streams)
+{
+   assert( Arena == nullptr );
+
+   releaseVertexBuffer();
    DataBuffer.clear();
-   for (auto& vertex : vertices) {
-      DataBuffer.emplace_back( vertex.x );
-      DataBuffer.emplace_back( vertex.y );
-      DataBuffer.emplace_back( vertex.z );
-      VerticesCount++;
+   DrawMode = draw_mode;
+   VerticesCount = vertex_num;
+   NormalsExist = false;
+   TexturesExist = false;
+   VertexStride = 0;
+   AllocatedVertexNum = 0;
+
+   constexpr GLsizeiptr alignment = 16;
+   std::vector<GLintptr> offsets;
+   GLsizeiptr size = 0;
+   for (const auto& stream : streams) {
+      offsets.emplace_back( size );
+      size += (stream.Size + alignment - 1) / alignment * alignment;
+   }
+   if (size == 0) return;
+
+   glCreateBuffers( 1, &VBO );
+   glNamedBufferStorage( VBO, size, nullptr, GL_DYNAMIC_STORAGE_BIT | GL_MAP_WRITE_BIT );
+   auto* destination = static_cast<uint8_t*>(
+      glMapNamedBufferRange( VBO, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT )
+   );
+   if (destination == nullptr) {
+      std::cerr << "Could not map the vertex buffer\n";
+      return;
+   }
+   for (size_t i = 0; i < streams.size(); ++i) {
+      std::memcpy( destination + offsets[i], streams[i].Data, static_cast<size_t>(streams[i].Size) );
+   }
+   glUnmapNamedBuffer( VBO );
+
+   glCreateVertexArrays( 1, &VAO );
+   glCreateVertexArrays( 1, &PositionVAO );
+   for (size_t i = 0; i < streams.size(); ++i) {
+      const VertexStream& stream = streams[i];
+      const GLsizei stride =
+         stream.Stride != 0 ? stream.Stride : stream.ComponentNum * getComponentSize( stream.ComponentType );
+      std::vector<GLuint> vaos = { VAO };
+      if (stream.Location == VertexLocation) vaos.emplace_back( PositionVAO );
+      for (const auto& vao : vaos) {
+         glVertexArrayVertexBuffer( vao, stream.Location, VBO, offsets[i], stride );
+         glVertexArrayAttribFormat(
+            vao, stream.Location, stream.ComponentNum, stream.ComponentType, stream.IsNormalized, 0
+         );
+         glVertexArrayAttribBinding( vao, stream.Location, stream.Location );
+         glEnableVertexArrayAttrib( vao, stream.Location );
+      }
+      if (stream.Location == NormalLocation) NormalsExist = true;
+      else if (stream.Location == TextureLocation) TexturesExist = true;
+      else if (stream.Location == VertexLocation && stream.ComponentType == GL_FLOAT && stream.ComponentNum >= 3) {
+         Bounds = BoundingVolume::get(
+            reinterpret_cast<const GLfloat*>(stream.Data), static_cast<size_t>(stride) / sizeof( GLfloat ),
+            static_cast<size_t>(vertex_num)
+         );
+      }
    }
-   const int n_bytes_per_vertex = 3 * sizeof( GLfloat );
-   prepareVertexBuffer( n_bytes_per_vertex );
+}
+
+void ObjectGL::setIndexBuffer(GLenum index_type, GLsizei index_num, const void* indices)
+{
+   assert( VAO != 0 );
+
+   LODs.clear();
+   CurrentLOD = 0;
+   releaseMeshletBuffers();
+   if (Arena != nullptr) {
+      // The arena keeps every index as a GLuint, so the other types are widened.
+      std::vector<GLuint> widened_indices;
+      if (index_type != GL_UNSIGNED_INT) {
+         widened_indices.resize( index_num );
+         for (GLsizei i = 0; i < index_num; ++i) {
+            widened_indices[i] = index_type == GL_UNSIGNED_SHORT ?
+               static_cast<const GLushort*>(indices)[i] : static_cast<const GLubyte*>(indices)[i];
+         }
+         indices = widened_indices.data();
+      }
+      Arena->freeIndices( ArenaIndices );
+      ArenaIndices = Arena->allocateIndices( static_cast<size_t>(index_num) );
+      IndexType = GL_UNSIGNED_INT;
+      IndicesCount = index_num;
+      FirstIndex = static_cast<GLuint>(ArenaIndices.Offset);
+      glNamedBufferSubData(
+         Arena->getIndexBuffer(),
+         static_cast<GLintptr>(sizeof( GLuint ) * FirstIndex),
+         static_cast<GLsizeiptr>(sizeof( GLuint ) * index_num),
+         indices
+      );
+      return;
+   }
+
+   if (IBO != 0) glDeleteBuffers( 1, &IBO );
+   IndexType = index_type;
+   IndicesCount = index_num;
+   glCreateBuffers( 1, &IBO );
+   glNamedBufferStorage(
+      IBO,
+      static_cast<GLsizeiptr>(getComponentSize( index_type )) * index_num,
+      indices,
+      GL_DYNAMIC_STORAGE_BIT
+   );
+   glVertexArrayElementBuffer( VAO, IBO );
+   glVertexArrayElementBuffer( PositionVAO, IBO );
+}
+
+void ObjectGL::setIndexBuffer(const std::vector<GLuint>& indices)
+{
+   setIndexBuffer( GL_UNSIGNED_INT, static_cast<GLsizei>(indices.size()), indices.data() );
+}
+
+void ObjectGL::setLODs(const std::vector<LOD>& lods)
+{
+   assert( isIndexed() );
+   assert( std::all_of(
+      lods.begin(), lods.end(),
+      [this](const LOD& lod) { return lod.FirstIndex >= 0 && lod.FirstIndex + lod.IndexNum <= IndicesCount; }
+   ) );
+
+   LODs = lods;
+   CurrentLOD = 0;
+}
+
+int ObjectGL::selectLOD(float projected_radius, float pixel_error, float hysteresis)
+{
+   if (LODs.empty() || Bounds.SphereRadius <= 0.0f) return CurrentLOD;
+
+   // The errors grow with the level, so the search stops at the first level that does not fit.
+   const float pixels_per_unit = projected_radius / Bounds.SphereRadius;
+   const auto get_coarsest_lod = [&](float max_error) {
+      int lod = 0;
+      while (lod + 1 < getLODNum() && LODs[lod + 1].Error * pixels_per_unit <= max_error) ++lod;
+      return lod;
+   };
+   if (LODs[CurrentLOD].Error * pixels_per_unit > pixel_error) CurrentLOD = get_coarsest_lod( pixel_error );
+   else CurrentLOD = std::max( CurrentLOD, get_coarsest_lod( pixel_error * (1.0f - hysteresis) ) );
+   return CurrentLOD;
+}
+
+void ObjectGL::setBoundingSphere(const glm::vec3& center, float radius)
+{
+   Bounds.SphereCenter = center;
+   Bounds.SphereRadius = radius;
+}
+
+void ObjectGL::setMeshlets(const std::vector<Meshlet>& meshlets)
+{
+   assert( isIndexed() );
+
+   releaseMeshletBuffers();
+   if (meshlets.empty()) return;
+
+   MeshletNum = static_cast<GLsizei>(meshlets.size());
+   glCreateBuffers( 1, &MeshletBuffer );
+   glNamedBufferStorage( MeshletBuffer, sizeof( Meshlet ) * meshlets.size(), meshlets.data(), 0 );
+   glCreateBuffers( 1, &MeshletCommandBuffer );
+   glNamedBufferStorage( MeshletCommandBuffer, sizeof( DrawElementsIndirectCommand ) * meshlets.size(), nullptr, 0 );
+   glCreateBuffers( 1, &MeshletDrawCountBuffer );
+   glNamedBufferStorage( MeshletDrawCountBuffer, sizeof( GLuint ), nullptr, 0 );
+}
+
+void ObjectGL::setIndexBufferWithMeshlets(std::vector<GLuint> indices)
+{
+   assert( VAO != 0 && VertexStride != 0 );
+   assert( DrawMode == GL_TRIANGLES );
+
+   // The positions lead every interleaved vertex, and fill the first block of the separated layout.
+   const size_t stride = Layout == Separated ? 3 : static_cast<size_t>(VertexStride) / sizeof( GLfloat );
+   const auto vertex_num = static_cast<size_t>(VerticesCount);
+   std::vector<GLfloat> read_back;
+   const GLfloat* positions = DataBuffer.data();
+   if (DataBuffer.empty()) {
+      read_back.resize( stride * vertex_num );
+      glGetNamedBufferSubData(
+         getVertexBuffer(), VertexBufferOffset, static_cast<GLsizeiptr>(sizeof( GLfloat ) * read_back.size()),
+         read_back.data()
+      );
+      positions = read_back.data();
+   }
+
+   const std::vector<Meshlet> meshlets =
+      MeshletBuilder::build( positions, stride, vertex_num, indices.data(), indices.size() );
+   setIndexBuffer( indices );
+   setMeshlets( meshlets );
+}
+
+void ObjectGL::setSkin(const std::vector<SkinWeight>& weights, int bone_num)
+{
+   assert( VAO != 0 && VertexStride != 0 );
+   assert( !isDynamic() );
+   assert( weights.size() >= static_cast<size_t>(VerticesCount) );
+
+   releaseSkinBuffers();
+   if (bone_num <= 0 || VerticesCount == 0) return;
+
+   // The skinning pass reads the bone of every lane, even one with a zero weight.
+   assert( std::all_of(
+      weights.begin(), weights.begin() + VerticesCount,
+      [bone_num](const SkinWeight& weight) {
+         return glm::all( glm::lessThan( weight.BoneIndices, glm::uvec4(static_cast<GLuint>(bone_num)) ) );
+      }
+   ) );
+
+   createBindPoseBuffer();
+   BoneNum = bone_num;
+   glCreateBuffers( 1, &SkinWeightBuffer );
+   glNamedBufferStorage( SkinWeightBuffer, sizeof( SkinWeight ) * VerticesCount, weights.data(), 0 );
+
+   const std::vector<glm::mat4> identities(bone_num, glm::mat4(1.0f));
+   glCreateBuffers( 1, &BoneBuffer );
+   glNamedBufferStorage(
+      BoneBuffer, sizeof( glm::mat4 ) * identities.size(), identities.data(), GL_DYNAMIC_STORAGE_BIT
+   );
+}
+
+void ObjectGL::setBoneMatrices(const std::vector<glm::mat4>& bone_matrices)
+{
+   assert( isSkinned() );
+   assert( bone_matrices.size() <= static_cast<size_t>(BoneNum) );
+
+   glNamedBufferSubData( BoneBuffer, 0, sizeof( glm::mat4 ) * bone_matrices.size(), bone_matrices.data() );
+}
+
+void ObjectGL::setInstances(const std::vector<Instance>& instances)
+{
+   const auto instance_num = static_cast<GLsizei>(instances.size());
+   if (instance_num != InstanceNum) {
+      if (InstanceBuffer != 0) glDeleteBuffers( 1, &InstanceBuffer );
+      InstanceBuffer = 0;
+      InstanceNum = instance_num;
+      if (instance_num == 0) return;
+
+      glCreateBuffers( 1, &InstanceBuffer );
+      glNamedBufferStorage( InstanceBuffer, sizeof( Instance ) * instances.size(), nullptr, GL_DYNAMIC_STORAGE_BIT );
+   }
+   updateInstances( 0, instances.data(), instance_num );
+}
+
+void ObjectGL::updateInstances(GLsizei first_instance, const Instance* instances, GLsizei instance_num)
+{
+   assert( first_instance >= 0 && first_instance + instance_num <= InstanceNum );
+
+   if (instance_num == 0) return;
+   glNamedBufferSubData(
+      InstanceBuffer, sizeof( Instance ) * first_instance, sizeof( Instance ) * instance_num, instances
+   );
+}
+
+void ObjectGL::setInstanceMaterials(const std::vector<InstanceMaterial>& materials)
+{
+   const auto material_num = static_cast<GLsizei>(materials.size());
+   if (material_num != InstanceMaterialNum) {
+      if (InstanceMaterialBuffer != 0) glDeleteBuffers( 1, &InstanceMaterialBuffer );
+      InstanceMaterialBuffer = 0;
+      InstanceMaterialNum = material_num;
+      if (material_num == 0) return;
+
+      glCreateBuffers( 1, &InstanceMaterialBuffer );
+      glNamedBufferStorage(
+         InstanceMaterialBuffer, sizeof( InstanceMaterial ) * materials.size(), nullptr, GL_DYNAMIC_STORAGE_BIT
+      );
+   }
+   glNamedBufferSubData( InstanceMaterialBuffer, 0, sizeof( InstanceMaterial ) * materials.size(), materials.data() );
+}
+
+void ObjectGL::setMorphTargets(const std::vector<MorphTarget>& targets)
+{
+   assert( VAO != 0 && VertexStride != 0 );
+   assert( !isDynamic() );
+   assert( targets.size() <= static_cast<size_t>(MaxMorphTargetNum) );
+
+   releaseMorphBuffers();
+   if (targets.empty() || VerticesCount == 0) return;
+
+   // The deltas are sorted by vertex with a counting pass, so that the ranges index them directly.
+   const auto vertex_num = static_cast<size_t>(VerticesCount);
+   std::vector<GLuint> ranges(vertex_num + 1, 0);
+   for (const auto& target : targets) {
+      assert( target.PositionDeltas.size() == target.Indices.size() );
+      assert( target.NormalDeltas.empty() || target.NormalDeltas.size() == target.Indices.size() );
+
+      for (const auto& index : target.Indices) {
+         assert( index < vertex_num );
+         ++ranges[index + 1];
+      }
+   }
+   for (size_t i = 0; i < vertex_num; ++i) ranges[i + 1] += ranges[i];
+   if (ranges.back() == 0) return;
+
+   std::vector<MorphDelta> deltas(ranges.back());
+   std::vector<GLuint> next(ranges.begin(), ranges.end() - 1);
+   for (size_t t = 0; t < targets.size(); ++t) {
+      const MorphTarget& target = targets[t];
+      for (size_t i = 0; i < target.Indices.size(); ++i) {
+         MorphDelta& delta = deltas[next[target.Indices[i]]++];
+         delta.PositionDelta = target.PositionDeltas[i];
+         delta.Target = static_cast<GLuint>(t);
+         delta.NormalDelta = target.NormalDeltas.empty() ? glm::vec3(0.0f) : target.NormalDeltas[i];
+         delta.Padding = 0.0f;
+      }
+   }
+
+   createBindPoseBuffer();
+   MorphWeights.assign( targets.size(), 0.0f );
+   glCreateBuffers( 1, &MorphDeltaBuffer );
+   glNamedBufferStorage( MorphDeltaBuffer, sizeof( MorphDelta ) * deltas.size(), deltas.data(), 0 );
+   glCreateBuffers( 1, &MorphRangeBuffer );
+   glNamedBufferStorage( MorphRangeBuffer, sizeof( GLuint ) * ranges.size(), ranges.data(), 0 );
+}
+
+void ObjectGL::setMorphWeights(const std::vector<float>& weights)
+{
+   assert( isMorphed() );
+   assert( weights.size() <= MorphWeights.size() );
+
+   std::copy( weights.begin(), weights.end(), MorphWeights.begin() );
+}
+
+ObjectGL::SkinLayout ObjectGL::getSkinLayout() const
+{
+   SkinLayout layout{};
+   layout.FirstFloat = static_cast<GLuint>(VertexBufferOffset / static_cast<GLintptr>(sizeof( GLfloat )));
+   if (Layout == Separated) {
+      layout.PositionStride = 3;
+      layout.NormalOffset = static_cast<GLuint>(3 * AllocatedVertexNum);
+      layout.NormalStride = NormalsExist ? 3 : 0;
+   }
+   else {
+      layout.PositionStride = static_cast<GLuint>(VertexStride / static_cast<GLsizei>(sizeof( GLfloat )));
+      layout.NormalOffset = 3;
+      layout.NormalStride = NormalsExist ? layout.PositionStride : 0;
+   }
+   return layout;
+}
+
+void ObjectGL::setObject(GLenum draw_mode, const std::vector<glm::vec3>& vertices)
+{
+   setObject( draw_mode, static_cast<GLsizei>(vertices.size()), vertices.data() );
 }
 
 void ObjectGL::setObject(
@@ -215,21 +1028,9 @@ void ObjectGL::setObject(
    const std::vector<glm::vec3>& normals
 )
 {
-   DrawMode = draw_mode;
-   VerticesCount = 0;
-   DataBuffer.clear();
-   for (size_t i = 0; i < vertices.size(); ++i) {
-      DataBuffer.emplace_back( vertices[i].x );
-      DataBuffer.emplace_back( vertices[i].y );
-      DataBuffer.emplace_back( vertices[i].z );
-      DataBuffer.emplace_back( normals[i].x );
-      DataBuffer.emplace_back( normals[i].y );
-      DataBuffer.emplace_back( normals[i].z );
-      VerticesCount++;
-   }
-   const int n_bytes_per_vertex = 6 * sizeof( GLfloat );
-   prepareVertexBuffer( n_bytes_per_vertex );
-   prepareNormal();
+   assert( normals.size() >= vertices.size() );
+
+   setObject( draw_mode, static_cast<GLsizei>(vertices.size()), vertices.data(), normals.data() );
 }
 
 void ObjectGL::setObject(
@@ -240,20 +1041,9 @@ void ObjectGL::setObject(
    bool is_grayscale
 )
 {
-   DrawMode = draw_mode;
-   VerticesCount = 0;
-   DataBuffer.clear();
-   for (size_t i = 0; i < vertices.size(); ++i) {
-      DataBuffer.emplace_back( vertices[i].x );
-      DataBuffer.emplace_back( vertices[i].y );
-      DataBuffer.emplace_back( vertices[i].z );
-      DataBuffer.emplace_back( textures[i].x );
-      DataBuffer.emplace_back( textures[i].y );
-      VerticesCount++;
-   }
-   const int n_bytes_per_vertex = 5 * sizeof( GLfloat );
-   prepareVertexBuffer( n_bytes_per_vertex );
-   prepareTexture( false );
+   assert( textures.size() >= vertices.size() );
+
+   setObject( draw_mode, static_cast<GLsizei>(vertices.size()), vertices.data(), nullptr, textures.data() );
    addTexture( texture_file_path, is_grayscale );
 }
 
@@ -264,24 +1054,10 @@ void ObjectGL::setObject(
    const std::vector<glm::vec2>& textures
 )
 {
-   DrawMode = draw_mode;
-   VerticesCount = 0;
-   DataBuffer.clear();
-   for (size_t i = 0; i < vertices.size(); ++i) {
-      DataBuffer.emplace_back( vertices[i].x );
-      DataBuffer.emplace_back( vertices[i].y );
-      DataBuffer.emplace_back( vertices[i].z );
-      DataBuffer.emplace_back( normals[i].x );
-      DataBuffer.emplace_back( normals[i].y );
-      DataBuffer.emplace_back( normals[i].z );
-      DataBuffer.emplace_back( textures[i].x );
-      DataBuffer.emplace_back( textures[i].y );
-      VerticesCount++;
-   }
-   const int n_bytes_per_vertex = 8 * sizeof( GLfloat );
-   prepareVertexBuffer( n_bytes_per_vertex );
-   prepareNormal();
-   prepareTexture( true );
+   assert( normals.size() >= vertices.size() );
+   assert( textures.size() >= vertices.size() );
+
+   setObject( draw_mode, static_cast<GLsizei>(vertices.size()), vertices.data(), normals.data(), textures.data() );
 }
 
 void ObjectGL::setObject(
@@ -320,20 +1096,11 @@ void ObjectGL::setSquareObject(
 
 void ObjectGL::updateDataBuffer(const std::vector<glm::vec3>& vertices, const std::vector<glm::vec3>& normals)
 {
-   assert( VBO != 0 );
+   assert( VAO != 0 );
+   assert( normals.size() >= vertices.size() );
 
-   VerticesCount = 0;
-   DataBuffer.clear();
-   for (size_t i = 0; i < vertices.size(); ++i) {
-      DataBuffer.push_back( vertices[i].x );
-      DataBuffer.push_back( vertices[i].y );
-      DataBuffer.push_back( vertices[i].z );
-      DataBuffer.push_back( normals[i].x );
-      DataBuffer.push_back( normals[i].y );
-      DataBuffer.push_back( normals[i].z );
-      VerticesCount++;
-   }
-   glNamedBufferSubData( VBO, 0, static_cast<GLsizeiptr>(sizeof( GLfloat ) * DataBuffer.size()), DataBuffer.data() );
+   VerticesCount = static_cast<GLsizei>(vertices.size());
+   uploadVertices( vertices.data(), normals.data(), nullptr );
 }
 
 void ObjectGL::updateDataBuffer(
@@ -342,22 +1109,174 @@ void ObjectGL::updateDataBuffer(
    const std::vector<glm::vec2>& textures
 )
 {
-   assert( VBO != 0 );
+   assert( VAO != 0 );
+   assert( normals.size() >= vertices.size() );
+   assert( textures.size() >= vertices.size() );
 
-   VerticesCount = 0;
-   DataBuffer.clear();
-   for (size_t i = 0; i < vertices.size(); ++i) {
-      DataBuffer.push_back( vertices[i].x );
-      DataBuffer.push_back( vertices[i].y );
-      DataBuffer.push_back( vertices[i].z );
-      DataBuffer.push_back( normals[i].x );
-      DataBuffer.push_back( normals[i].y );
-      DataBuffer.push_back( normals[i].z );
-      DataBuffer.push_back( textures[i].x );
-      DataBuffer.push_back( textures[i].y );
-      VerticesCount++;
+   VerticesCount = static_cast<GLsizei>(vertices.size());
+   uploadVertices( vertices.data(), normals.data(), textures.data() );
+}
+
+void ObjectGL::mergeVertexRanges(std::vector<VertexRange>& ranges)
+{
+   // Ranges separated by a few vertices are cheaper to send as one upload than as two.
+   constexpr size_t max_gap = 8;
+   std::sort( ranges.begin(), ranges.end() );
+   size_t merged_num = 0;
+   for (const auto& range : ranges) {
+      if (merged_num > 0 && range.first <= ranges[merged_num - 1].second + max_gap) {
+         ranges[merged_num - 1].second = std::max( ranges[merged_num - 1].second, range.second );
+      }
+      else ranges[merged_num++] = range;
+   }
+   ranges.resize( merged_num );
+}
+
+bool ObjectGL::needsFullUpload(const std::vector<VertexRange>& ranges) const
+{
+   size_t dirty_vertex_num = 0;
+   for (const auto& range : ranges) dirty_vertex_num += range.second - range.first;
+   return static_cast<float>(dirty_vertex_num) > FullUploadThreshold * static_cast<float>(VerticesCount);
+}
+
+void ObjectGL::uploadDirtyRanges(std::vector<VertexRange>& ranges, int step)
+{
+   assert( CopyPolicy == KeepCPUCopy );
+
+   if (ranges.empty()) return;
+   if (isDynamic()) {
+      writeDynamicRegion();
+      return;
+   }
+
+   mergeVertexRanges( ranges );
+   if (needsFullUpload( ranges )) {
+      const auto size = static_cast<GLsizeiptr>(sizeof( GLfloat ) * VerticesCount * step);
+      glNamedBufferSubData( getVertexBuffer(), VertexBufferOffset, size, DataBuffer.data() );
+      return;
+   }
+   for (const auto& range : ranges) {
+      glNamedBufferSubData(
+         getVertexBuffer(),
+         VertexBufferOffset + static_cast<GLintptr>(sizeof( GLfloat ) * range.first * step),
+         static_cast<GLsizeiptr>(sizeof( GLfloat ) * (range.second - range.first) * step),
+         DataBuffer.data() + range.first * step
+      );
+   }
+}
+
+void ObjectGL::writePositions(const GLfloat* vertices, size_t vertex_num, int step)
+{
+   assert( VertexStride != 0 );
+   assert( vertex_num <= AllocatedVertexNum );
+
+   VerticesCount = static_cast<GLsizei>(vertex_num);
+   const auto size = static_cast<GLsizeiptr>(sizeof( GLfloat ) * VerticesCount * step);
+   Bounds = BoundingVolume::get( vertices, 3, vertex_num );
+   if (size == 0) return;
+
+   if (CopyPolicy == KeepCPUCopy) {
+      assert( DataBuffer.size() >= vertex_num * step );
+
+      // The CPU copy tells which vertices actually moved, so only those are uploaded.
+      std::vector<VertexRange> dirty_ranges;
+      for (size_t i = 0; i < vertex_num; ++i) {
+         GLfloat* destination = DataBuffer.data() + i * step;
+         const GLfloat* source = vertices + i * 3;
+         if (destination[0] == source[0] && destination[1] == source[1] && destination[2] == source[2]) continue;
+
+         destination[0] = source[0];
+         destination[1] = source[1];
+         destination[2] = source[2];
+         if (!dirty_ranges.empty() && dirty_ranges.back().second == i) dirty_ranges.back().second = i + 1;
+         else dirty_ranges.emplace_back( i, i + 1 );
+      }
+      uploadDirtyRanges( dirty_ranges, step );
+      return;
+   }
+
+   // Mapping without invalidation keeps the normals and textures between the positions.
+   auto* destination = static_cast<GLfloat*>(
+      glMapNamedBufferRange( getVertexBuffer(), VertexBufferOffset, size, GL_MAP_WRITE_BIT )
+   );
+   if (destination == nullptr) {
+      std::cerr << "Could not map the vertex buffer\n";
+      return;
+   }
+   for (size_t i = 0; i < vertex_num; ++i) {
+      destination[i * step] = vertices[i * 3];
+      destination[i * step + 1] = vertices[i * 3 + 1];
+      destination[i * step + 2] = vertices[i * 3 + 2];
+   }
+   glUnmapNamedBuffer( getVertexBuffer() );
+}
+
+void ObjectGL::writePositions(const GLfloat* vertices, const std::vector<GLuint>& indices, int step)
+{
+   assert( VertexStride != 0 );
+   if (indices.empty()) return;
+
+   if (CopyPolicy == KeepCPUCopy) {
+      // The bounds only need to be fitted again when a vertex leaves the boundary; otherwise they just grow.
+      bool boundary_moved = false;
+      std::vector<VertexRange> dirty_ranges;
+      dirty_ranges.reserve( indices.size() );
+      for (size_t i = 0; i < indices.size(); ++i) {
+         assert( indices[i] < static_cast<GLuint>(VerticesCount) );
+
+         GLfloat* destination = DataBuffer.data() + static_cast<size_t>(indices[i]) * step;
+         const glm::vec3 position(vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2]);
+         const glm::vec3 old_position(destination[0], destination[1], destination[2]);
+         if (position != old_position && Bounds.touchesBoundary( old_position )) boundary_moved = true;
+         Bounds.expand( position );
+         destination[0] = position.x;
+         destination[1] = position.y;
+         destination[2] = position.z;
+         dirty_ranges.emplace_back( indices[i], indices[i] + 1 );
+      }
+      if (boundary_moved) Bounds = BoundingVolume::get( DataBuffer.data(), step, static_cast<size_t>(VerticesCount) );
+      uploadDirtyRanges( dirty_ranges, step );
+      return;
+   }
+
+   // The other vertices are only in the GL buffer, so the bounds can grow but never shrink.
+   for (size_t i = 0; i < indices.size(); ++i) {
+      Bounds.expand( glm::vec3(vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2]) );
+   }
+
+   // Without a CPU copy, each merged range is mapped on its own and only its positions are written.
+   std::vector<std::pair<GLuint, size_t>> sorted_indices(indices.size());
+   std::vector<VertexRange> dirty_ranges(indices.size());
+   for (size_t i = 0; i < indices.size(); ++i) {
+      assert( indices[i] < static_cast<GLuint>(VerticesCount) );
+
+      sorted_indices[i] = { indices[i], i };
+      dirty_ranges[i] = { indices[i], indices[i] + 1 };
+   }
+   std::sort( sorted_indices.begin(), sorted_indices.end() );
+   mergeVertexRanges( dirty_ranges );
+   if (needsFullUpload( dirty_ranges )) dirty_ranges = { { 0, static_cast<size_t>(VerticesCount) } };
+
+   auto index = sorted_indices.cbegin();
+   for (const auto& range : dirty_ranges) {
+      auto* destination = static_cast<GLfloat*>(glMapNamedBufferRange(
+         getVertexBuffer(),
+         VertexBufferOffset + static_cast<GLintptr>(sizeof( GLfloat ) * range.first * step),
+         static_cast<GLsizeiptr>(sizeof( GLfloat ) * (range.second - range.first) * step),
+         GL_MAP_WRITE_BIT
+      ));
+      if (destination == nullptr) {
+         std::cerr << "Could not map the vertex buffer\n";
+         return;
+      }
+      for (; index != sorted_indices.cend() && index->first < range.second; ++index) {
+         GLfloat* vertex = destination + (index->first - range.first) * step;
+         vertex[0] = vertices[index->second * 3];
+         vertex[1] = vertices[index->second * 3 + 1];
+         vertex[2] = vertices[index->second * 3 + 2];
+      }
+      glUnmapNamedBuffer( getVertexBuffer() );
    }
-   glNamedBufferSubData( VBO, 0, static_cast<GLsizeiptr>(sizeof( GLfloat ) * DataBuffer.size()), DataBuffer.data() );
 }
 
 void ObjectGL::replaceVertices(
@@ -366,19 +1285,10 @@ void ObjectGL::replaceVertices(
    bool textures_exist
 )
 {
-   assert( VBO != 0 );
+   assert( VAO != 0 );
 
-   VerticesCount = 0;
-   int step = 3;
-   if (normals_exist) step += 3;
-   if (textures_exist) step += 2;
-   for (size_t i = 0; i < vertices.size(); ++i) {
-      DataBuffer[i * step] = vertices[i].x;
-      DataBuffer[i * step + 1] = vertices[i].y;
-      DataBuffer[i * step + 2] = vertices[i].z;
-      VerticesCount++;
-   }
-   glNamedBufferSubData( VBO, 0, static_cast<GLsizeiptr>(sizeof( GLfloat ) * VerticesCount * step), DataBuffer.data() );
+   const int step = getPositionStep( normals_exist, textures_exist );
+   writePositions( reinterpret_cast<const GLfloat*>(vertices.data()), vertices.size(), step );
 }
 
 void ObjectGL::replaceVertices(
@@ -387,17 +1297,22 @@ void ObjectGL::replaceVertices(
    bool textures_exist
 )
 {
-   assert( VBO != 0 );
+   assert( VAO != 0 );
 
-   VerticesCount = 0;
-   int step = 3;
-   if (normals_exist) step += 3;
-   if (textures_exist) step += 2;
-   for (size_t i = 0, j = 0; i < vertices.size(); i += 3, ++j) {
-      DataBuffer[j * step] = vertices[i];
-      DataBuffer[j * step + 1] = vertices[i + 1];
-      DataBuffer[j * step + 2] = vertices[i + 2];
-      VerticesCount++;
-   }
-   glNamedBufferSubData( VBO, 0, static_cast<GLsizeiptr>(sizeof( GLfloat ) * VerticesCount * step), DataBuffer.data() );
-}
\ No newline at end of file
+   const int step = getPositionStep( normals_exist, textures_exist );
+   writePositions( vertices.data(), vertices.size() / 3, step );
+}
+
+void ObjectGL::replaceVertices(
+   const std::vector<glm::vec3>& vertices,
+   const std::vector<GLuint>& indices,
+   bool normals_exist,
+   bool textures_exist
+)
+{
+   assert( VAO != 0 );
+   assert( vertices.size() >= indices.size() );
+
+   const int step = getPositionStep( normals_exist, textures_exist );
+   writePositions( reinterpret_cast<const GLfloat*>(vertices.data()), indices, step );
+}
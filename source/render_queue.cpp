@@ -0,0 +1,119 @@
+#include "render_queue.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cstring>
+
+uint64_t RenderQueue::getKey(
+   Pass pass,
+   uint32_t program,
+   uint32_t material,
+   uint32_t texture,
+   uint32_t mesh,
+   float depth
+)
+{
+   // The bits of a non-negative float order the same way as its value, so the top bits after the sign bit are a
+   // coarse depth without any knowledge of the depth range.
+   uint32_t depth_bits;
+   const float clamped_depth = std::max( depth, 0.0f );
+   std::memcpy( &depth_bits, &clamped_depth, sizeof( depth_bits ) );
+   depth_bits >>= 31 - DepthBits;
+   if (pass == Transparent) depth_bits = ~depth_bits & ((1u << DepthBits) - 1);
+
+   const auto field = [](uint32_t value, int bits, int shift) {
+      return static_cast<uint64_t>(value & ((1u << bits) - 1)) << shift;
+   };
+   return static_cast<uint64_t>(pass) << PassShift |
+      field( program, ProgramBits, ProgramShift ) |
+      field( material, MaterialBits, MaterialShift ) |
+      field( texture, TextureBits, TextureShift ) |
+      field( mesh, MeshBits, MeshShift ) |
+      depth_bits;
+}
+
+RenderQueue::StateChanges RenderQueue::countStateChanges(const std::vector<Item>& items)
+{
+   StateChanges changes;
+   for (size_t i = 0; i < items.size(); ++i) {
+      const uint64_t key = items[i].Key;
+      const bool first = i == 0;
+      const uint64_t previous = first ? 0 : items[i - 1].Key;
+      const auto differs = [&](int shift, int bits) {
+         return first || getField( key, shift, bits ) != getField( previous, shift, bits );
+      };
+      // A new pass counts as a new program.
+      if (differs( ProgramShift, ProgramBits + 2 )) ++changes.ProgramChanges;
+      if (differs( MaterialShift, MaterialBits )) ++changes.MaterialChanges;
+      if (differs( TextureShift, TextureBits )) ++changes.TextureChanges;
+      if (differs( MeshShift, MeshBits )) ++changes.MeshChanges;
+   }
+   return changes;
+}
+
+void RenderQueue::radixSort()
+{
+   constexpr int digit_bits = 8;
+   constexpr size_t digit_num = 1 << digit_bits;
+   constexpr size_t min_chunk_size = 1 << 14;
+
+   uint64_t all_ones = ~uint64_t{ 0 }, any_ones = 0;
+   for (const auto& item : Items) {
+      all_ones &= item.Key;
+      any_ones |= item.Key;
+   }
+   const uint64_t varying_bits = all_ones ^ any_ones;
+
+   // Each chunk counts its own digits, and the offsets go digit by digit and then chunk by chunk, which keeps the
+   // scatter stable however the chunks are spread over the threads.
+   ThreadPool& pool = ThreadPool::getInstance();
+   const size_t item_num = Items.size();
+   const size_t chunk_num = std::clamp(
+      item_num / min_chunk_size, size_t{ 1 }, static_cast<size_t>(pool.getThreadNum()) * 4
+   );
+   const size_t chunk_size = (item_num + chunk_num - 1) / chunk_num;
+   std::vector<std::array<size_t, digit_num>> offsets(chunk_num);
+   SortBuffer.resize( item_num );
+   for (int shift = 0; shift < 64; shift += digit_bits) {
+      if (((varying_bits >> shift) & (digit_num - 1)) == 0) continue;
+
+      pool.parallelFor(
+         chunk_num, 1,
+         [&](size_t chunk_begin, size_t chunk_end) {
+            for (size_t c = chunk_begin; c < chunk_end; ++c) {
+               offsets[c].fill( 0 );
+               const size_t end = std::min( (c + 1) * chunk_size, item_num );
+               for (size_t i = c * chunk_size; i < end; ++i) ++offsets[c][(Items[i].Key >> shift) & (digit_num - 1)];
+            }
+         }
+      );
+      size_t offset = 0;
+      for (size_t d = 0; d < digit_num; ++d) {
+         for (size_t c = 0; c < chunk_num; ++c) {
+            const size_t count = offsets[c][d];
+            offsets[c][d] = offset;
+            offset += count;
+         }
+      }
+      pool.parallelFor(
+         chunk_num, 1,
+         [&](size_t chunk_begin, size_t chunk_end) {
+            for (size_t c = chunk_begin; c < chunk_end; ++c) {
+               const size_t end = std::min( (c + 1) * chunk_size, item_num );
+               for (size_t i = c * chunk_size; i < end; ++i) {
+                  SortBuffer[offsets[c][(Items[i].Key >> shift) & (digit_num - 1)]++] = Items[i];
+               }
+            }
+         }
+      );
+      Items.swap( SortBuffer );
+   }
+}
+
+void RenderQueue::sort()
+{
+   Stats.DrawNum = Items.size();
+   Stats.Submitted = countStateChanges( Items );
+   if (Items.size() > 1) radixSort();
+   Stats.Sorted = countStateChanges( Items );
+}
@@ -1,10 +1,24 @@
 #include "renderer.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <array>
+#include <limits>
 
 RendererGL::RendererGL() : 
    Window( nullptr ), FrameWidth( 1920 ), FrameHeight( 1080 ), ClickedPoint( -1, -1 ),
    MainCamera( std::make_unique<CameraGL>() ), ObjectShader( std::make_unique<ShaderGL>() ),
-   Object( std::make_unique<ObjectGL>() ), Lights( std::make_unique<LightGL>() ), DrawMovingObject( false ),
-   ObjectRotationAngle( 0 )
+   ClusterCullShader( std::make_unique<ClusterCullShaderGL>() ),
+   InstanceCullShader( std::make_unique<InstanceCullShaderGL>() ), HiZShader( std::make_unique<HiZShaderGL>() ),
+   SkinningShader( std::make_unique<SkinningShaderGL>() ), MorphShader( std::make_unique<MorphShaderGL>() ),
+   Arena( std::make_unique<GeometryArenaGL>() ),
+   Object( std::make_unique<ObjectGL>() ), Lights( std::make_unique<LightGL>() ),
+   StressScene( std::make_unique<StressSceneGL>() ), Scene( std::make_unique<SceneGraph>() ),
+   Batcher( std::make_unique<IndirectBatcherGL>() ), Queue( std::make_unique<RenderQueue>() ),
+   CommandLists( std::make_unique<CommandListSetGL>() ), HiZ( std::make_unique<HiZBufferGL>() ),
+   ObjectPivot( SceneGraph::NoNode ), ObjectNode( SceneGraph::NoNode ), DrawMovingObject( false ),
+   ObjectRotationAngle( 0 ), StressObjectNum( 0 ), DrawPath( MultiDrawPath ), UseRenderQueue( true ),
+   UseFrustumCulling( true ), UseOcclusionCulling( true ), UseTextureSet( true )
 {
    Renderer = this;
 
@@ -53,6 +67,11 @@ void RendererGL::initialize()
       std::string(shader_directory_path + "/scene_shader.vert").c_str(),
       std::string(shader_directory_path + "/scene_shader.frag").c_str()
    );
+   ClusterCullShader->setComputeShaders( std::string(shader_directory_path + "/cluster_cull.comp").c_str() );
+   InstanceCullShader->setComputeShaders( std::string(shader_directory_path + "/instance_cull.comp").c_str() );
+   HiZShader->setComputeShaders( std::string(shader_directory_path + "/hi_z.comp").c_str() );
+   SkinningShader->setComputeShaders( std::string(shader_directory_path + "/skinning.comp").c_str() );
+   MorphShader->setComputeShaders( std::string(shader_directory_path + "/morph.comp").c_str() );
 }
 
 void RendererGL::error(int e, const char* description)
@@ -101,6 +120,35 @@ void RendererGL::keyboard(GLFWwindow* window, int key, int scancode, int action,
       case GLFW_KEY_SPACE:
          DrawMovingObject = !DrawMovingObject;
          break;
+      case GLFW_KEY_G:
+         toggleStressScene();
+         break;
+      case GLFW_KEY_B: {
+         const char* names[StressDrawPathNum] = {
+            "Multi-Draw Indirect", "Instancing", "Command Lists", "GPU Culling"
+         };
+         DrawPath = static_cast<StressDrawPath>((DrawPath + 1) % StressDrawPathNum);
+         std::cout << "Stress Scene Drawn with " << names[DrawPath] << "\n";
+      } break;
+      case GLFW_KEY_R:
+         UseRenderQueue = !UseRenderQueue;
+         std::cout << "Render Queue " << (UseRenderQueue ? "On!\n" : "Off!\n");
+         break;
+      case GLFW_KEY_T:
+         printRenderQueueStatistics();
+         break;
+      case GLFW_KEY_C:
+         UseFrustumCulling = !UseFrustumCulling;
+         std::cout << "Frustum Culling " << (UseFrustumCulling ? "On!\n" : "Off!\n");
+         break;
+      case GLFW_KEY_O:
+         UseOcclusionCulling = !UseOcclusionCulling;
+         std::cout << "Occlusion Culling " << (UseOcclusionCulling ? "On!\n" : "Off!\n");
+         break;
+      case GLFW_KEY_X:
+         UseTextureSet = !UseTextureSet;
+         std::cout << "Texture Set " << (UseTextureSet ? "On!\n" : "Off!\n");
+         break;
       case GLFW_KEY_P: {
          const glm::vec3 pos = MainCamera->getCameraPosition();
          std::cout << "Camera Position: " << pos.x << ", " << pos.y << ", " << pos.z << "\n";
@@ -199,10 +247,18 @@ void RendererGL::setLights() const
    );  
 }
 
-void RendererGL::setObject() const
+void RendererGL::setObject()
 {
    if (Object->getVAO() != 0) return;
 
+   // The unit square is scaled by 20 about its center and moved 50 units away.
+   ObjectPivot = Scene->addNode();
+   ObjectNode = Scene->addNode( ObjectPivot );
+   Scene->setTranslation( ObjectNode, glm::vec3(-10.0f, -10.0f, -50.0f) );
+   Scene->setScale( ObjectNode, glm::vec3(20.0f) );
+   Scene->update();
+
+   Object->setGeometryArena( Arena.get() );
    Object->setSquareObject(
       GL_TRIANGLES,
       std::string(CMAKE_SOURCE_DIR) + "/emoy.png",
@@ -213,63 +269,573 @@ void RendererGL::setObject() const
    Object->setDiffuseReflectionColor( diffuse_color );
 }
 
-void RendererGL::drawObject(const float& scale_factor) const
+float RendererGL::getProjectedRadius(const ObjectGL& object, const glm::mat4& to_world) const
+{
+   const float scale = std::max( {
+      glm::length( glm::vec3(to_world[0]) ),
+      glm::length( glm::vec3(to_world[1]) ),
+      glm::length( glm::vec3(to_world[2]) )
+   } );
+   const float radius = object.getBoundingSphereRadius() * scale;
+   const glm::vec4 center = MainCamera->getViewMatrix() * to_world * glm::vec4(object.getBoundingSphereCenter(), 1.0f);
+   const float depth = -center.z;
+   if (depth <= radius) return std::numeric_limits<float>::max();
+
+   const float pixels_per_unit = MainCamera->getProjectionMatrix()[1][1] * 0.5f * static_cast<float>(FrameHeight);
+   return radius * pixels_per_unit / depth;
+}
+
+void RendererGL::skinObject(const ObjectGL& object) const
+{
+   using s = SkinningShaderGL::UNIFORM;
+   using b = SkinningShaderGL::BINDING;
+
+   const ObjectGL::SkinLayout layout = object.getSkinLayout();
+   SkinningShader->uniform1ui( s::VertexNum, static_cast<uint>(object.getVertexNum()) );
+   SkinningShader->uniform1ui( s::FirstFloat, layout.FirstFloat );
+   SkinningShader->uniform1ui( s::PositionStride, layout.PositionStride );
+   SkinningShader->uniform1ui( s::NormalOffset, layout.NormalOffset );
+   SkinningShader->uniform1ui( s::NormalStride, layout.NormalStride );
+   SkinningShader->uniform1ui( s::SourceFirstFloat, object.isMorphed() ? layout.FirstFloat : 0 );
+   glBindBufferBase(
+      GL_SHADER_STORAGE_BUFFER,
+      b::BindPoseBuffer,
+      object.isMorphed() ? object.getVertexBuffer() : object.getBindPoseBuffer()
+   );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::SkinWeightBuffer, object.getSkinWeightBuffer() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::BoneBuffer, object.getBoneBuffer() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::VertexBuffer, object.getVertexBuffer() );
+   glUseProgram( SkinningShader->getShaderProgram() );
+   glDispatchCompute( (object.getVertexNum() + 63) / 64, 1, 1 );
+   glMemoryBarrier( GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT );
+}
+
+void RendererGL::morphObject(const ObjectGL& object) const
+{
+   using s = MorphShaderGL::UNIFORM;
+   using b = MorphShaderGL::BINDING;
+
+   const ObjectGL::SkinLayout layout = object.getSkinLayout();
+   const std::vector<float>& weights = object.getMorphWeights();
+   MorphShader->uniform1ui( s::VertexNum, static_cast<uint>(object.getVertexNum()) );
+   MorphShader->uniform1ui( s::FirstFloat, layout.FirstFloat );
+   MorphShader->uniform1ui( s::PositionStride, layout.PositionStride );
+   MorphShader->uniform1ui( s::NormalOffset, layout.NormalOffset );
+   MorphShader->uniform1ui( s::NormalStride, layout.NormalStride );
+   MorphShader->uniform1fv( s::Weights, static_cast<int>(weights.size()), weights.data() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::BindPoseBuffer, object.getBindPoseBuffer() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::DeltaBuffer, object.getMorphDeltaBuffer() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::RangeBuffer, object.getMorphRangeBuffer() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::VertexBuffer, object.getVertexBuffer() );
+   glUseProgram( MorphShader->getShaderProgram() );
+   glDispatchCompute( (object.getVertexNum() + 63) / 64, 1, 1 );
+   // Skinning reads what morphing wrote as storage, and drawing reads it as vertices.
+   glMemoryBarrier( GL_SHADER_STORAGE_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT );
+}
+
+void RendererGL::drawMeshlets(const ObjectGL& object, const glm::mat4& to_world) const
+{
+   using c = ClusterCullShaderGL::UNIFORM;
+   using b = ClusterCullShaderGL::BINDING;
+
+   // The model-view-projection matrix gives the frustum planes in object space.
+   const std::array<glm::vec4, 6> planes = CameraGL::getFrustumPlanes(
+      MainCamera->getProjectionMatrix() * MainCamera->getViewMatrix() * to_world
+   );
+   const glm::vec3 camera_position =
+      glm::inverse( to_world ) * glm::vec4(MainCamera->getCameraPosition(), 1.0f);
+
+   ClusterCullShader->uniform4fv( c::FrustumPlanes, 6, glm::value_ptr( planes[0] ) );
+   ClusterCullShader->uniform3fv( c::CameraPosition, camera_position );
+   ClusterCullShader->uniform1ui( c::MeshletNum, static_cast<uint>(object.getMeshletNum()) );
+   ClusterCullShader->uniform1i( c::BaseVertex, object.getBaseVertex() );
+   ClusterCullShader->uniform1ui( c::FirstIndex, object.getFirstIndex() );
+   glClearNamedBufferData(
+      object.getMeshletDrawCountBuffer(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr
+   );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::MeshletBuffer, object.getMeshletBuffer() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::CommandBuffer, object.getMeshletCommandBuffer() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::DrawCountBuffer, object.getMeshletDrawCountBuffer() );
+   glUseProgram( ClusterCullShader->getShaderProgram() );
+   glDispatchCompute( (object.getMeshletNum() + 63) / 64, 1, 1 );
+   glMemoryBarrier( GL_COMMAND_BARRIER_BIT );
+
+   glUseProgram( ObjectShader->getShaderProgram() );
+   glBindVertexArray( object.getVAO() );
+   glBindBuffer( GL_DRAW_INDIRECT_BUFFER, object.getMeshletCommandBuffer() );
+   glBindBuffer( GL_PARAMETER_BUFFER, object.getMeshletDrawCountBuffer() );
+   glMultiDrawElementsIndirectCount(
+      object.getDrawMode(), object.getIndexType(), nullptr, 0, object.getMeshletNum(), 0
+   );
+   glBindBuffer( GL_PARAMETER_BUFFER, 0 );
+   glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+}
+
+void RendererGL::toggleStressScene()
+{
+   constexpr size_t max_object_num = 1000000;
+   StressObjectNum = StressObjectNum == 0 ? 1000 : StressObjectNum * 10;
+   if (StressObjectNum > max_object_num) {
+      StressObjectNum = 0;
+      std::cout << "Stress Scene Off!\n";
+      return;
+   }
+
+   StressSceneGL::Description description;
+   description.ObjectNum = StressObjectNum;
+   const auto start = std::chrono::steady_clock::now();
+   StressScene->generate( description, Arena.get() );
+   // The grid is moved in front of the initial camera, far enough for all of it to be in view.
+   SceneGraph& graph = StressScene->getSceneGraph();
+   graph.setTranslation( StressScene->getRoot(), glm::vec3(0.0f, 0.0f, -4.0f * StressScene->getExtent()) );
+   StressScene->updateTransforms();
+   const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+   std::cout << "Stress Scene: " << StressObjectNum << " objects generated in " << elapsed.count() << " ms\n";
+}
+
+void RendererGL::printRenderQueueStatistics() const
+{
+   const RenderQueue::Statistics& statistics = Queue->getStatistics();
+   const auto print = [&statistics](const char* name, size_t submitted, size_t sorted) {
+      std::cout << " - " << name << " changes: " << submitted << " submitted, " << sorted << " sorted\n";
+   };
+   std::cout << "Render Queue: " << statistics.DrawNum << " draws in the last sorted frame\n";
+   print( "Program", statistics.Submitted.ProgramChanges, statistics.Sorted.ProgramChanges );
+   print( "Material", statistics.Submitted.MaterialChanges, statistics.Sorted.MaterialChanges );
+   print( "Texture", statistics.Submitted.TextureChanges, statistics.Sorted.TextureChanges );
+   print( "Mesh", statistics.Submitted.MeshChanges, statistics.Sorted.MeshChanges );
+}
+
+void RendererGL::setLightUniforms(LightGL& lights) const
 {
    using u = ShaderGL::UNIFORM;
    using l = ShaderGL::LIGHT_UNIFORM;
+
+   ObjectShader->uniform1i( u::UseLight, lights.isLightOn() ? 1 : 0 );
+   if (lights.isLightOn()) {
+      ObjectShader->uniform1i( u::LightNum, lights.getTotalLightNum() );
+      ObjectShader->uniform4fv( u::GlobalAmbient, lights.getGlobalAmbientColor() );
+      for (int i = 0; i < lights.getTotalLightNum(); ++i) {
+         const int offset = u::Lights + l::UniformNum * i;
+         ObjectShader->uniform1i( offset + l::LightSwitch, lights.isActivated( i ) ? 1 : 0 );
+         ObjectShader->uniform4fv( offset + l::LightPosition, lights.getPosition( i ) );
+         ObjectShader->uniform4fv( offset + l::LightAmbientColor, lights.getAmbientColors( i ) );
+         ObjectShader->uniform4fv( offset + l::LightDiffuseColor, lights.getDiffuseColors( i ) );
+         ObjectShader->uniform4fv( offset + l::LightSpecularColor, lights.getSpecularColors( i ) );
+         ObjectShader->uniform3fv( offset + l::SpotlightDirection, lights.getSpotlightDirections( i ) );
+         ObjectShader->uniform1f( offset + l::SpotlightCutoffAngle, lights.getSpotlightCutoffAngles( i ) );
+         ObjectShader->uniform1f( offset + l::SpotlightFeather, lights.getSpotlightFeathers( i ) );
+         ObjectShader->uniform1f( offset + l::FallOffRadius, lights.getFallOffRadii( i ) );
+      }
+   }
+}
+
+void RendererGL::drawObject() const
+{
+   using u = ShaderGL::UNIFORM;
    using m = ShaderGL::MATERIAL_UNIFORM;
 
    MainCamera->updateWindowSize( FrameWidth, FrameHeight );
    glViewport( 0, 0, FrameWidth, FrameHeight );
 
+   if (Object->isMorphed()) morphObject( *Object );
+   if (Object->isSkinned()) skinObject( *Object );
+
    glBindFramebuffer( GL_FRAMEBUFFER, 0 );
    glUseProgram( ObjectShader->getShaderProgram() );
 
-   const glm::mat4 to_origin = glm::translate( glm::mat4(1.0f), glm::vec3(-0.5f, -0.5f, 0.0f) );
-   const glm::mat4 scale_matrix = glm::scale( glm::mat4(1.0f), glm::vec3(scale_factor, scale_factor, scale_factor) );
-   const glm::mat4 move_back = glm::translate( glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -50.0f) );
-   glm::mat4 to_world = move_back * scale_matrix * to_origin;
-   if (DrawMovingObject) {
-      to_world = rotate( glm::mat4(1.0f), static_cast<float>(ObjectRotationAngle), glm::vec3(0.0f, 0.0f, 1.0f) ) * to_world;
-   }
+   const glm::mat4& to_world = Scene->getWorldMatrix( ObjectNode );
 
    ObjectShader->uniformMat4fv( u::WorldMatrix, to_world );
    ObjectShader->uniformMat4fv( u::ViewMatrix, MainCamera->getViewMatrix() );
    ObjectShader->uniformMat4fv( u::ModelViewProjectionMatrix, MainCamera->getProjectionMatrix() * MainCamera->getViewMatrix() * to_world );
    ObjectShader->uniform1i( u::UseTexture, 1 );
+   ObjectShader->uniform1i( u::UseInstancing, 0 );
+   ObjectShader->uniform1i( u::TextureMode, ShaderGL::BoundTexture );
    ObjectShader->uniform4fv( u::Material + m::EmissionColor, Object->getEmissionColor() );
    ObjectShader->uniform4fv( u::Material + m::AmbientColor, Object->getAmbientReflectionColor() );
    ObjectShader->uniform4fv( u::Material + m::DiffuseColor, Object->getDiffuseReflectionColor() );
    ObjectShader->uniform4fv( u::Material + m::SpecularColor, Object->getSpecularReflectionColor() );
    ObjectShader->uniform1f( u::Material + m::SpecularExponent, Object->getSpecularReflectionExponent() );
-   ObjectShader->uniform1i( u::UseLight, Lights->isLightOn() ? 1 : 0 );
-   if (Lights->isLightOn()) {
-      ObjectShader->uniform1i( u::LightNum, Lights->getTotalLightNum() );
-      ObjectShader->uniform4fv( u::GlobalAmbient, Lights->getGlobalAmbientColor() );
-      for (int i = 0; i < Lights->getTotalLightNum(); ++i) {
-         const int offset = u::Lights + l::UniformNum * i;
-         ObjectShader->uniform1i( offset + l::LightSwitch, Lights->isActivated( i ) ? 1 : 0 );
-         ObjectShader->uniform4fv( offset + l::LightPosition, Lights->getPosition( i ) );
-         ObjectShader->uniform4fv( offset + l::LightAmbientColor, Lights->getAmbientColors( i ) );
-         ObjectShader->uniform4fv( offset + l::LightDiffuseColor, Lights->getDiffuseColors( i ) );
-         ObjectShader->uniform4fv( offset + l::LightSpecularColor, Lights->getSpecularColors( i ) );
-         ObjectShader->uniform3fv( offset + l::SpotlightDirection, Lights->getSpotlightDirections( i ) );
-         ObjectShader->uniform1f( offset + l::SpotlightCutoffAngle, Lights->getSpotlightCutoffAngles( i ) );
-         ObjectShader->uniform1f( offset + l::SpotlightFeather, Lights->getSpotlightFeathers( i ) );
-         ObjectShader->uniform1f( offset + l::FallOffRadius, Lights->getFallOffRadii( i ) );
-      }
-   }
+   setLightUniforms( *Lights );
 
    glBindTextureUnit( 0, Object->getTextureID( 0 ) );
    glBindVertexArray( Object->getVAO() );
-   glDrawArrays( Object->getDrawMode(), 0, Object->getVertexNum() );
+   if (Object->getMeshletNum() > 0) drawMeshlets( *Object, to_world );
+   else if (Object->isIndexed()) {
+      GLsizei first_index = 0, index_num = Object->getIndexNum();
+      if (Object->getLODNum() > 0) {
+         const ObjectGL::LOD& lod = Object->getLOD( Object->selectLOD( getProjectedRadius( *Object, to_world ) ) );
+         first_index = lod.FirstIndex;
+         index_num = lod.IndexNum;
+      }
+      const auto offset = static_cast<size_t>(Object->getFirstIndex() + first_index) *
+         ObjectGL::getComponentSize( Object->getIndexType() );
+      glDrawElementsBaseVertex(
+         Object->getDrawMode(),
+         index_num,
+         Object->getIndexType(),
+         reinterpret_cast<const void*>(offset),
+         Object->getBaseVertex()
+      );
+   }
+   else glDrawArrays( Object->getDrawMode(), Object->getBaseVertex(), Object->getVertexNum() );
+}
+
+void RendererGL::drawInstances(const ObjectGL& object, GLsizei first_instance, GLsizei instance_num) const
+{
+   using b = ShaderGL::BINDING;
+
+   assert( object.isInstanced() && first_instance + instance_num <= object.getInstanceNum() );
+
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::InstanceBuffer, object.getInstanceBuffer() );
+   if (object.getInstanceMaterialBuffer() != 0) {
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::InstanceMaterialBuffer, object.getInstanceMaterialBuffer() );
+   }
+   glBindVertexArray( object.getVAO() );
+   if (object.isIndexed()) {
+      glDrawElementsInstancedBaseVertexBaseInstance(
+         object.getDrawMode(),
+         object.getIndexNum(),
+         object.getIndexType(),
+         reinterpret_cast<const void*>(
+            static_cast<size_t>(object.getFirstIndex()) * ObjectGL::getComponentSize( object.getIndexType() )
+         ),
+         instance_num,
+         object.getBaseVertex(),
+         static_cast<GLuint>(first_instance)
+      );
+   }
+   else {
+      glDrawArraysInstancedBaseInstance(
+         object.getDrawMode(),
+         object.getBaseVertex(),
+         object.getVertexNum(),
+         instance_num,
+         static_cast<GLuint>(first_instance)
+      );
+   }
+}
+
+GLuint RendererGL::getStressBoundTexture(int texture) const
+{
+   if (texture < 0 || usesTextureSet()) return 0;
+   return StressScene->getTextureID( texture );
+}
+
+void RendererGL::batchStressScene() const
+{
+   Batcher->clear();
+   if (!UseRenderQueue) {
+      StressScene->forEachVisibleRun(
+         [this](const StressSceneGL::Batch& batch, GLsizei first_instance, GLsizei instance_num) {
+            const ObjectGL& shape = StressScene->getShape( batch.Shape );
+            const GLuint texture_id = getStressBoundTexture( batch.Texture );
+            const ObjectGL::Instance* instances = StressScene->getShapeInstances( batch.Shape ).data();
+            Batcher->add( shape, texture_id, instances + first_instance, instance_num );
+         }
+      );
+      Batcher->build();
+      return;
+   }
+
+   sortStressScene();
+   const std::vector<StressSceneGL::Instance>& instances = StressScene->getInstances();
+   const SceneGraph& graph = StressScene->getSceneGraph();
+   for (const auto& item : Queue->getItems()) {
+      const StressSceneGL::Instance& instance = instances[item.Payload];
+      const GLuint texture_id = getStressBoundTexture( instance.Texture );
+      Batcher->add(
+         StressScene->getShape( instance.Shape ), texture_id, graph.getWorldMatrix( instance.Node ), item.Payload
+      );
+   }
+   Batcher->build();
+}
+
+void RendererGL::sortStressScene() const
+{
+   // Every visible instance is submitted on its own with the depth of its origin and its index as the payload.
+   // All of them share the program and the material buffer. The arena shapes all share one VAO, so the shape index
+   // is the mesh ID that puts draws of the same mesh next to each other for the batcher to merge.
+   const std::vector<StressSceneGL::Instance>& instances = StressScene->getInstances();
+   const std::vector<uint32_t>& visible = StressScene->getCuller().getVisibleIndices();
+   const glm::mat4& view = MainCamera->getViewMatrix();
+   const GLuint program = ObjectShader->getShaderProgram();
+   Queue->resize( visible.size() );
+   ThreadPool::getInstance().parallelFor(
+      visible.size(), 1 << 12,
+      [&](size_t begin, size_t end) {
+         for (size_t k = begin; k < end; ++k) {
+            const ObjectGL::Instance& draw = StressScene->getDrawInstance( visible[k] );
+            const StressSceneGL::Instance& instance = instances[draw.MaterialIndex];
+            const float depth = -(view * draw.WorldMatrix[3]).z;
+            const GLuint texture_id = getStressBoundTexture( instance.Texture );
+            const uint64_t key = RenderQueue::getKey(
+               RenderQueue::Opaque, program, 0, texture_id, static_cast<uint32_t>(instance.Shape), depth
+            );
+            Queue->setItem( k, key, draw.MaterialIndex );
+         }
+      }
+   );
+   Queue->sort();
+}
+
+void RendererGL::recordStressScene() const
+{
+   using u = ShaderGL::UNIFORM;
+   using m = ShaderGL::MATERIAL_UNIFORM;
+
+   if (UseRenderQueue) sortStressScene();
+   const std::vector<StressSceneGL::Instance>& instances = StressScene->getInstances();
+   const std::vector<RenderQueue::Item>& items = Queue->getItems();
+   const std::vector<uint32_t>& visible = StressScene->getCuller().getVisibleIndices();
+   const SceneGraph& graph = StressScene->getSceneGraph();
+   const glm::mat4 view_projection = MainCamera->getProjectionMatrix() * MainCamera->getViewMatrix();
+   const GLuint program = ObjectShader->getShaderProgram();
+   CommandLists->record(
+      visible.size(), 1 << 10,
+      [&](CommandListGL& list, size_t begin, size_t end) {
+         int use_texture = -1;
+         for (size_t k = begin; k < end; ++k) {
+            const uint32_t index =
+               UseRenderQueue ? items[k].Payload : StressScene->getDrawInstance( visible[k] ).MaterialIndex;
+            const StressSceneGL::Instance& instance = instances[index];
+            const ObjectGL& shape = StressScene->getShape( instance.Shape );
+            const glm::mat4& to_world = graph.getWorldMatrix( instance.Node );
+            list.uniformMat4fv( program, u::WorldMatrix, to_world );
+            list.uniformMat4fv( program, u::ModelViewProjectionMatrix, view_projection * to_world );
+            list.uniform4fv( program, u::Material + m::AmbientColor, instance.DiffuseColor );
+            list.uniform4fv( program, u::Material + m::DiffuseColor, instance.DiffuseColor );
+            list.uniform4fv( program, u::Material + m::SpecularColor, instance.SpecularColor );
+            list.uniform1f( program, u::Material + m::SpecularExponent, instance.SpecularExponent );
+            if (use_texture != (instance.Texture >= 0 ? 1 : 0)) {
+               use_texture = instance.Texture >= 0 ? 1 : 0;
+               list.uniform1i( program, u::UseTexture, use_texture );
+            }
+            if (instance.Texture >= 0) list.bindTextureUnit( 0, StressScene->getTextureID( instance.Texture ) );
+            list.bindVertexArray( shape.getVAO() );
+            list.drawElements(
+               shape.getDrawMode(),
+               shape.getIndexNum(),
+               shape.getIndexType(),
+               static_cast<size_t>(shape.getFirstIndex()) * ObjectGL::getComponentSize( shape.getIndexType() ),
+               1,
+               shape.getBaseVertex(),
+               0
+            );
+         }
+      }
+   );
+}
+
+void RendererGL::drawBatches() const
+{
+   using u = ShaderGL::UNIFORM;
+   using b = ShaderGL::BINDING;
+
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::InstanceBuffer, Batcher->getInstanceBuffer() );
+   glBindBuffer( GL_DRAW_INDIRECT_BUFFER, Batcher->getCommandBuffer() );
+   for (const auto& bucket : Batcher->getBuckets()) {
+      if (bucket.CommandNum == 0) continue;
+
+      ObjectShader->uniform1i( u::UseTexture, bucket.TextureID != 0 ? 1 : 0 );
+      if (bucket.TextureID != 0) glBindTextureUnit( 0, bucket.TextureID );
+      glBindVertexArray( bucket.VAO );
+      glMultiDrawElementsIndirect(
+         bucket.DrawMode,
+         bucket.IndexType,
+         reinterpret_cast<const void*>(
+            static_cast<size_t>(bucket.CommandOffset) * sizeof( ObjectGL::DrawElementsIndirectCommand )
+         ),
+         bucket.CommandNum,
+         0
+      );
+   }
+   glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+}
+
+void RendererGL::cullStressSceneOnGPU(InstanceCullShaderGL::PHASE phase) const
+{
+   using c = InstanceCullShaderGL::UNIFORM;
+   using b = InstanceCullShaderGL::BINDING;
+
+   // Every bounding sphere is in front of planes of (0, 0, 0, 1), so they keep everything while culling is off.
+   std::array<glm::vec4, 6> planes{};
+   if (UseFrustumCulling) planes = MainCamera->getFrustumPlanes();
+   else planes.fill( glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) );
+   InstanceCullShader->uniform4fv( c::FrustumPlanes, 6, glm::value_ptr( planes[0] ) );
+   InstanceCullShader->uniformMat4fv(
+      c::ViewProjectionMatrix, MainCamera->getProjectionMatrix() * MainCamera->getViewMatrix()
+   );
+   InstanceCullShader->uniform1i( c::Phase, phase );
+   if (phase == InstanceCullShaderGL::OcclusionPhase) glBindTextureUnit( 0, HiZ->getPyramid() );
+   glClearNamedBufferData(
+      StressScene->getCulledDrawCountBuffer(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr
+   );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::CommandBuffer, StressScene->getCulledCommandBuffer() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::DrawCountBuffer, StressScene->getCulledDrawCountBuffer() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::VisibilityBuffer, StressScene->getVisibilityBuffer() );
+   glUseProgram( InstanceCullShader->getShaderProgram() );
+
+   // A dispatch per batch appends the visible instances of the batch from the first command of the batch on.
+   const std::vector<StressSceneGL::Batch>& batches = StressScene->getBatches();
+   for (size_t i = 0; i < batches.size(); ++i) {
+      const StressSceneGL::Batch& batch = batches[i];
+      const ObjectGL& shape = StressScene->getShape( batch.Shape );
+      assert( shape.isIndexed() );
+
+      InstanceCullShader->uniform4fv(
+         c::BoundingSphere, glm::vec4(shape.getBoundingSphereCenter(), shape.getBoundingSphereRadius())
+      );
+      InstanceCullShader->uniform3fv( c::BoundingBoxMin, shape.getBoundingBoxMin() );
+      InstanceCullShader->uniform3fv( c::BoundingBoxMax, shape.getBoundingBoxMax() );
+      InstanceCullShader->uniform1ui( c::FirstInstance, static_cast<uint>(batch.FirstInstance) );
+      InstanceCullShader->uniform1ui( c::InstanceNum, static_cast<uint>(batch.InstanceNum) );
+      InstanceCullShader->uniform1ui( c::FirstCommand, static_cast<uint>(batch.FirstDraw) );
+      InstanceCullShader->uniform1ui( c::DrawCountIndex, static_cast<uint>(i) );
+      InstanceCullShader->uniform1ui( c::IndexNum, static_cast<uint>(shape.getIndexNum()) );
+      InstanceCullShader->uniform1ui( c::FirstIndex, shape.getFirstIndex() );
+      InstanceCullShader->uniform1i( c::BaseVertex, shape.getBaseVertex() );
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::InstanceBuffer, shape.getInstanceBuffer() );
+      glDispatchCompute( (batch.InstanceNum + 63) / 64, 1, 1 );
+   }
+   // The visibility flags are read again by the culling of the next frame.
+   glMemoryBarrier( GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT );
+}
+
+void RendererGL::drawCulledStressScene() const
+{
+   using u = ShaderGL::UNIFORM;
+   using b = ShaderGL::BINDING;
+
+   // The culling pass used the binding of the material buffer for its commands.
+   glUseProgram( ObjectShader->getShaderProgram() );
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::InstanceMaterialBuffer, StressScene->getMaterialBuffer() );
+
+   // The commands draw one instance each, whose index the culling pass wrote as the base instance.
+   glBindBuffer( GL_DRAW_INDIRECT_BUFFER, StressScene->getCulledCommandBuffer() );
+   glBindBuffer( GL_PARAMETER_BUFFER, StressScene->getCulledDrawCountBuffer() );
+   const std::vector<StressSceneGL::Batch>& batches = StressScene->getBatches();
+   for (size_t i = 0; i < batches.size(); ++i) {
+      const StressSceneGL::Batch& batch = batches[i];
+      const ObjectGL& shape = StressScene->getShape( batch.Shape );
+      ObjectShader->uniform1i( u::UseTexture, batch.Texture >= 0 ? 1 : 0 );
+      if (batch.Texture >= 0) glBindTextureUnit( 0, StressScene->getTextureID( batch.Texture ) );
+      glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::InstanceBuffer, shape.getInstanceBuffer() );
+      glBindVertexArray( shape.getVAO() );
+      glMultiDrawElementsIndirectCount(
+         shape.getDrawMode(),
+         shape.getIndexType(),
+         reinterpret_cast<const void*>(batch.FirstDraw * sizeof( ObjectGL::DrawElementsIndirectCommand )),
+         static_cast<GLintptr>(i * sizeof( GLuint )),
+         batch.InstanceNum,
+         0
+      );
+   }
+   glBindBuffer( GL_PARAMETER_BUFFER, 0 );
+   glBindBuffer( GL_DRAW_INDIRECT_BUFFER, 0 );
+}
+
+void RendererGL::buildHiZPyramid() const
+{
+   using h = HiZShaderGL::UNIFORM;
+
+   glUseProgram( HiZShader->getShaderProgram() );
+   for (int level = 0; level < HiZ->getLevelNum(); ++level) {
+      // The first level reads the depth buffer, and every other level reads the one below it.
+      glBindTextureUnit( 0, level == 0 ? HiZ->getDepthTexture() : HiZ->getPyramid() );
+      HiZShader->uniform1i( h::SourceLevel, std::max( level - 1, 0 ) );
+      glBindImageTexture( 0, HiZ->getPyramid(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F );
+      const glm::ivec2 size = HiZ->getLevelSize( level );
+      glDispatchCompute( (size.x + 7) / 8, (size.y + 7) / 8, 1 );
+      glMemoryBarrier( GL_TEXTURE_FETCH_BARRIER_BIT );
+   }
+}
+
+void RendererGL::drawStressScene() const
+{
+   using u = ShaderGL::UNIFORM;
+   using m = ShaderGL::MATERIAL_UNIFORM;
+   using b = ShaderGL::BINDING;
+
+   MainCamera->updateWindowSize( FrameWidth, FrameHeight );
+   glViewport( 0, 0, FrameWidth, FrameHeight );
+
+   // Every path draws only what the culler left visible, except that the GPU culls for itself.
+   FrustumCuller& culler = StressScene->getCuller();
+   if (DrawPath != GPUCullingPath) {
+      if (UseFrustumCulling) culler.cull( MainCamera->getFrustumPlanes() );
+      else culler.setAllVisible();
+   }
+
+   // Occlusion culling needs the depth as a texture, so the scene is drawn offscreen and copied to the screen.
+   bool use_occlusion = DrawPath == GPUCullingPath && UseOcclusionCulling;
+   if (use_occlusion) {
+      HiZ->setSize( FrameWidth, FrameHeight );
+      use_occlusion = HiZ->getFramebuffer() != 0;
+   }
+   glBindFramebuffer( GL_FRAMEBUFFER, use_occlusion ? HiZ->getFramebuffer() : 0 );
+   if (use_occlusion) glClear( OPENGL_COLOR_BUFFER_BIT | OPENGL_DEPTH_BUFFER_BIT );
+   glUseProgram( ObjectShader->getShaderProgram() );
+
+   ObjectShader->uniformMat4fv( u::ViewMatrix, MainCamera->getViewMatrix() );
+   ObjectShader->uniformMat4fv( u::ProjectionMatrix, MainCamera->getProjectionMatrix() );
+   ObjectShader->uniform1i( u::UseInstancing, 1 );
+   setLightUniforms( StressScene->getLights() );
+   const TextureSetGL& texture_set = StressScene->getTextureSet();
+   ShaderGL::TEXTURE_MODE texture_mode = ShaderGL::BoundTexture;
+   if (usesTextureSet()) texture_mode = texture_set.isBindless() ? ShaderGL::BindlessTexture : ShaderGL::ArrayTexture;
+   ObjectShader->uniform1i( u::TextureMode, texture_mode );
+   if (texture_mode == ShaderGL::ArrayTexture) {
+      glBindTextureUnit( ShaderGL::TextureArrayUnit, texture_set.getArrayTexture() );
+   }
+   glBindBufferBase( GL_SHADER_STORAGE_BUFFER, b::InstanceMaterialBuffer, StressScene->getMaterialBuffer() );
+
+   if (DrawPath == MultiDrawPath) {
+      batchStressScene();
+      drawBatches();
+      return;
+   }
+   if (DrawPath == GPUCullingPath) {
+      if (!use_occlusion) {
+         cullStressSceneOnGPU( InstanceCullShaderGL::FrustumPhase );
+         drawCulledStressScene();
+         return;
+      }
+      // What was visible in the last frame is drawn first, and what the pyramid of its depth does not hide is
+      // drawn next, so that nothing that comes into view while the camera moves fast is missing for a frame.
+      cullStressSceneOnGPU( InstanceCullShaderGL::LastVisiblePhase );
+      drawCulledStressScene();
+      buildHiZPyramid();
+      cullStressSceneOnGPU( InstanceCullShaderGL::OcclusionPhase );
+      drawCulledStressScene();
+      HiZ->blitToScreen();
+      glBindFramebuffer( GL_FRAMEBUFFER, 0 );
+      return;
+   }
+   if (DrawPath == CommandListPath) {
+      recordStressScene();
+      ObjectShader->uniform1i( u::UseInstancing, 0 );
+      ObjectShader->uniform4fv( u::Material + m::EmissionColor, glm::vec4(0.0f, 0.0f, 0.0f, 1.0f) );
+      CommandLists->execute();
+      return;
+   }
+
+   StressScene->forEachVisibleRun(
+      [this](const StressSceneGL::Batch& batch, GLsizei first_instance, GLsizei instance_num) {
+         ObjectShader->uniform1i( u::UseTexture, batch.Texture >= 0 ? 1 : 0 );
+         if (batch.Texture >= 0) glBindTextureUnit( 0, StressScene->getTextureID( batch.Texture ) );
+         drawInstances( StressScene->getShape( batch.Shape ), first_instance, instance_num );
+      }
+   );
 }
 
 void RendererGL::render() const
 {
    glClear( OPENGL_COLOR_BUFFER_BIT | OPENGL_DEPTH_BUFFER_BIT );
 
-   drawObject( 20.0f );
+   if (StressObjectNum > 0) drawStressScene();
+   else drawObject();
 
    glBindVertexArray( 0 );
    glUseProgram( 0 );
@@ -281,6 +847,11 @@ void RendererGL::update()
       ObjectRotationAngle += 3;
       if (ObjectRotationAngle == 360) ObjectRotationAngle = 0;
    }
+   const glm::quat rotation = DrawMovingObject ?
+      glm::angleAxis( static_cast<float>(ObjectRotationAngle), glm::vec3(0.0f, 0.0f, 1.0f) ) :
+      glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+   Scene->setRotation( ObjectPivot, rotation );
+   Scene->update();
 }
 
 void RendererGL::play()
@@ -0,0 +1,168 @@
+#include "scene_graph.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+
+void SceneGraph::clear()
+{
+   Translations.clear();
+   Rotations.clear();
+   Scales.clear();
+   WorldMatrices.clear();
+   Parents.clear();
+   Depths.clear();
+   Dirty.clear();
+   Nodes.clear();
+   Slots.clear();
+   LevelRanges.clear();
+   NeedsSorting = false;
+   NeedsLevels = false;
+}
+
+void SceneGraph::reserve(size_t node_num)
+{
+   Translations.reserve( node_num );
+   Rotations.reserve( node_num );
+   Scales.reserve( node_num );
+   WorldMatrices.reserve( node_num );
+   Parents.reserve( node_num );
+   Depths.reserve( node_num );
+   Dirty.reserve( node_num );
+   Nodes.reserve( node_num );
+   Slots.reserve( node_num );
+}
+
+SceneGraph::Node SceneGraph::addNode(Node parent)
+{
+   return addNodes( parent, 1 );
+}
+
+SceneGraph::Node SceneGraph::addNodes(Node parent, size_t node_num)
+{
+   assert( parent == NoNode || parent < Nodes.size() );
+   assert( Nodes.size() + node_num < NoNode );
+
+   const auto first_node = static_cast<Node>(Nodes.size());
+   const uint32_t parent_slot = parent == NoNode ? NoNode : Slots[parent];
+   const uint32_t depth = parent == NoNode ? 0 : Depths[parent_slot] + 1;
+   // Appending keeps the level order unless the new nodes are shallower than the last slot.
+   if (!Depths.empty() && depth < Depths.back()) NeedsSorting = true;
+   NeedsLevels = true;
+
+   const size_t slot_num = Nodes.size() + node_num;
+   Translations.resize( slot_num, glm::vec3(0.0f) );
+   Rotations.resize( slot_num, glm::quat(1.0f, 0.0f, 0.0f, 0.0f) );
+   Scales.resize( slot_num, glm::vec3(1.0f) );
+   WorldMatrices.resize( slot_num, glm::mat4(1.0f) );
+   Parents.resize( slot_num, parent_slot );
+   Depths.resize( slot_num, depth );
+   Dirty.resize( slot_num, 1 );
+   for (size_t i = Nodes.size(); i < slot_num; ++i) {
+      Slots.emplace_back( static_cast<uint32_t>(i) );
+      Nodes.emplace_back( static_cast<Node>(i) );
+   }
+   return first_node;
+}
+
+void SceneGraph::setTranslation(Node node, const glm::vec3& translation)
+{
+   const uint32_t slot = Slots[node];
+   Translations[slot] = translation;
+   Dirty[slot] = 1;
+}
+
+void SceneGraph::setRotation(Node node, const glm::quat& rotation)
+{
+   const uint32_t slot = Slots[node];
+   Rotations[slot] = rotation;
+   Dirty[slot] = 1;
+}
+
+void SceneGraph::setScale(Node node, const glm::vec3& scale)
+{
+   const uint32_t slot = Slots[node];
+   Scales[slot] = scale;
+   Dirty[slot] = 1;
+}
+
+void SceneGraph::setLocalMatrix(Node node, const glm::mat4& matrix)
+{
+   const uint32_t slot = Slots[node];
+   glm::vec3 scale(
+      glm::length( glm::vec3(matrix[0]) ), glm::length( glm::vec3(matrix[1]) ), glm::length( glm::vec3(matrix[2]) )
+   );
+   glm::mat3 rotation(glm::vec3(matrix[0]) / scale.x, glm::vec3(matrix[1]) / scale.y, glm::vec3(matrix[2]) / scale.z);
+   // A mirroring matrix is kept as a negative scale on x so that the rotation stays proper.
+   if (glm::determinant( rotation ) < 0.0f) {
+      scale.x = -scale.x;
+      rotation[0] = -rotation[0];
+   }
+   Translations[slot] = glm::vec3(matrix[3]);
+   Rotations[slot] = glm::quat_cast( rotation );
+   Scales[slot] = scale;
+   Dirty[slot] = 1;
+}
+
+void SceneGraph::sortByDepth()
+{
+   const uint32_t max_depth = *std::max_element( Depths.begin(), Depths.end() );
+   std::vector<uint32_t> offsets(max_depth + 2, 0);
+   for (const auto& depth : Depths) ++offsets[depth + 1];
+   for (uint32_t d = 0; d <= max_depth; ++d) offsets[d + 1] += offsets[d];
+
+   std::vector<uint32_t> new_slots(Nodes.size());
+   for (size_t i = 0; i < Nodes.size(); ++i) new_slots[i] = offsets[Depths[i]]++;
+   for (auto& parent : Parents) {
+      if (parent != NoNode) parent = new_slots[parent];
+   }
+   permute( Translations, new_slots );
+   permute( Rotations, new_slots );
+   permute( Scales, new_slots );
+   permute( WorldMatrices, new_slots );
+   permute( Parents, new_slots );
+   permute( Depths, new_slots );
+   permute( Dirty, new_slots );
+   permute( Nodes, new_slots );
+   for (size_t i = 0; i < Nodes.size(); ++i) Slots[Nodes[i]] = static_cast<uint32_t>(i);
+   NeedsSorting = false;
+}
+
+void SceneGraph::setLevelRanges()
+{
+   LevelRanges.assign( 1, 0 );
+   for (size_t i = 1; i <= Depths.size(); ++i) {
+      if (i == Depths.size() || Depths[i] != Depths[i - 1]) LevelRanges.emplace_back( static_cast<uint32_t>(i) );
+   }
+   NeedsLevels = false;
+}
+
+void SceneGraph::update()
+{
+   if (Nodes.empty()) return;
+   if (NeedsSorting) sortByDepth();
+   if (NeedsLevels) setLevelRanges();
+
+   // The parents of a level are all in earlier levels, whose dirty flags and world matrices are final by then.
+   ThreadPool& pool = ThreadPool::getInstance();
+   for (size_t level = 0; level + 1 < LevelRanges.size(); ++level) {
+      const uint32_t level_begin = LevelRanges[level];
+      pool.parallelFor(
+         LevelRanges[level + 1] - level_begin, 1 << 12,
+         [&](size_t begin, size_t end) {
+            for (size_t slot = level_begin + begin; slot < level_begin + end; ++slot) {
+               const uint32_t parent = Parents[slot];
+               if (parent != NoNode && Dirty[parent] != 0) Dirty[slot] = 1;
+               if (Dirty[slot] == 0) continue;
+
+               glm::mat4 local = glm::mat4_cast( Rotations[slot] );
+               local[0] *= Scales[slot].x;
+               local[1] *= Scales[slot].y;
+               local[2] *= Scales[slot].z;
+               local[3] = glm::vec4(Translations[slot], 1.0f);
+               WorldMatrices[slot] = parent == NoNode ? local : WorldMatrices[parent] * local;
+            }
+         }
+      );
+   }
+   std::fill( Dirty.begin(), Dirty.end(), 0 );
+}
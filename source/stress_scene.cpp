@@ -0,0 +1,427 @@
+#include "stress_scene.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+StressSceneGL::StressSceneGL() :
+   ShapeDrawOffsets{}, MaterialBuffer( 0 ), CulledCommandBuffer( 0 ), CulledDrawCountBuffer( 0 ),
+   VisibilityBuffer( 0 ),
+   Root( SceneGraph::NoNode ), Lights( std::make_unique<LightGL>() ), Extent( 0.0f )
+{
+}
+
+StressSceneGL::~StressSceneGL()
+{
+   releaseTextures();
+   releaseBuffers();
+}
+
+void StressSceneGL::releaseBuffers()
+{
+   if (MaterialBuffer != 0) glDeleteBuffers( 1, &MaterialBuffer );
+   if (CulledCommandBuffer != 0) glDeleteBuffers( 1, &CulledCommandBuffer );
+   if (CulledDrawCountBuffer != 0) glDeleteBuffers( 1, &CulledDrawCountBuffer );
+   if (VisibilityBuffer != 0) glDeleteBuffers( 1, &VisibilityBuffer );
+   MaterialBuffer = 0;
+   CulledCommandBuffer = 0;
+   CulledDrawCountBuffer = 0;
+   VisibilityBuffer = 0;
+}
+
+uint64_t StressSceneGL::getRandomBits(uint64_t seed, uint64_t stream, uint64_t index)
+{
+   // SplitMix64 over a key mixed from the three inputs.
+   uint64_t x = seed * 0x9E3779B97F4A7C15ull ^ stream * 0xC2B2AE3D27D4EB4Full ^ index * 0x165667B19E3779F9ull;
+   x ^= x >> 30;
+   x *= 0xBF58476D1CE4E5B9ull;
+   x ^= x >> 27;
+   x *= 0x94D049BB133111EBull;
+   x ^= x >> 31;
+   return x;
+}
+
+void StressSceneGL::setGrid(
+   Mesh& mesh,
+   int column_num,
+   int row_num,
+   const std::function<void(float, float, glm::vec3&, glm::vec3&)>& get_vertex
+)
+{
+   const size_t base = mesh.Vertices.size();
+   const size_t first_index = mesh.Indices.size();
+   const auto row_size = static_cast<size_t>(column_num + 1);
+   mesh.Vertices.resize( base + row_size * (row_num + 1) );
+   mesh.Normals.resize( mesh.Vertices.size() );
+   mesh.Textures.resize( mesh.Vertices.size() );
+   mesh.Indices.resize( first_index + static_cast<size_t>(6) * column_num * row_num );
+   ThreadPool::getInstance().parallelFor(
+      static_cast<size_t>(row_num + 1), 16,
+      [&](size_t begin, size_t end) {
+         for (size_t j = begin; j < end; ++j) {
+            const float v = static_cast<float>(j) / static_cast<float>(row_num);
+            for (size_t i = 0; i < row_size; ++i) {
+               const size_t vertex = base + j * row_size + i;
+               const float u = static_cast<float>(i) / static_cast<float>(column_num);
+               get_vertex( u, v, mesh.Vertices[vertex], mesh.Normals[vertex] );
+               mesh.Textures[vertex] = glm::vec2(u, v);
+               if (j == static_cast<size_t>(row_num) || i == static_cast<size_t>(column_num)) continue;
+
+               GLuint* quad = mesh.Indices.data() + first_index + 6 * (j * column_num + i);
+               const auto v0 = static_cast<GLuint>(vertex);
+               const auto v1 = static_cast<GLuint>(vertex + row_size);
+               quad[0] = v0;
+               quad[1] = v0 + 1;
+               quad[2] = v1 + 1;
+               quad[3] = v0;
+               quad[4] = v1 + 1;
+               quad[5] = v1;
+            }
+         }
+      }
+   );
+}
+
+void StressSceneGL::getSphere(Mesh& mesh, int tessellation)
+{
+   const float pi = glm::pi<float>();
+   setGrid(
+      mesh, tessellation, std::max( tessellation / 2, 2 ),
+      [pi](float u, float v, glm::vec3& position, glm::vec3& normal) {
+         const float theta = 2.0f * pi * u;
+         const float phi = pi * (v - 0.5f);
+         normal = glm::vec3(std::cos( phi ) * std::cos( theta ), std::sin( phi ), -std::cos( phi ) * std::sin( theta ));
+         position = normal;
+      }
+   );
+}
+
+void StressSceneGL::getCube(Mesh& mesh, int tessellation)
+{
+   const int segment_num = std::max( tessellation / 4, 1 );
+   for (int axis = 0; axis < 3; ++axis) {
+      for (const float sign : { 1.0f, -1.0f }) {
+         glm::vec3 normal(0.0f), u_axis(0.0f), v_axis(0.0f);
+         normal[axis] = sign;
+         u_axis[(axis + 1) % 3] = sign;
+         v_axis[(axis + 2) % 3] = 1.0f;
+         setGrid(
+            mesh, segment_num, segment_num,
+            [=](float u, float v, glm::vec3& position, glm::vec3& face_normal) {
+               position = normal + u_axis * (2.0f * u - 1.0f) + v_axis * (2.0f * v - 1.0f);
+               face_normal = normal;
+            }
+         );
+      }
+   }
+}
+
+void StressSceneGL::getTorus(Mesh& mesh, int tessellation)
+{
+   constexpr float major_radius = 0.7f;
+   constexpr float minor_radius = 0.3f;
+   const float pi = glm::pi<float>();
+   setGrid(
+      mesh, tessellation, std::max( tessellation / 2, 3 ),
+      [pi](float u, float v, glm::vec3& position, glm::vec3& normal) {
+         const float theta = 2.0f * pi * u;
+         const float phi = 2.0f * pi * v;
+         const glm::vec3 ring(std::cos( theta ), 0.0f, -std::sin( theta ));
+         normal = ring * std::cos( phi ) + glm::vec3(0.0f, std::sin( phi ), 0.0f);
+         position = ring * major_radius + normal * minor_radius;
+      }
+   );
+}
+
+void StressSceneGL::releaseTextures()
+{
+   TextureSet.release();
+   if (!TextureIDs.empty()) glDeleteTextures( static_cast<GLsizei>(TextureIDs.size()), TextureIDs.data() );
+   TextureIDs.clear();
+}
+
+void StressSceneGL::createTextures(const Description& description)
+{
+   releaseTextures();
+   if (description.TextureNum <= 0 || description.TextureSize <= 0) return;
+
+   // Each texture is a checkerboard of two random colors at a random frequency.
+   constexpr uint64_t stream = 1;
+   const auto size = static_cast<size_t>(description.TextureSize);
+   std::vector<uint8_t> image(size * size * 4);
+   for (int t = 0; t < description.TextureNum; ++t) {
+      std::array<glm::u8vec4, 2> colors;
+      for (size_t c = 0; c < colors.size(); ++c) {
+         for (int k = 0; k < 3; ++k) {
+            const float random = getRandomFloat( description.Seed, stream, static_cast<uint64_t>(t) * 8 + c * 3 + k );
+            colors[c][k] = static_cast<uint8_t>(64.0f + 191.0f * random);
+         }
+         colors[c][3] = 255;
+      }
+      const uint64_t frequency = getRandomBits( description.Seed, stream, static_cast<uint64_t>(t) * 8 + 6 ) % 4;
+      const size_t cell_size = std::max( size >> (1 + frequency), size_t{ 1 } );
+      ThreadPool::getInstance().parallelFor(
+         size, 16,
+         [&](size_t begin, size_t end) {
+            for (size_t y = begin; y < end; ++y) {
+               for (size_t x = 0; x < size; ++x) {
+                  const glm::u8vec4& color = colors[(x / cell_size + y / cell_size) & 1];
+                  std::memcpy( image.data() + (y * size + x) * 4, &color, 4 );
+               }
+            }
+         }
+      );
+
+      GLuint texture_id = 0;
+      glCreateTextures( GL_TEXTURE_2D, 1, &texture_id );
+      const auto level_num = static_cast<GLsizei>(std::log2( static_cast<float>(size) )) + 1;
+      glTextureStorage2D( texture_id, level_num, GL_RGBA8, description.TextureSize, description.TextureSize );
+      glTextureSubImage2D(
+         texture_id, 0, 0, 0, description.TextureSize, description.TextureSize, GL_RGBA, GL_UNSIGNED_BYTE, image.data()
+      );
+      glTextureParameteri( texture_id, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
+      glTextureParameteri( texture_id, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+      glTextureParameteri( texture_id, GL_TEXTURE_WRAP_S, GL_REPEAT );
+      glTextureParameteri( texture_id, GL_TEXTURE_WRAP_T, GL_REPEAT );
+      glGenerateTextureMipmap( texture_id );
+      TextureIDs.emplace_back( texture_id );
+   }
+   TextureSet.setTextures( TextureIDs, TextureSetGL::isBindlessSupported() );
+}
+
+void StressSceneGL::createInstances(const Description& description)
+{
+   constexpr uint64_t stream = 2;
+   constexpr uint64_t randoms_per_instance = 16;
+   auto side = static_cast<size_t>(std::round( std::cbrt( static_cast<double>(description.ObjectNum) ) ));
+   while (side * side * side < description.ObjectNum) ++side;
+   Extent = 0.5f * description.Spacing * static_cast<float>(side);
+   Instances.resize( description.ObjectNum );
+   Graph.clear();
+   Graph.reserve( description.ObjectNum + 1 );
+   Root = Graph.addNode();
+   const SceneGraph::Node first_node = Graph.addNodes( Root, description.ObjectNum );
+   ThreadPool::getInstance().parallelFor(
+      description.ObjectNum, 1 << 12,
+      [&](size_t begin, size_t end) {
+         for (size_t i = begin; i < end; ++i) {
+            const auto get_random = [&](uint64_t k) {
+               return getRandomFloat( description.Seed, stream, i * randoms_per_instance + k );
+            };
+            const glm::vec3 cell(
+               static_cast<float>(i % side), static_cast<float>(i / side % side), static_cast<float>(i / (side * side))
+            );
+            const glm::vec3 jitter = glm::vec3(get_random( 0 ), get_random( 1 ), get_random( 2 )) - 0.5f;
+            const glm::vec3 position = (cell + 0.5f) * description.Spacing - Extent + jitter;
+            glm::vec3 axis(get_random( 3 ) - 0.5f, get_random( 4 ) - 0.5f, get_random( 5 ) - 0.5f);
+            if (glm::dot( axis, axis ) < 1e-6f) axis = glm::vec3(0.0f, 1.0f, 0.0f);
+            const float angle = 2.0f * glm::pi<float>() * get_random( 6 );
+            const float scale = 0.5f + 0.5f * get_random( 7 );
+
+            Instance& instance = Instances[i];
+            instance.Node = first_node + static_cast<SceneGraph::Node>(i);
+            Graph.setTranslation( instance.Node, position );
+            Graph.setRotation( instance.Node, glm::angleAxis( angle, glm::normalize( axis ) ) );
+            Graph.setScale( instance.Node, glm::vec3(scale) );
+            instance.DiffuseColor = glm::vec4(get_random( 8 ), get_random( 9 ), get_random( 10 ), 1.0f);
+            instance.SpecularColor = glm::vec4(glm::vec3(get_random( 11 )), 1.0f);
+            instance.SpecularExponent = 4.0f + 124.0f * get_random( 12 );
+            instance.Shape = static_cast<ShapeType>(
+               getRandomBits( description.Seed, stream, i * randoms_per_instance + 13 ) % ShapeTypeNum
+            );
+            const uint64_t texture = getRandomBits( description.Seed, stream, i * randoms_per_instance + 14 );
+            instance.Texture = TextureIDs.empty() ? -1 : static_cast<int>(texture % TextureIDs.size());
+         }
+      }
+   );
+}
+
+void StressSceneGL::createLights(const Description& description)
+{
+   constexpr uint64_t stream = 3;
+   constexpr int max_light_num = 32;
+   Lights = std::make_unique<LightGL>();
+   const int light_num = std::clamp( description.LightNum, 0, max_light_num );
+   for (int i = 0; i < light_num; ++i) {
+      const auto get_random = [&](uint64_t k) {
+         return getRandomFloat( description.Seed, stream, static_cast<uint64_t>(i) * 8 + k );
+      };
+      const glm::vec4 position(
+         (2.0f * get_random( 0 ) - 1.0f) * Extent,
+         Extent + description.Spacing,
+         (2.0f * get_random( 1 ) - 1.0f) * Extent,
+         1.0f
+      );
+      const glm::vec4 color(
+         0.3f + 0.7f * get_random( 2 ), 0.3f + 0.7f * get_random( 3 ), 0.3f + 0.7f * get_random( 4 ), 1.0f
+      );
+      Lights->addLight(
+         position,
+         glm::vec4(glm::vec3(0.1f / static_cast<float>(light_num)), 1.0f),
+         color / static_cast<float>(light_num),
+         glm::vec4(1.0f),
+         glm::vec3(0.0f, -1.0f, 0.0f),
+         180.0f,
+         0.0f,
+         4.0f * Extent + description.Spacing
+      );
+   }
+}
+
+void StressSceneGL::generate(const Description& description, GeometryArenaGL* arena)
+{
+   assert( description.Tessellation >= 3 );
+
+   std::array<Mesh, ShapeTypeNum> meshes;
+   getSphere( meshes[Sphere], description.Tessellation );
+   getCube( meshes[Cube], description.Tessellation );
+   getTorus( meshes[Torus], description.Tessellation );
+   for (int i = 0; i < ShapeTypeNum; ++i) {
+      Shapes[i] = std::make_unique<ObjectGL>();
+      Shapes[i]->setGeometryArena( arena );
+      Shapes[i]->setObject( GL_TRIANGLES, meshes[i].Vertices, meshes[i].Normals, meshes[i].Textures );
+      Shapes[i]->setIndexBuffer( meshes[i].Indices );
+   }
+
+   createTextures( description );
+   createInstances( description );
+   createLights( description );
+   createBatches();
+   updateTransforms();
+}
+
+void StressSceneGL::createBatches()
+{
+   // A counting sort on the key shape * (TextureNum + 1) + texture + 1, where -1 stands for no texture.
+   const size_t texture_key_num = TextureIDs.size() + 1;
+   std::vector<size_t> offsets(ShapeTypeNum * texture_key_num + 1, 0);
+   const auto get_key = [texture_key_num](const Instance& instance) {
+      return static_cast<size_t>(instance.Shape) * texture_key_num + static_cast<size_t>(instance.Texture + 1);
+   };
+   for (const auto& instance : Instances) ++offsets[get_key( instance ) + 1];
+   for (size_t k = 1; k < offsets.size(); ++k) offsets[k] += offsets[k - 1];
+
+   Batches.clear();
+   for (int s = 0; s < ShapeTypeNum; ++s) {
+      const size_t shape_begin = offsets[s * texture_key_num];
+      for (size_t t = 0; t < texture_key_num; ++t) {
+         const size_t key = s * texture_key_num + t;
+         if (offsets[key + 1] == offsets[key]) continue;
+         Batches.push_back(
+            {
+               static_cast<ShapeType>(s), static_cast<int>(t) - 1,
+               static_cast<GLsizei>(offsets[key] - shape_begin), static_cast<GLsizei>(offsets[key + 1] - offsets[key]),
+               offsets[key]
+            }
+         );
+      }
+      InstanceOrders[s].resize( offsets[(s + 1) * texture_key_num] - shape_begin );
+      ShapeDrawOffsets[s] = shape_begin;
+   }
+   ShapeDrawOffsets[ShapeTypeNum] = Instances.size();
+
+   std::vector<size_t> next(offsets.begin(), offsets.end() - 1);
+   for (size_t i = 0; i < Instances.size(); ++i) {
+      const Instance& instance = Instances[i];
+      const size_t position = next[get_key( instance )]++ - offsets[instance.Shape * texture_key_num];
+      InstanceOrders[instance.Shape][position] = static_cast<uint32_t>(i);
+   }
+
+   // Every instance has its own material, so an instance and its material share their index.
+   std::vector<ObjectGL::InstanceMaterial> materials(Instances.size());
+   ThreadPool& pool = ThreadPool::getInstance();
+   pool.parallelFor(
+      Instances.size(), 1 << 12,
+      [&](size_t begin, size_t end) {
+         for (size_t i = begin; i < end; ++i) {
+            const Instance& instance = Instances[i];
+            materials[i] = {
+               glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), instance.DiffuseColor, instance.DiffuseColor,
+               instance.SpecularColor, instance.SpecularExponent, instance.Texture,
+               instance.Texture >= 0 ? TextureSet.getHandle( instance.Texture ) : 0
+            };
+         }
+      }
+   );
+   releaseBuffers();
+   glCreateBuffers( 1, &MaterialBuffer );
+   glNamedBufferStorage(
+      MaterialBuffer, sizeof( ObjectGL::InstanceMaterial ) * std::max( materials.size(), size_t{ 1 } ),
+      materials.data(), 0
+   );
+   // Only the GPU writes and reads these.
+   glCreateBuffers( 1, &CulledCommandBuffer );
+   glNamedBufferStorage(
+      CulledCommandBuffer,
+      sizeof( ObjectGL::DrawElementsIndirectCommand ) * std::max( Instances.size(), size_t{ 1 } ), nullptr, 0
+   );
+   glCreateBuffers( 1, &CulledDrawCountBuffer );
+   glNamedBufferStorage(
+      CulledDrawCountBuffer, sizeof( GLuint ) * std::max( Batches.size(), size_t{ 1 } ), nullptr, 0
+   );
+   // Nothing was visible before the first frame.
+   glCreateBuffers( 1, &VisibilityBuffer );
+   glNamedBufferStorage( VisibilityBuffer, sizeof( GLuint ) * std::max( Instances.size(), size_t{ 1 } ), nullptr, 0 );
+   glClearNamedBufferData( VisibilityBuffer, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr );
+
+   for (int s = 0; s < ShapeTypeNum; ++s) {
+      const std::vector<uint32_t>& order = InstanceOrders[s];
+      ShapeInstances[s].resize( order.size() );
+      pool.parallelFor(
+         order.size(), 1 << 12,
+         [&](size_t begin, size_t end) {
+            for (size_t j = begin; j < end; ++j) ShapeInstances[s][j] = { glm::mat4(1.0f), order[j], { 0, 0, 0 } };
+         }
+      );
+   }
+   Culler.resize( Instances.size() );
+}
+
+void StressSceneGL::updateTransforms()
+{
+   Graph.update();
+   for (int s = 0; s < ShapeTypeNum; ++s) {
+      const std::vector<uint32_t>& order = InstanceOrders[s];
+      const glm::vec4 center(Shapes[s]->getBoundingSphereCenter(), 1.0f);
+      const float radius = Shapes[s]->getBoundingSphereRadius();
+      ThreadPool::getInstance().parallelFor(
+         order.size(), 1 << 12,
+         [&](size_t begin, size_t end) {
+            for (size_t j = begin; j < end; ++j) {
+               const glm::mat4& to_world = Graph.getWorldMatrix( Instances[order[j]].Node );
+               ShapeInstances[s][j].WorldMatrix = to_world;
+               // The longest axis of the world matrix scales the radius enough for any rotation.
+               const float scale = std::sqrt(
+                  std::max(
+                     { glm::dot( to_world[0], to_world[0] ), glm::dot( to_world[1], to_world[1] ),
+                       glm::dot( to_world[2], to_world[2] ) }
+                  )
+               );
+               Culler.setSphere( ShapeDrawOffsets[s] + j, glm::vec3(to_world * center), radius * scale );
+            }
+         }
+      );
+      Shapes[s]->setInstances( ShapeInstances[s] );
+   }
+}
+
+void StressSceneGL::forEachVisibleRun(const std::function<void(const Batch&, GLsizei, GLsizei)>& draw) const
+{
+   // Both the batches and the visible draws are in ascending order of draws, so one pass pairs them.
+   const std::vector<uint32_t>& visible = Culler.getVisibleIndices();
+   size_t k = 0;
+   for (const auto& batch : Batches) {
+      const size_t batch_end = batch.FirstDraw + static_cast<size_t>(batch.InstanceNum);
+      while (k < visible.size() && visible[k] < batch_end) {
+         const size_t run_begin = visible[k];
+         size_t run_end = run_begin + 1;
+         for (++k; k < visible.size() && visible[k] == run_end && run_end < batch_end; ++k) ++run_end;
+         draw(
+            batch,
+            batch.FirstInstance + static_cast<GLsizei>(run_begin - batch.FirstDraw),
+            static_cast<GLsizei>(run_end - run_begin)
+         );
+      }
+   }
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+#include "texture_set.h"
+
+#include <algorithm>
+#include <cstring>
+
+TextureSetGL::TextureSetGL() : ArrayTexture( 0 )
+{
+}
+
+TextureSetGL::~TextureSetGL()
+{
+   release();
+}
+
+const TextureSetGL::BindlessFunctions& TextureSetGL::getBindlessFunctions()
+{
+   // Loaded once the context exists, and left empty when either extension is not there. ARB_bindless_texture alone
+   // leaves a handle that is not dynamically uniform undefined, and the handles of the instanced materials vary
+   // within one draw, so NV_gpu_shader5 has to allow that as well.
+   static const BindlessFunctions functions = []() {
+      BindlessFunctions loaded;
+      bool bindless_exists = false, shader5_exists = false;
+      GLint extension_num = 0;
+      glGetIntegerv( GL_NUM_EXTENSIONS, &extension_num );
+      for (GLint i = 0; i < extension_num; ++i) {
+         const auto* name = reinterpret_cast<const char*>(glGetStringi( GL_EXTENSIONS, static_cast<GLuint>(i) ));
+         if (name == nullptr) continue;
+         if (std::strcmp( name, "GL_ARB_bindless_texture" ) == 0) bindless_exists = true;
+         else if (std::strcmp( name, "GL_NV_gpu_shader5" ) == 0) shader5_exists = true;
+      }
+      if (bindless_exists && shader5_exists) {
+         loaded.GetTextureHandle = reinterpret_cast<decltype(loaded.GetTextureHandle)>(
+            glfwGetProcAddress( "glGetTextureHandleARB" )
+         );
+         loaded.MakeTextureHandleResident = reinterpret_cast<decltype(loaded.MakeTextureHandleResident)>(
+            glfwGetProcAddress( "glMakeTextureHandleResidentARB" )
+         );
+         loaded.MakeTextureHandleNonResident = reinterpret_cast<decltype(loaded.MakeTextureHandleNonResident)>(
+            glfwGetProcAddress( "glMakeTextureHandleNonResidentARB" )
+         );
+      }
+      return loaded;
+   }();
+   return functions;
+}
+
+bool TextureSetGL::isBindlessSupported()
+{
+   const BindlessFunctions& functions = getBindlessFunctions();
+   return functions.GetTextureHandle != nullptr && functions.MakeTextureHandleResident != nullptr &&
+      functions.MakeTextureHandleNonResident != nullptr;
+}
+
+void TextureSetGL::release()
+{
+   if (!Handles.empty()) {
+      const BindlessFunctions& functions = getBindlessFunctions();
+      for (const auto handle : Handles) functions.MakeTextureHandleNonResident( handle );
+   }
+   if (ArrayTexture != 0) glDeleteTextures( 1, &ArrayTexture );
+   Handles.clear();
+   ArrayTexture = 0;
+}
+
+bool TextureSetGL::setTextures(const std::vector<GLuint>& textures, bool use_bindless)
+{
+   release();
+   if (textures.empty()) return true;
+
+   if (use_bindless && isBindlessSupported()) {
+      setHandles( textures );
+      return true;
+   }
+   return setArrayTexture( textures );
+}
+
+void TextureSetGL::setHandles(const std::vector<GLuint>& textures)
+{
+   // A texture keeps its sampling state from here on, as it is baked into the handle.
+   const BindlessFunctions& functions = getBindlessFunctions();
+   Handles.resize( textures.size() );
+   for (size_t i = 0; i < textures.size(); ++i) {
+      Handles[i] = functions.GetTextureHandle( textures[i] );
+      functions.MakeTextureHandleResident( Handles[i] );
+   }
+}
+
+bool TextureSetGL::setArrayTexture(const std::vector<GLuint>& textures)
+{
+   const auto get_format = [](GLuint texture) {
+      glm::ivec4 format;
+      glGetTextureLevelParameteriv( texture, 0, GL_TEXTURE_WIDTH, &format[0] );
+      glGetTextureLevelParameteriv( texture, 0, GL_TEXTURE_HEIGHT, &format[1] );
+      glGetTextureLevelParameteriv( texture, 0, GL_TEXTURE_INTERNAL_FORMAT, &format[2] );
+      glGetTextureParameteriv( texture, GL_TEXTURE_IMMUTABLE_LEVELS, &format[3] );
+      return format;
+   };
+   const glm::ivec4 format = get_format( textures[0] );
+   for (const auto texture : textures) {
+      if (get_format( texture ) != format || format[3] == 0) {
+         std::cerr << "Could not pack textures of different sizes, formats or mutable storage into an array\n";
+         return false;
+      }
+   }
+
+   const auto width = format[0];
+   const auto height = format[1];
+   const auto level_num = format[3];
+   const auto layer_num = static_cast<GLsizei>(textures.size());
+   glCreateTextures( GL_TEXTURE_2D_ARRAY, 1, &ArrayTexture );
+   glTextureStorage3D( ArrayTexture, level_num, static_cast<GLenum>(format[2]), width, height, layer_num );
+   for (GLsizei layer = 0; layer < layer_num; ++layer) {
+      for (GLint level = 0; level < level_num; ++level) {
+         glCopyImageSubData(
+            textures[layer], GL_TEXTURE_2D, level, 0, 0, 0,
+            ArrayTexture, GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+            std::max( width >> level, 1 ), std::max( height >> level, 1 ), 1
+         );
+      }
+   }
+   glTextureParameteri( ArrayTexture, GL_TEXTURE_MIN_FILTER, level_num > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR );
+   glTextureParameteri( ArrayTexture, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+   glTextureParameteri( ArrayTexture, GL_TEXTURE_WRAP_S, GL_REPEAT );
+   glTextureParameteri( ArrayTexture, GL_TEXTURE_WRAP_T, GL_REPEAT );
+   return true;
+}
@@ -0,0 +1,96 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool() :
+   Terminate( false ), JobID( 0 ), Count( 0 ), CountPerTask( 0 ), TaskNum( 0 ), ActiveWorkerNum( 0 ), NextTask( 0 ),
+   Task( nullptr )
+{
+   const uint worker_num = std::max( std::thread::hardware_concurrency(), 1u ) - 1;
+   for (uint i = 0; i < worker_num; ++i) Workers.emplace_back( &ThreadPool::work, this );
+}
+
+ThreadPool::~ThreadPool()
+{
+   {
+      std::lock_guard<std::mutex> lock(Lock);
+      Terminate = true;
+   }
+   JobReady.notify_all();
+   for (auto& worker : Workers) worker.join();
+}
+
+ThreadPool& ThreadPool::getInstance()
+{
+   static ThreadPool pool;
+   return pool;
+}
+
+void ThreadPool::runTasks()
+{
+   size_t task_index;
+   while ((task_index = NextTask.fetch_add( 1 )) < TaskNum) {
+      const size_t begin = task_index * CountPerTask;
+      const size_t end = std::min( begin + CountPerTask, Count );
+      (*Task)( begin, end );
+   }
+}
+
+void ThreadPool::work()
+{
+   IsWorkerThread = true;
+   uint64_t last_job_id = 0;
+   while (true) {
+      {
+         std::unique_lock<std::mutex> lock(Lock);
+         JobReady.wait( lock, [this, last_job_id] { return Terminate || JobID != last_job_id; } );
+         if (Terminate) return;
+         last_job_id = JobID;
+         ActiveWorkerNum++;
+      }
+      runTasks();
+      {
+         std::lock_guard<std::mutex> lock(Lock);
+         ActiveWorkerNum--;
+      }
+      JobDone.notify_all();
+   }
+}
+
+void ThreadPool::parallelFor(
+   size_t count,
+   size_t min_count_per_task,
+   const std::function<void(size_t, size_t)>& task
+)
+{
+   if (count == 0) return;
+
+   // Nested calls from a worker and small inputs are not worth the hand-off.
+   const size_t max_task_num = static_cast<size_t>(getThreadNum()) * 4;
+   const size_t task_num = std::min( max_task_num, count / std::max( min_count_per_task, size_t(1) ) );
+   if (IsWorkerThread || Workers.empty() || task_num <= 1) {
+      task( 0, count );
+      return;
+   }
+
+   // One job runs at a time; concurrent callers from other threads queue up here.
+   std::lock_guard<std::mutex> job_lock(JobLock);
+   {
+      // A worker that woke up late for the previous job may still be draining it.
+      std::unique_lock<std::mutex> lock(Lock);
+      JobDone.wait( lock, [this] { return ActiveWorkerNum == 0; } );
+      Count = count;
+      CountPerTask = (count + task_num - 1) / task_num;
+      TaskNum = (count + CountPerTask - 1) / CountPerTask;
+      Task = &task;
+      NextTask = 0;
+      JobID++;
+   }
+   JobReady.notify_all();
+
+   IsWorkerThread = true;
+   runTasks();
+   IsWorkerThread = false;
+
+   // Every task has been claimed, so the job is done once no worker is running one.
+   std::unique_lock<std::mutex> lock(Lock);
+   JobDone.wait( lock, [this] { return ActiveWorkerNum == 0; } );
+}
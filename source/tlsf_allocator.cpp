@@ -0,0 +1,204 @@
+#include "tlsf_allocator.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+TLSFAllocator::TLSFAllocator(size_t capacity) :
+   Capacity( 0 ), UsedSize( 0 ), FirstLevelBitmap( 0 ), SecondLevelBitmaps{}, FreeHeads{},
+   LastPhysical( InvalidHandle )
+{
+   for (auto& heads : FreeHeads) {
+      for (auto& head : heads) head = InvalidHandle;
+   }
+   if (capacity > 0) grow( capacity );
+}
+
+int TLSFAllocator::getHighestBit(uint64_t value)
+{
+   assert( value != 0 );
+#ifdef _MSC_VER
+   unsigned long index;
+   _BitScanReverse64( &index, value );
+   return static_cast<int>(index);
+#else
+   return 63 - __builtin_clzll( value );
+#endif
+}
+
+int TLSFAllocator::getLowestBit(uint64_t value)
+{
+   assert( value != 0 );
+#ifdef _MSC_VER
+   unsigned long index;
+   _BitScanForward64( &index, value );
+   return static_cast<int>(index);
+#else
+   return __builtin_ctzll( value );
+#endif
+}
+
+void TLSFAllocator::getLevels(size_t size, int& first_level, int& second_level)
+{
+   // Sizes below SecondLevelNum are bucketed linearly in the first level 0.
+   if (size < SecondLevelNum) {
+      first_level = 0;
+      second_level = static_cast<int>(size);
+      return;
+   }
+   const int highest_bit = getHighestBit( size );
+   first_level = highest_bit - SecondLevelLog2 + 1;
+   second_level = static_cast<int>(size >> (highest_bit - SecondLevelLog2)) - SecondLevelNum;
+}
+
+uint32_t TLSFAllocator::createBlock(size_t offset, size_t size)
+{
+   const Block block{ offset, size, InvalidHandle, InvalidHandle, InvalidHandle, InvalidHandle, true };
+   if (UnusedBlocks.empty()) {
+      Blocks.emplace_back( block );
+      return static_cast<uint32_t>(Blocks.size() - 1);
+   }
+   const uint32_t index = UnusedBlocks.back();
+   UnusedBlocks.pop_back();
+   Blocks[index] = block;
+   return index;
+}
+
+void TLSFAllocator::destroyBlock(uint32_t block)
+{
+   UnusedBlocks.emplace_back( block );
+}
+
+void TLSFAllocator::insertFreeBlock(uint32_t block)
+{
+   int first_level, second_level;
+   getLevels( Blocks[block].Size, first_level, second_level );
+   uint32_t& head = FreeHeads[first_level][second_level];
+   Blocks[block].IsFree = true;
+   Blocks[block].PreviousFree = InvalidHandle;
+   Blocks[block].NextFree = head;
+   if (head != InvalidHandle) Blocks[head].PreviousFree = block;
+   head = block;
+   FirstLevelBitmap |= 1ull << first_level;
+   SecondLevelBitmaps[first_level] |= 1u << second_level;
+}
+
+void TLSFAllocator::removeFreeBlock(uint32_t block)
+{
+   int first_level, second_level;
+   getLevels( Blocks[block].Size, first_level, second_level );
+   const uint32_t previous = Blocks[block].PreviousFree;
+   const uint32_t next = Blocks[block].NextFree;
+   if (previous != InvalidHandle) Blocks[previous].NextFree = next;
+   if (next != InvalidHandle) Blocks[next].PreviousFree = previous;
+
+   uint32_t& head = FreeHeads[first_level][second_level];
+   if (head == block) {
+      head = next;
+      if (head == InvalidHandle) {
+         SecondLevelBitmaps[first_level] &= ~(1u << second_level);
+         if (SecondLevelBitmaps[first_level] == 0) FirstLevelBitmap &= ~(1ull << first_level);
+      }
+   }
+   Blocks[block].IsFree = false;
+}
+
+uint32_t TLSFAllocator::findFreeBlock(size_t size) const
+{
+   // Rounding the size up to the next bucket makes any block of the found bucket large enough.
+   size_t rounded_size = size;
+   if (size >= SecondLevelNum) rounded_size += (size_t{ 1 } << (getHighestBit( size ) - SecondLevelLog2)) - 1;
+
+   int first_level, second_level;
+   getLevels( rounded_size, first_level, second_level );
+   uint32_t second_level_bitmap = SecondLevelBitmaps[first_level] & (~0u << second_level);
+   if (second_level_bitmap == 0) {
+      const uint64_t first_level_bitmap =
+         first_level + 1 < 64 ? FirstLevelBitmap & (~0ull << (first_level + 1)) : 0;
+      if (first_level_bitmap != 0) {
+         first_level = getLowestBit( first_level_bitmap );
+         second_level_bitmap = SecondLevelBitmaps[first_level];
+      }
+   }
+   if (second_level_bitmap != 0) return FreeHeads[first_level][getLowestBit( second_level_bitmap )];
+
+   // Only the bucket of the size itself is left, whose blocks may or may not be large enough.
+   getLevels( size, first_level, second_level );
+   for (uint32_t block = FreeHeads[first_level][second_level]; block != InvalidHandle; block = Blocks[block].NextFree) {
+      if (Blocks[block].Size >= size) return block;
+   }
+   return InvalidHandle;
+}
+
+TLSFAllocator::Allocation TLSFAllocator::allocate(size_t size)
+{
+   if (size == 0) return {};
+
+   const uint32_t block = findFreeBlock( size );
+   if (block == InvalidHandle) return {};
+
+   removeFreeBlock( block );
+   if (Blocks[block].Size > size) {
+      const uint32_t remainder = createBlock( Blocks[block].Offset + size, Blocks[block].Size - size );
+      const uint32_t next = Blocks[block].NextPhysical;
+      Blocks[remainder].PreviousPhysical = block;
+      Blocks[remainder].NextPhysical = next;
+      if (next != InvalidHandle) Blocks[next].PreviousPhysical = remainder;
+      else LastPhysical = remainder;
+      Blocks[block].NextPhysical = remainder;
+      Blocks[block].Size = size;
+      insertFreeBlock( remainder );
+   }
+   UsedSize += size;
+   return { Blocks[block].Offset, size, block };
+}
+
+void TLSFAllocator::free(const Allocation& allocation)
+{
+   if (!allocation.isValid()) return;
+
+   uint32_t block = allocation.Handle;
+   assert( !Blocks[block].IsFree && Blocks[block].Offset == allocation.Offset );
+   UsedSize -= Blocks[block].Size;
+
+   const uint32_t previous = Blocks[block].PreviousPhysical;
+   if (previous != InvalidHandle && Blocks[previous].IsFree) {
+      removeFreeBlock( previous );
+      Blocks[previous].Size += Blocks[block].Size;
+      Blocks[previous].NextPhysical = Blocks[block].NextPhysical;
+      if (Blocks[block].NextPhysical != InvalidHandle) Blocks[Blocks[block].NextPhysical].PreviousPhysical = previous;
+      else LastPhysical = previous;
+      destroyBlock( block );
+      block = previous;
+   }
+   const uint32_t next = Blocks[block].NextPhysical;
+   if (next != InvalidHandle && Blocks[next].IsFree) {
+      removeFreeBlock( next );
+      Blocks[block].Size += Blocks[next].Size;
+      Blocks[block].NextPhysical = Blocks[next].NextPhysical;
+      if (Blocks[next].NextPhysical != InvalidHandle) Blocks[Blocks[next].NextPhysical].PreviousPhysical = block;
+      else LastPhysical = block;
+      destroyBlock( next );
+   }
+   insertFreeBlock( block );
+}
+
+void TLSFAllocator::grow(size_t new_capacity)
+{
+   assert( new_capacity > Capacity );
+
+   const size_t added_size = new_capacity - Capacity;
+   if (LastPhysical != InvalidHandle && Blocks[LastPhysical].IsFree) {
+      removeFreeBlock( LastPhysical );
+      Blocks[LastPhysical].Size += added_size;
+      insertFreeBlock( LastPhysical );
+   }
+   else {
+      const uint32_t block = createBlock( Capacity, added_size );
+      Blocks[block].PreviousPhysical = LastPhysical;
+      if (LastPhysical != InvalidHandle) Blocks[LastPhysical].NextPhysical = block;
+      LastPhysical = block;
+      insertFreeBlock( block );
+   }
+   Capacity = new_capacity;
+}